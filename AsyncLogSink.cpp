@@ -0,0 +1,289 @@
+#include "AsyncLogSink.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Recycled buffers kept for producers; beyond this they are freed.
+#define MAX_FREE_BUFFERS 256
+
+static uint64_t steadyNowUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Loops until all of length bytes are written. Returns false on error.
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+AsyncLogSink::AsyncLogSink()
+    : format(LOG_FORMAT_TEXT), running(false), stopping(false), queuedBytes(0), bytesWritten(0), writeBatches(0)
+{
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    stop();
+}
+
+void AsyncLogSink::start(LogFormat logFormat)
+{
+    stop();
+    format = logFormat;
+    stopping = false;
+    running = true;
+    if (format != LOG_FORMAT_NONE)
+        writer = thread(&AsyncLogSink::writerLoop, this);
+}
+
+void AsyncLogSink::stop()
+{
+    if (!running)
+        return;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    if (writer.joinable())
+        writer.join();
+
+    for (size_t i = 0; i < channelFds.size(); i++)
+    {
+        if (channelFds[i] >= 0)
+            close(channelFds[i]);
+    }
+    channelFds.clear();
+    running = false;
+}
+
+int AsyncLogSink::openChannel(const string &path)
+{
+    if (!running || format == LOG_FORMAT_NONE)
+        return -1;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("open log file");
+        return -1;
+    }
+
+    lock_guard<mutex> lock(queueMutex);
+    channelFds.push_back(fd);
+    return static_cast<int>(channelFds.size() - 1);
+}
+
+void AsyncLogSink::closeChannel(int channel)
+{
+    if (channel < 0)
+        return;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        PendingChunk pending;
+        pending.channel = channel;
+        pending.closeAfter = true;
+        queue.push_back(std::move(pending));
+    }
+    queueReady.notify_one();
+}
+
+void AsyncLogSink::submit(int channel, vector<char> &chunk)
+{
+    if (channel < 0 || chunk.empty())
+        return;
+
+    unique_lock<mutex> lock(queueMutex);
+    queueDrained.wait(lock, [this] { return queuedBytes < MAX_QUEUED_BYTES || stopping; });
+
+    PendingChunk pending;
+    pending.channel = channel;
+    pending.closeAfter = false;
+    pending.data.swap(chunk);
+    queuedBytes += pending.data.size();
+    queue.push_back(std::move(pending));
+
+    // Give the producer a recycled buffer that already has capacity.
+    if (!freeBuffers.empty())
+    {
+        chunk.swap(freeBuffers.back());
+        freeBuffers.pop_back();
+    }
+    lock.unlock();
+    queueReady.notify_one();
+}
+
+void AsyncLogSink::writerLoop()
+{
+    deque<PendingChunk> batch;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this] { return !queue.empty() || stopping; });
+            if (queue.empty() && stopping)
+                return;
+            batch.swap(queue);
+        }
+
+        size_t batchBytes = 0;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            PendingChunk &pending = batch[i];
+            int fd = -1;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (pending.channel < static_cast<int>(channelFds.size()))
+                    fd = channelFds[pending.channel];
+                if (pending.closeAfter && fd >= 0)
+                    channelFds[pending.channel] = -1;
+            }
+
+            if (pending.closeAfter)
+            {
+                if (fd >= 0)
+                    close(fd);
+                continue;
+            }
+            if (fd >= 0 && !writeAll(fd, pending.data.data(), pending.data.size()))
+                perror("write log file");
+            batchBytes += pending.data.size();
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queuedBytes -= batchBytes;
+            bytesWritten += batchBytes;
+            writeBatches++;
+            for (size_t i = 0; i < batch.size() && freeBuffers.size() < MAX_FREE_BUFFERS; i++)
+            {
+                if (batch[i].data.capacity() == 0)
+                    continue;
+                batch[i].data.clear();
+                freeBuffers.push_back(vector<char>());
+                freeBuffers.back().swap(batch[i].data);
+            }
+        }
+        batch.clear();
+        queueDrained.notify_all();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// LogBuffer
+// -----------------------------------------------------------------------------
+
+LogBuffer::LogBuffer(AsyncLogSink &logSink, int logChannel)
+    : sink(logSink), channel(logChannel), enabled(logChannel >= 0),
+      binary(logSink.getFormat() == LOG_FORMAT_BINARY)
+{
+    if (enabled)
+        buffer.reserve(FLUSH_THRESHOLD + 4096);
+}
+
+LogBuffer::~LogBuffer()
+{
+    flush();
+}
+
+void LogBuffer::appendRecordHeader(uint8_t kind, uint8_t flag, size_t payloadLength)
+{
+    LogRecordHeader header;
+    header.length = static_cast<uint32_t>(sizeof(LogRecordHeader) + payloadLength);
+    header.kind = kind;
+    header.flag = flag;
+    header.reserved = 0;
+    header.timestampUs = steadyNowUs();
+    const char *bytes = reinterpret_cast<const char *>(&header);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(header));
+}
+
+void LogBuffer::line(const string &text)
+{
+    if (!enabled)
+        return;
+
+    if (binary)
+    {
+        appendRecordHeader(LOG_RECORD_TEXT, 0, text.size());
+        buffer.insert(buffer.end(), text.begin(), text.end());
+    }
+    else
+    {
+        buffer.insert(buffer.end(), text.begin(), text.end());
+        buffer.push_back('\n');
+    }
+    flushIfFull();
+}
+
+void LogBuffer::received(int flag, const uint8_t *payload, int length)
+{
+    if (!enabled)
+        return;
+    if (length < 0)
+        length = 0;
+
+    if (binary)
+    {
+        appendRecordHeader(LOG_RECORD_RECEIVED, static_cast<uint8_t>(flag), length);
+        buffer.insert(buffer.end(), payload, payload + length);
+        flushIfFull();
+        return;
+    }
+
+    static const char hexDigits[] = "0123456789abcdef";
+    char prefix[64];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "[Received] Flag: %d, Len: %d, Data: ", flag, length);
+
+    // Same layout as "<< hex << (int)byte << ' '": no leading zero.
+    size_t start = buffer.size();
+    buffer.resize(start + prefixLength + 3 * static_cast<size_t>(length) + 1);
+    char *out = buffer.data() + start;
+    memcpy(out, prefix, prefixLength);
+    out += prefixLength;
+    for (int i = 0; i < length; i++)
+    {
+        uint8_t byte = payload[i];
+        if (byte >= 0x10)
+            *out++ = hexDigits[byte >> 4];
+        *out++ = hexDigits[byte & 0x0F];
+        *out++ = ' ';
+    }
+    *out++ = '\n';
+    buffer.resize(out - buffer.data());
+    flushIfFull();
+}
+
+void LogBuffer::flushIfFull()
+{
+    if (buffer.size() >= FLUSH_THRESHOLD)
+        flush();
+}
+
+void LogBuffer::flush()
+{
+    if (!enabled || buffer.empty())
+        return;
+    sink.submit(channel, buffer);
+    if (buffer.capacity() < FLUSH_THRESHOLD)
+        buffer.reserve(FLUSH_THRESHOLD + 4096);
+}
@@ -0,0 +1,136 @@
+#ifndef ASYNC_LOG_SINK_H
+#define ASYNC_LOG_SINK_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Output format of an AsyncLogSink.
+enum LogFormat
+{
+    LOG_FORMAT_TEXT,   // Human readable lines, same layout as the old per-client ofstream logs.
+    LOG_FORMAT_BINARY, // Length-prefixed LogRecordHeader records, no formatting on the hot path.
+    LOG_FORMAT_NONE    // Logging disabled; LogBuffer calls are no-ops.
+};
+
+// Binary log record kinds.
+enum LogRecordKind
+{
+    LOG_RECORD_TEXT = 0,    // Payload is one text line without the trailing newline.
+    LOG_RECORD_RECEIVED = 1 // Payload is the raw PDU payload; flag holds the PDU flag.
+};
+
+#pragma pack(push, 1)
+// Header that precedes every record in LOG_FORMAT_BINARY files.
+struct LogRecordHeader
+{
+    uint32_t length;      // Total record length, header included.
+    uint8_t kind;         // LogRecordKind.
+    uint8_t flag;         // PDU flag for LOG_RECORD_RECEIVED, otherwise 0.
+    uint16_t reserved;
+    uint64_t timestampUs; // steady_clock microseconds.
+};
+#pragma pack(pop)
+
+// Shared background writer for many log files (channels).
+//
+// Producers never touch a file descriptor: they fill a private LogBuffer and
+// hand full chunks to the sink, which writes every queued chunk in one pass on
+// its own thread. Chunks of one buffer are written in order; lines from two
+// different LogBuffers on the same channel interleave at chunk granularity.
+class AsyncLogSink
+{
+public:
+    AsyncLogSink();
+    ~AsyncLogSink();
+
+    // Starts the writer thread. Must be called before any channel is opened.
+    void start(LogFormat format);
+
+    // Writes everything still queued, closes all channels and joins the writer.
+    void stop();
+
+    LogFormat getFormat() const { return format; }
+
+    // Opens (truncates) path as a new channel. Returns the channel id, or -1
+    // when logging is disabled or the file cannot be opened.
+    int openChannel(const string &path);
+
+    // Closes the channel once every chunk submitted before this call is written.
+    void closeChannel(int channel);
+
+    // Queues chunk for channel. chunk is swapped with a recycled, empty buffer.
+    // Blocks while more than MAX_QUEUED_BYTES are waiting to be written.
+    void submit(int channel, vector<char> &chunk);
+
+    uint64_t getBytesWritten() const { return bytesWritten; }
+    uint64_t getWriteBatches() const { return writeBatches; }
+
+    static const size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+private:
+    struct PendingChunk
+    {
+        int channel;
+        bool closeAfter;
+        vector<char> data;
+    };
+
+    void writerLoop();
+
+    LogFormat format;
+    bool running;
+    bool stopping;
+    thread writer;
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    condition_variable queueDrained;
+    deque<PendingChunk> queue;
+    size_t queuedBytes;
+    vector<vector<char> > freeBuffers;
+    vector<int> channelFds;
+
+    uint64_t bytesWritten;
+    uint64_t writeBatches;
+};
+
+// Per-thread staging buffer for one channel of an AsyncLogSink.
+// Not thread-safe: every thread that logs to a channel owns its own LogBuffer.
+class LogBuffer
+{
+public:
+    LogBuffer(AsyncLogSink &sink, int channel);
+    ~LogBuffer();
+
+    // Appends one line (a newline is added in text format).
+    void line(const string &text);
+
+    // Logs a received PDU: "[Received] Flag: f, Len: n, Data: <hex bytes>"
+    // in text format, or the raw payload in binary format.
+    void received(int flag, const uint8_t *payload, int length);
+
+    // Hands whatever is buffered to the sink.
+    void flush();
+
+    static const size_t FLUSH_THRESHOLD = 64 * 1024;
+
+private:
+    void appendRecordHeader(uint8_t kind, uint8_t flag, size_t payloadLength);
+    void flushIfFull();
+
+    AsyncLogSink &sink;
+    int channel;
+    bool enabled;
+    bool binary;
+    vector<char> buffer;
+};
+
+#endif // ASYNC_LOG_SINK_H
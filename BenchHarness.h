@@ -0,0 +1,205 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Reads the CPU cycle counter (TSC on x86, virtual counter on ARM64).
+// Falls back to steady_clock nanoseconds on other architectures.
+inline uint64_t readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Prevents the compiler from optimizing away a computed value.
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// -----------------------------------------------------------------------------
+// Stream buffer that discards everything written to it.
+class NullStreamBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize n) override { return n; }
+};
+
+// RAII helper: silences cout and cerr while a benchmark body runs, so the
+// debug logging inside the components is formatted but never hits the terminal.
+class StreamSilencer
+{
+public:
+    StreamSilencer() : oldCout(cout.rdbuf(&sink)), oldCerr(cerr.rdbuf(&sink)) {}
+    ~StreamSilencer()
+    {
+        cout.rdbuf(oldCout);
+        cerr.rdbuf(oldCerr);
+    }
+
+private:
+    NullStreamBuffer sink;
+    streambuf *oldCout;
+    streambuf *oldCerr;
+};
+
+// -----------------------------------------------------------------------------
+// Summary of one benchmark; all times are per operation.
+struct BenchStats
+{
+    string name;
+    int repetitions;
+    long opsPerRep;
+    double minNs;
+    double medianNs;
+    double meanNs;
+    double p95Ns;
+    double maxNs;
+    double stddevNs;
+    double meanCycles;
+};
+
+// Runs a benchmark body for a number of warmup and measured repetitions.
+// Each repetition calls the body once; the body performs opsPerRep operations.
+class BenchHarness
+{
+public:
+    BenchHarness(int warmupReps, int measuredReps, const string &filter)
+        : warmup(warmupReps), reps(measuredReps), nameFilter(filter) {}
+
+    // Returns true if the named benchmark passes the --filter substring.
+    bool enabled(const string &name) const
+    {
+        return nameFilter.empty() || name.find(nameFilter) != string::npos;
+    }
+
+    // Times body() and records the per-operation statistics under name.
+    template <typename Body>
+    void run(const string &name, long opsPerRep, Body body)
+    {
+        run(name, opsPerRep, []() {}, body);
+    }
+
+    // Same as run(), but calls setup() untimed before every repetition.
+    template <typename Setup, typename Body>
+    void run(const string &name, long opsPerRep, Setup setup, Body body)
+    {
+        if (!enabled(name) || opsPerRep <= 0)
+            return;
+
+        vector<double> nsPerOp;
+        vector<double> cyclesPerOp;
+        nsPerOp.reserve(reps);
+        cyclesPerOp.reserve(reps);
+
+        {
+            StreamSilencer silence;
+            for (int i = 0; i < warmup; i++)
+            {
+                setup();
+                body();
+            }
+
+            for (int i = 0; i < reps; i++)
+            {
+                setup();
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                uint64_t startCycles = readCycleCounter();
+                body();
+                uint64_t endCycles = readCycleCounter();
+                chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+                double ns = chrono::duration<double, nano>(end - start).count();
+                nsPerOp.push_back(ns / opsPerRep);
+                cyclesPerOp.push_back(static_cast<double>(endCycles - startCycles) / opsPerRep);
+            }
+        }
+
+        results.push_back(summarize(name, opsPerRep, nsPerOp, cyclesPerOp));
+        printRow(results.back());
+    }
+
+    // Prints the column header for the result table.
+    static void printHeader()
+    {
+        printf("%-44s %6s %9s %11s %11s %11s %11s %9s %11s\n",
+               "benchmark", "reps", "ops/rep", "min(ns)", "median(ns)", "mean(ns)",
+               "p95(ns)", "stddev", "cycles/op");
+    }
+
+    // Prints one result row.
+    static void printRow(const BenchStats &s)
+    {
+        printf("%-44s %6d %9ld %11.1f %11.1f %11.1f %11.1f %9.1f %11.1f\n",
+               s.name.c_str(), s.repetitions, s.opsPerRep, s.minNs, s.medianNs,
+               s.meanNs, s.p95Ns, s.stddevNs, s.meanCycles);
+        fflush(stdout);
+    }
+
+    const vector<BenchStats> &getResults() const { return results; }
+
+private:
+    static BenchStats summarize(const string &name, long opsPerRep,
+                                vector<double> &samples, const vector<double> &cycles)
+    {
+        BenchStats s;
+        s.name = name;
+        s.repetitions = static_cast<int>(samples.size());
+        s.opsPerRep = opsPerRep;
+
+        sort(samples.begin(), samples.end());
+        size_t n = samples.size();
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++)
+            sum += samples[i];
+        s.meanNs = sum / n;
+
+        double squares = 0.0;
+        for (size_t i = 0; i < n; i++)
+            squares += (samples[i] - s.meanNs) * (samples[i] - s.meanNs);
+        s.stddevNs = n > 1 ? sqrt(squares / (n - 1)) : 0.0;
+
+        s.minNs = samples.front();
+        s.maxNs = samples.back();
+        s.medianNs = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+        s.p95Ns = samples[static_cast<size_t>(0.95 * (n - 1))];
+
+        double cycleSum = 0.0;
+        for (size_t i = 0; i < cycles.size(); i++)
+            cycleSum += cycles[i];
+        s.meanCycles = cycles.empty() ? 0.0 : cycleSum / cycles.size();
+        return s;
+    }
+
+    int warmup;
+    int reps;
+    string nameFilter;
+    vector<BenchStats> results;
+};
+
+#endif // BENCH_HARNESS_H
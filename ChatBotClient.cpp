@@ -1,16 +1,56 @@
 // ChatBotClient.cpp
 #include "ChatBotClient.h"
 #include "networks.h"
+#include "chatFlags.h"
+#include "PDU_Schema.h"
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <cerrno>
 #include <cstring>
+#include <cstdlib>
 #include <iostream>
 #include <cstdio>
+#include <unordered_set>
 
-ChatBotClient::ChatBotClient(const std::string &serverAddress, int port, const std::string &botHandle)
-    : serverAddress(serverAddress), port(port), botHandle(botHandle), socketNum(-1), nlpProcessor()
+#define MAXBUF 1024
+#define MAX_NAME_LEN 100
+#define MAX_TEXT_PER_PACKET 200
+
+// A %M packet carries at most this many destination handles.
+#define MAX_DESTINATIONS 9
+
+// Replies are dropped while this much output waits for the server. The bot
+// cannot stop reading instead: the server blocks sending to it and would
+// then never read the bot's output.
+#define BOT_MAX_QUEUED (4 * 1024 * 1024)
+
+// Relays remembered for flag-7 reports. The report follows its relay within
+// one round trip, so older entries are only kept for relays that worked.
+#define BOT_MAX_RELAYS_TRACKED 1024
+
+// Handles are matched in lowercase, like the server's destination lookup.
+static string lowercase(const string &text)
 {
+    string lower(text);
+    transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+              { return tolower(c); });
+    return lower;
+}
+
+ChatBotClient::ChatBotClient(const std::string &serverAddress, int port, const std::string &botHandle,
+                             shared_ptr<const NLPModel> model)
+    : serverAddress(serverAddress), port(port), botHandle(botHandle), socketNum(-1), registered(false),
+      running(false), model(model ? model : NLPModel::shared()), listRequested(false), relaySequence(0),
+      messagesHandled(0),
+      repliesQueued(0), repliesDropped(0)
+{
+}
+
+bool ChatBotClient::isBotHandle(const string &handle) const
+{
+    return lowercase(handle) == lowercase(botHandle);
 }
 
 ChatBotClient::~ChatBotClient()
@@ -39,52 +79,499 @@ bool ChatBotClient::connectToServer()
         return false;
     }
     std::cout << "Connected to server at " << serverAddress << ":" << port << std::endl;
-    return true;
+
+    if (!stream.attach(socketNum))
+        return false;
+
+    // Registration; the confirmation arrives in run().
+    uint8_t *payload = stream.reservePDU(1 + MAX_NAME_LEN);
+    size_t length = RegistrationPDU::build(payload, 1 + MAX_NAME_LEN, botHandle);
+    stream.commitPDU(length > 0 ? CLIENT_INIT_PACKET_TO_SERVER : -1, static_cast<uint16_t>(length));
+    if (length == 0)
+    {
+        std::cerr << "Error: Handle " << botHandle << " is too long." << std::endl;
+        return false;
+    }
+    return stream.flush();
 }
 
 void ChatBotClient::run()
 {
-    std::string userInput;
-    // Main loop: receive natural language commands from the user.
-    while (true)
+    bool stdinOpen = true;
+    running = true;
+
+    // pollLib only watches for input; the bot also needs POLLOUT while
+    // replies are waiting for room in the socket buffer.
+    while (running)
     {
-        std::cout << "Enter command (or type 'exit' to quit): ";
-        std::getline(std::cin, userInput);
-        if (userInput.empty())
-            continue;
-        if (userInput == "exit")
-            break;
+        pollfd fds[2];
+        fds[0].fd = socketNum;
+        fds[0].events = POLLIN | (stream.hasPendingOutput() ? POLLOUT : 0);
+        fds[0].revents = 0;
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
 
-        // Process the natural language input using the NLPProcessor.
-        std::string structuredCommand = nlpProcessor.processMessage(userInput);
+        if (poll(fds, stdinOpen ? 2 : 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
 
-        // If the NLPProcessor returns an error message, display it.
-        if (structuredCommand.find("Error:") == 0)
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
         {
-            std::cout << structuredCommand << std::endl;
+            bool open = stream.fill();
+
+            // Answer everything that arrived, then send all replies at once.
+            int flag;
+            const uint8_t *payload;
+            uint16_t length;
+            while (stream.nextPDU(&flag, &payload, &length))
+            {
+                connStats.recordReceived(length + SIZE_CHAT_HEADER);
+                handlePDU(flag, payload, length);
+            }
+            flushReplies();
+
+            if (stream.isCorrupt())
+            {
+                std::cerr << "Error: Malformed packet from server." << std::endl;
+                break;
+            }
+            if (!open)
+            {
+                std::cout << "Server terminated connection." << std::endl;
+                break;
+            }
         }
-        else
+
+        if (stdinOpen && (fds[1].revents & (POLLIN | POLLHUP)))
         {
-            // Otherwise, send the structured command to the server.
-            sendMessage(structuredCommand);
+            if (std::cin.peek() == EOF)
+                stdinOpen = false;
+            else
+                handleOperatorInput();
         }
+
+        if (stream.hasPendingOutput() && !stream.flush())
+            break;
+    }
+    running = false;
+}
+
+void ChatBotClient::handleOperatorInput()
+{
+    std::string line;
+    std::getline(std::cin, line);
+    if (line == "exit")
+    {
+        // The server acknowledges with EXIT_ACK, which ends the loop.
+        stream.queue(CLIENT_TO_SERVER_EXIT, nullptr, 0);
+    }
+    else if (line == "status")
+    {
+        printStats();
+    }
+    else if (!line.empty())
+    {
+        std::cout << "Commands: status, exit" << std::endl;
+    }
+}
+
+// Member handlers by flag, expanded at compile time into one slot per flag
+// value (nullptr where the bot ignores the flag). A friend of the class so
+// the table can name its private handlers.
+struct ChatBotDispatch
+{
+    typedef ChatBotClient::PacketHandler Handler;
+    static constexpr ChatFlagHandler<Handler> handlerList[] = {
+        {CONFIRM_GOOD_HANDLE, &ChatBotClient::onRegistered},
+        {ERROR_ON_INIT_PACKET, &ChatBotClient::onHandleInUse},
+        {MESSAGE_PACKET, &ChatBotClient::onDirectMessage},
+        {BROADCAST_PACKET, &ChatBotClient::onBroadcast},
+        {LIST_RESPONSE_NUM, &ChatBotClient::onListCount},
+        {LIST_RESPONSE_HANDLE, &ChatBotClient::onListHandle},
+        {LIST_RESPONSE_END, &ChatBotClient::onListEnd},
+        {ERROR_INVALID_DESTINATION, &ChatBotClient::onInvalidDestination},
+        {EXIT_ACK, &ChatBotClient::onExitAck}};
+
+#define BOT_HANDLER_ROW(value) chatFlagHandlerFor(handlerList, value)
+    static constexpr Handler handlers[256] = {CHAT_FLAG_ROWS256(BOT_HANDLER_ROW)};
+#undef BOT_HANDLER_ROW
+};
+
+constexpr ChatFlagHandler<ChatBotDispatch::Handler> ChatBotDispatch::handlerList[];
+constexpr ChatBotDispatch::Handler ChatBotDispatch::handlers[256];
+
+void ChatBotClient::handlePDU(int flag, const uint8_t *payload, uint16_t length)
+{
+    ChatFlagCheck check = checkChatFlag(flag, CHAT_DIR_TO_CLIENT, length);
+    if (check == CHAT_FLAG_TOO_SHORT || check == CHAT_FLAG_WRONG_DIRECTION)
+    {
+        std::cerr << "[ERROR] Dropping " << chatFlagToString(flag) << " PDU: " << chatFlagCheckString(check) << std::endl;
+        return;
+    }
+
+    PacketHandler handler = ChatBotDispatch::handlers[flag & 0xFF];
+    if (check == CHAT_FLAG_OK && handler != nullptr)
+        (this->*handler)(payload, length);
+}
+
+void ChatBotClient::onRegistered(const uint8_t *, uint16_t)
+{
+    registered = true;
+    std::cout << "Registered as " << botHandle << "." << std::endl;
+}
+
+void ChatBotClient::onHandleInUse(const uint8_t *, uint16_t)
+{
+    std::cerr << "Error: Handle " << botHandle << " is already in use." << std::endl;
+    running = false;
+}
+
+void ChatBotClient::onDirectMessage(const uint8_t *payload, uint16_t length)
+{
+    MessagePDU message;
+    if (!message.parse(payload, length))
+        return;
+    connStats.recordMessageReceived();
+
+    // The server hands a %M back to its sender when the sender is among the
+    // destinations; answering the bot's own packets would never stop.
+    if (isBotHandle(message.sender.str()))
+        return;
+    handleUserMessage(message.sender.str(), message.text.data, message.text.length);
+}
+
+void ChatBotClient::onBroadcast(const uint8_t *payload, uint16_t length)
+{
+    BroadcastPDU broadcast;
+    if (!broadcast.parse(payload, length))
+        return;
+    connStats.recordMessageReceived();
+    if (isBotHandle(broadcast.sender.str()))
+        return;
+
+    // Broadcasts are only for the bot when they mention it; drop the mention.
+    string message = broadcast.text.str();
+    if (!processIncomingMessage(message))
+        return;
+    string trigger = "@" + botHandle;
+    message.erase(message.find(trigger), trigger.size());
+    handleUserMessage(broadcast.sender.str(), message.data(), message.size());
+}
+
+void ChatBotClient::onListCount(const uint8_t *, uint16_t)
+{
+    listedHandles.clear();
+}
+
+void ChatBotClient::onListHandle(const uint8_t *payload, uint16_t length)
+{
+    ListHandlePDU entry;
+    if (entry.parse(payload, length))
+        listedHandles.push_back(entry.handle.str());
+}
+
+void ChatBotClient::onListEnd(const uint8_t *, uint16_t)
+{
+    finishListRequest();
+}
+
+void ChatBotClient::onInvalidDestination(const uint8_t *payload, uint16_t length)
+{
+    // A relay went to a handle that does not exist: tell whoever asked for it.
+    InvalidDestinationPDU error;
+    if (!error.parse(payload, length))
+        return;
+    string destination = error.handle.str();
+    auto requester = lastRequester.find(lowercase(destination));
+    if (requester != lastRequester.end())
+    {
+        reply(requester->second.requester, "Error: Client with handle " + destination + " does not exist.");
+        lastRequester.erase(requester);
+    }
+}
+
+void ChatBotClient::rememberRelay(const string &destination, const string &sender)
+{
+    string key = lowercase(destination);
+    RelayRequest &request = lastRequester[key];
+    request.requester = sender;
+    request.sequence = ++relaySequence;
+    relayOrder.emplace_back(key, relaySequence);
+
+    // Entries replaced by a newer relay or erased by a flag-7 report are
+    // skipped; only the current entry for a destination is evicted.
+    while (relayOrder.size() > BOT_MAX_RELAYS_TRACKED)
+    {
+        auto oldest = lastRequester.find(relayOrder.front().first);
+        if (oldest != lastRequester.end() && oldest->second.sequence == relayOrder.front().second)
+            lastRequester.erase(oldest);
+        relayOrder.pop_front();
+    }
+}
+
+void ChatBotClient::onExitAck(const uint8_t *, uint16_t)
+{
+    std::cout << "Exit ACK received." << std::endl;
+    running = false;
+}
+
+void ChatBotClient::handleUserMessage(const string &sender, const char *text, size_t length)
+{
+    messagesHandled++;
+
+    string handle = lowercase(sender);
+    if (knownHandles.find(handle.data(), handle.size()) < 0)
+        knownHandles.addWord(handle);
+
+    // Users without a dialogue in progress start from a fresh (Idle) session.
+    auto existing = sessions.find(handle);
+    DialogueSession fresh;
+    DialogueSession &session = existing != sessions.end() ? existing->second : fresh;
+
+    size_t needed = model->maxResponseSize(session, length);
+    if (responseBuffer.size() < needed)
+        responseBuffer.resize(needed);
+    size_t responseLength = model->processMessage(session, text, length, responseBuffer.data(),
+                                                  responseBuffer.size(), &knownHandles);
+
+    // Keep only the dialogues that still wait for input.
+    if (session.state == DialogueSession::Idle)
+    {
+        if (existing != sessions.end())
+            sessions.erase(existing);
     }
+    else if (existing == sessions.end())
+    {
+        sessions.emplace(handle, std::move(fresh));
+    }
+
+    const char *response = responseBuffer.data();
+    if (responseLength > 0 && response[0] == '%')
+        executeCommand(sender, response, responseLength);
+    else
+        reply(sender, string(response, responseLength));
 }
 
-void ChatBotClient::sendMessage(const std::string &message)
+void ChatBotClient::executeCommand(const string &sender, const char *command, size_t length)
 {
-    // Send the message over the socket.
-    int bytesSent = send(socketNum, message.c_str(), message.length(), 0);
-    if (bytesSent < 0)
+    string text(command, length);
+
+    if (text.compare(0, 5, "%M 1 ") == 0)
+    {
+        // "%M 1 <destination> <message>": relay the message for sender.
+        size_t space = text.find(' ', 5);
+        string destination = text.substr(5, space == string::npos ? string::npos : space - 5);
+        string message = space == string::npos ? "" : text.substr(space + 1);
+        if (isBotHandle(destination))
+        {
+            reply(sender, "Error: I can't relay a message to myself; just tell me what you need.");
+            return;
+        }
+        reply(destination, "[from " + sender + "] " + message);
+        reply(sender, "Sent to " + destination + ".");
+        rememberRelay(destination, sender);
+    }
+    else if (text.compare(0, 3, "%B ") == 0)
     {
-        std::cerr << "Error sending message." << std::endl;
+        queueBroadcast("[from " + sender + "] " + text.substr(3));
+        reply(sender, "Broadcast sent.");
+    }
+    else if (text == "%L")
+    {
+        // One request to the server answers everyone who asks meanwhile.
+        listWaiters.push_back(sender);
+        if (!listRequested)
+        {
+            stream.queue(CLIENT_TO_SERVER_LIST_OF_HANDLES, nullptr, 0);
+            listRequested = true;
+        }
+    }
+    else if (text == "%S")
+    {
+        reply(sender, "Bot " + botHandle + ": " + to_string(sessions.size()) + " dialogues in progress, " +
+                          to_string(messagesHandled) + " messages handled.");
+    }
+    else if (text == "%E")
+    {
+        sessions.erase(lowercase(sender));
+        reply(sender, "Goodbye! Your conversation has been reset.");
     }
     else
     {
-        std::cout << "Sent command: " << message << std::endl;
+        reply(sender, "Error: Unable to process command " + text);
     }
 }
 
+void ChatBotClient::finishListRequest()
+{
+    vector<string> lower;
+    lower.reserve(listedHandles.size());
+    for (const string &handle : listedHandles)
+        lower.push_back(lowercase(handle));
+    knownHandles.clear();
+    knownHandles.addWords(lower);
+
+    string text = "Clients (" + to_string(listedHandles.size()) + "):";
+    for (size_t i = 0; i < listedHandles.size(); i++)
+        text += (i == 0 ? " " : ", ") + listedHandles[i];
+    for (const string &waiter : listWaiters)
+        reply(waiter, text);
+
+    listWaiters.clear();
+    listedHandles.clear();
+    listRequested = false;
+}
+
+void ChatBotClient::reply(const string &destination, const string &text)
+{
+    PendingReply pending;
+    pending.destination = destination;
+    pending.text = text;
+    replies.push_back(std::move(pending));
+    repliesQueued++;
+}
+
+void ChatBotClient::sendMessage(const string &destination, const string &message)
+{
+    queueMessage(vector<const string *>(1, &destination), message);
+}
+
+bool ChatBotClient::outboundFull() const
+{
+    return stream.pendingOutputBytes() >= BOT_MAX_QUEUED;
+}
+
+void ChatBotClient::flushReplies()
+{
+    if (outboundFull() && !replies.empty())
+    {
+        std::cerr << "[ERROR] Outbound queue full; dropping " << replies.size() << " replies." << std::endl;
+        repliesDropped += replies.size();
+        replies.clear();
+        return;
+    }
+
+
+    // Replies are split into runs in which no destination repeats. Within a
+    // run, one PDU carries a text to up to MAX_DESTINATIONS users; across
+    // runs the order is kept, so each user sees their replies in order.
+    size_t begin = 0;
+    while (begin < replies.size())
+    {
+        unordered_set<string> destinations;
+        size_t end = begin;
+        while (end < replies.size() && destinations.insert(replies[end].destination).second)
+            end++;
+
+        // Group the run by text, in order of first appearance.
+        unordered_map<string, size_t> groupOfText;
+        vector<vector<const string *>> groups;
+        vector<const string *> texts;
+        for (size_t i = begin; i < end; i++)
+        {
+            auto inserted = groupOfText.emplace(replies[i].text, groups.size());
+            if (inserted.second)
+            {
+                groups.push_back(vector<const string *>());
+                texts.push_back(&replies[i].text);
+            }
+            groups[inserted.first->second].push_back(&replies[i].destination);
+        }
+        for (size_t g = 0; g < groups.size(); g++)
+            queueMessage(groups[g], *texts[g]);
+
+        begin = end;
+    }
+    replies.clear();
+}
+
+void ChatBotClient::queueMessage(const vector<const string *> &destinations, const string &text)
+{
+    // [1 byte sender length][sender][1 byte count] count x [1 byte length][handle][text segment '\0'],
+    // with the segment and destination count chosen to fit the server's MAXBUF.
+    const size_t maxSegment = MAX_TEXT_PER_PACKET - 1;
+
+    size_t first = 0;
+    while (first < destinations.size())
+    {
+        size_t headerLength = 1 + botHandle.size() + 1;
+        size_t last = first;
+        while (last < destinations.size() && last - first < MAX_DESTINATIONS &&
+               headerLength + 1 + destinations[last]->size() + MAX_TEXT_PER_PACKET <= MAXBUF)
+        {
+            headerLength += 1 + destinations[last]->size();
+            last++;
+        }
+        if (last == first)
+        {
+            std::cerr << "Error: Destination handle too long: " << *destinations[first] << std::endl;
+            first++;
+            continue;
+        }
+
+        // Each segment is built straight into the stream's outbound buffer.
+        size_t position = 0;
+        do
+        {
+            size_t segment = min(maxSegment, text.size() - position);
+            uint8_t *packet = stream.reservePDU(MAXBUF);
+            size_t length = MessagePDU::build(packet, MAXBUF, botHandle, destinations.begin() + first,
+                                              destinations.begin() + last, text.data() + position, segment);
+            stream.commitPDU(length > 0 ? MESSAGE_PACKET : -1, static_cast<uint16_t>(length));
+            if (length == 0)
+            {
+                std::cerr << "Error: Message header does not fit in a PDU." << std::endl;
+                break;
+            }
+            connStats.recordSent(length + SIZE_CHAT_HEADER);
+            connStats.recordMessageSent();
+            position += segment;
+        } while (position < text.size());
+
+        first = last;
+    }
+}
+
+void ChatBotClient::queueBroadcast(const string &text)
+{
+    // [sender][text segment '\0'], built straight into the stream's outbound buffer.
+    const size_t maxSegment = MAX_TEXT_PER_PACKET - 1;
+    if (outboundFull())
+    {
+        std::cerr << "[ERROR] Outbound queue full; dropping a broadcast." << std::endl;
+        repliesDropped++;
+        return;
+    }
+
+    size_t position = 0;
+    do
+    {
+        size_t segment = min(maxSegment, text.size() - position);
+        uint8_t *packet = stream.reservePDU(MAXBUF);
+        size_t length = BroadcastPDU::build(packet, MAXBUF, botHandle, text.data() + position, segment);
+        stream.commitPDU(length > 0 ? BROADCAST_PACKET : -1, static_cast<uint16_t>(length));
+        if (length == 0)
+            return;
+        connStats.recordSent(length + SIZE_CHAT_HEADER);
+        connStats.recordMessageSent();
+        position += segment;
+    } while (position < text.size());
+}
+
+void ChatBotClient::printStats() const
+{
+    connStats.printStats();
+    std::cout << "Messages handled: " << messagesHandled << std::endl;
+    std::cout << "Active dialogues: " << sessions.size() << std::endl;
+    std::cout << "Replies: " << repliesQueued << " in " << stream.getQueuedPDUs() << " PDUs over "
+              << stream.getSendCalls() << " send calls, " << repliesDropped << " dropped" << std::endl;
+}
+
 bool ChatBotClient::processIncomingMessage(const std::string &message)
 {
     // Check if the message is directed to the bot (e.g., starting with "@" followed by the bot handle)
@@ -95,23 +582,46 @@ bool ChatBotClient::processIncomingMessage(const std::string &message)
 // Main function for the chatbot executable.
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    std::string dictionaryPath, intentModelPath;
+    bool validArgs = (argc >= 4 && argc % 2 == 0);
+    for (int i = 4; validArgs && i + 1 < argc; i += 2)
     {
-        std::cerr << "Usage: " << argv[0] << " <server address> <server port> <bot handle>" << std::endl;
+        if (strcmp(argv[i], "--dictionary") == 0)
+            dictionaryPath = argv[i + 1];
+        else if (strcmp(argv[i], "--intent-model") == 0)
+            intentModelPath = argv[i + 1];
+        else
+            validArgs = false;
+    }
+    if (!validArgs)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <server address> <server port> <bot handle> [--dictionary <file>] [--intent-model <file>]" << std::endl;
         return 1;
     }
 
     std::string serverAddress(argv[1]);
     int port = std::atoi(argv[2]);
     std::string botHandle(argv[3]);
+    if (botHandle.empty() || botHandle.size() > MAX_NAME_LEN)
+    {
+        std::cerr << "Error: Handle must be 1 to " << MAX_NAME_LEN << " characters." << std::endl;
+        return 1;
+    }
+
+    // Optional word list for fuzzy correction of misspelled commands and trained intent model.
+    shared_ptr<const NLPModel> model = NLPModel::create(dictionaryPath, intentModelPath);
+    if (!model)
+        return 1;
+
+    ChatBotClient chatbot(serverAddress, port, botHandle, model);
 
-    ChatBotClient chatbot(serverAddress, port, botHandle);
-    
     if (!chatbot.connectToServer())
     {
         std::cerr << "Failed to connect to server." << std::endl;
         return 1;
     }
     chatbot.run();
+    chatbot.printStats();
     return 0;
 }
@@ -5,39 +5,155 @@
 #include <algorithm>
 #include <cstring>
 #include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <unistd.h> // For close()
 
 #include <sys/socket.h> // Socket functions
 #include <arpa/inet.h> // For inet_pton(), etc.
 
 #include "networks.h" // Provides tcpClientSetuo() and related network functions
-#include "NLPProcessor.h"
+#include "NLPModel.h"
+#include "SpellDictionary.h"
+#include "PDU_Stream.h"
+#include "ConnectionStats.h"
 
 using namespace std;
 
+// A chat client that other users talk to in natural language. It registers
+// like any client, reads the %M and %B packets addressed to it, keeps one
+// DialogueSession per sender and carries out the resulting commands on the
+// sender's behalf. Everything runs on one thread around poll(); replies
+// produced while handling one batch of input go out together, with
+// identical prompts to different users sharing a packet.
 class ChatBotClient {
-    public: 
-        ChatBotClient(const string &serverAddress, int port, const string &botHandle);
+    public:
+        ChatBotClient(const string &serverAddress, int port, const string &botHandle,
+                      shared_ptr<const NLPModel> model = nullptr);
         ~ChatBotClient();
 
-        // Establish connection with the chat server. 
+        // Establish connection with the chat server and send the registration packet.
         bool connectToServer();
 
-        // Main loop to receive messages, process them, and send responses.
+        // Event loop: receives packets, answers users and reads operator
+        // commands ("status", "exit") from stdin until exit or disconnect.
         void run();
 
-        // Send a message to the server.
-        void sendMessage(const string &message);
-    
+        // Queues a direct message from the bot to destination.
+        void sendMessage(const string &destination, const string &message);
+
+        // Prints traffic, batching and session counters.
+        void printStats() const;
+
     private:
+        // A direct message produced while handling the current batch.
+        struct PendingReply
+        {
+            string destination;
+            string text;
+        };
+
+        // Who asked for a relay; sequence tells a reused entry from an evicted one.
+        struct RelayRequest
+        {
+            string requester;
+            uint64_t sequence;
+        };
+
         string serverAddress;
         int port;
         string botHandle;
         int socketNum; // Socket descriptor for network communication.
-        NLPProcessor nlpProcessor; // NLP module to process incoming messages. 
+        bool registered;
+        bool running;
+
+        PDU_Stream stream;
+        shared_ptr<const NLPModel> model; // NLP module shared by every dialogue.
+
+        // Dialogues that are waiting for more input, by lowercased sender.
+        // Finished dialogues are dropped, so this only holds the active ones.
+        unordered_map<string, DialogueSession> sessions;
+
+        // Handles seen so far (senders and %L results) for destination correction.
+        SpellDictionary knownHandles;
+
+        vector<PendingReply> replies;
+        vector<char> responseBuffer;
+
+        // Users waiting for the handle list the bot requested from the server.
+        vector<string> listWaiters;
+        vector<string> listedHandles;
+        bool listRequested;
+
+        // Who asked for the last relay to each (lowercased) destination, to
+        // report a non-existent destination (flag 7) back to them. The server
+        // never confirms a relay that worked, so only the newest
+        // BOT_MAX_RELAYS_TRACKED relays are remembered, oldest first in relayOrder.
+        unordered_map<string, RelayRequest> lastRequester;
+        deque<pair<string, uint64_t>> relayOrder;
+        uint64_t relaySequence;
+
+        ConnectionStats connStats;
+        uint64_t messagesHandled;
+        uint64_t repliesQueued;
+        uint64_t repliesDropped; // Discarded because the outbound queue was full.
+
+        // True while BOT_MAX_QUEUED bytes wait for the socket.
+        bool outboundFull() const;
 
         // Checks if a message is directed to the bot.
         bool processIncomingMessage(const string &message);
+
+        // True when handle is the bot's own, compared in lowercase like the server.
+        bool isBotHandle(const string &handle) const;
+
+        // Handles one PDU from the server through the flag table built by
+        // ChatBotDispatch in ChatBotClient.cpp.
+        void handlePDU(int flag, const uint8_t *payload, uint16_t length);
+
+        typedef void (ChatBotClient::*PacketHandler)(const uint8_t *payload, uint16_t length);
+        friend struct ChatBotDispatch;
+
+        // One handler per flag the bot receives.
+        void onRegistered(const uint8_t *payload, uint16_t length);
+        void onHandleInUse(const uint8_t *payload, uint16_t length);
+        void onDirectMessage(const uint8_t *payload, uint16_t length);
+        void onBroadcast(const uint8_t *payload, uint16_t length);
+        void onListCount(const uint8_t *payload, uint16_t length);
+        void onListHandle(const uint8_t *payload, uint16_t length);
+        void onListEnd(const uint8_t *payload, uint16_t length);
+        void onInvalidDestination(const uint8_t *payload, uint16_t length);
+        void onExitAck(const uint8_t *payload, uint16_t length);
+
+        // Runs one user message through the sender's dialogue.
+        void handleUserMessage(const string &sender, const char *text, size_t length);
+
+        // Carries out a structured command ("%M 1 bob hi", "%B hi", ...) for sender.
+        void executeCommand(const string &sender, const char *command, size_t length);
+
+        // Records sender as the requester of a relay to destination.
+        void rememberRelay(const string &destination, const string &sender);
+
+        // Delivers the handle list to everyone who asked for it.
+        void finishListRequest();
+
+        // Queues a reply; replies are sent by flushReplies().
+        void reply(const string &destination, const string &text);
+
+        // Turns the batch of replies into as few MESSAGE_PACKETs as possible.
+        void flushReplies();
+
+        // Queues text as MESSAGE_PACKETs to every destination (segmented like %M).
+        void queueMessage(const vector<const string *> &destinations, const string &text);
+
+        // Queues text as BROADCAST_PACKETs (segmented like %B).
+        void queueBroadcast(const string &text);
+
+        // Handles one line typed by the operator.
+        void handleOperatorInput();
 };
 
-#endif // CHATBOTCLIENT_H
\ No newline at end of file
+#endif // CHATBOTCLIENT_H
@@ -1,6 +1,6 @@
 #include "ConnectionStats.h"
 
-ConnectionStats::ConnectionStats() : totalBytesSent(0), totalBytesReceived(0), totalMessagesSent(0), totalMessagesReceived(0) {
+ConnectionStats::ConnectionStats() : totalBytesSent(0), totalBytesReceived(0), totalMessagesSent(0), totalMessagesReceived(0), totalSendCalls(0) {
     startTime = chrono::steady_clock::now();
 }
 
@@ -20,6 +20,10 @@ void ConnectionStats::recordMessageReceived() {
     totalMessagesReceived++;
 }
 
+void ConnectionStats::recordSendCalls(int calls) {
+    totalSendCalls += calls;
+}
+
 double ConnectionStats::getUptimeSeconds() const {
     chrono::duration<double> uptime = chrono::steady_clock::now() - startTime;
     return uptime.count();
@@ -33,5 +37,6 @@ void ConnectionStats::printStats() const {
     std::cout << "Total Bytes Received: " << totalBytesReceived << std::endl;
     std::cout << "Total Messages Sent: " << totalMessagesSent << std::endl;
     std::cout << "Total Messages Received: " << totalMessagesReceived << std::endl;
+    std::cout << "Total Send Calls: " << totalSendCalls << std::endl;
     std::cout << "---------------------------" << std::endl;
 }
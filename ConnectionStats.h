@@ -24,6 +24,9 @@ class ConnectionStats
         // Record that a message (a complete PDU) was received.
         void recordMessageReceived();
 
+        // Record 'calls' send system calls (one may carry several PDUs).
+        void recordSendCalls(int calls);
+
         // Get the elapsed time in seconds since the connection started. 
         double getUptimeSeconds() const;
 
@@ -36,6 +39,7 @@ class ConnectionStats
         int totalBytesReceived;
         int totalMessagesSent;
         int totalMessagesReceived;
+        int totalSendCalls;
 };
 
 #endif // CONNECTION_STATS_H
\ No newline at end of file
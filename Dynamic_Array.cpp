@@ -7,6 +7,8 @@
 #include <iostream>
 #include <iomanip>
 #include <exception>
+#include <algorithm>
+#include <string>
 
 using namespace std;
 
@@ -0,0 +1,87 @@
+#include "HandleDirectory.h"
+
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+// The server registers and looks up handles in lowercase, so "Bob" and "bob"
+// are one handle; everything is stored and compared that way.
+static string lowercase(const string &handle)
+{
+    string lower(handle);
+    transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+              { return tolower(c); });
+    return lower;
+}
+
+HandleDirectory::HandleDirectory(int freshSeconds)
+    : freshFor(freshSeconds), listedAt(), listed(false), suppressed(0), completed(0)
+{
+}
+
+void HandleDirectory::replaceOnline(const vector<string> &handles)
+{
+    online.clear();
+    online.reserve(handles.size());
+    for (const string &handle : handles)
+        online.push_back(lowercase(handle));
+    sort(online.begin(), online.end());
+    online.erase(unique(online.begin(), online.end()), online.end());
+    for (const string &handle : online)
+        unknown.erase(handle);
+    listedAt = chrono::steady_clock::now();
+    listed = true;
+}
+
+void HandleDirectory::markOnline(const string &handle)
+{
+    string key = lowercase(handle);
+    unknown.erase(key);
+    vector<string>::iterator it = lower_bound(online.begin(), online.end(), key);
+    if (it == online.end() || *it != key)
+        online.insert(it, key);
+}
+
+void HandleDirectory::markUnknown(const string &handle)
+{
+    string key = lowercase(handle);
+    vector<string>::iterator it = lower_bound(online.begin(), online.end(), key);
+    if (it != online.end() && *it == key)
+        online.erase(it);
+    unknown.insert(key);
+}
+
+bool HandleDirectory::isFresh() const
+{
+    return listed && chrono::steady_clock::now() - listedAt < freshFor;
+}
+
+HandleDirectory::Verdict HandleDirectory::resolve(string &handle)
+{
+    string key = lowercase(handle);
+    vector<string>::const_iterator it = lower_bound(online.begin(), online.end(), key);
+    if (it != online.end() && *it == key)
+        return HANDLE_SEND;
+    if (unknown.count(key) > 0)
+    {
+        suppressed++;
+        return HANDLE_SUPPRESS;
+    }
+
+    // A stale list may be missing newcomers, and a short handle that joined
+    // since must not be completed into someone else's.
+    if (!isFresh())
+        return HANDLE_SEND;
+
+    // Online handles starting with key sort right after it.
+    bool isPrefix = it != online.end() && it->compare(0, key.size(), key) == 0;
+    if (isPrefix && (it + 1 == online.end() || (it + 1)->compare(0, key.size(), key) != 0))
+    {
+        handle = *it;
+        completed++;
+        return HANDLE_COMPLETED;
+    }
+    suppressed++;
+    return isPrefix ? HANDLE_AMBIGUOUS : HANDLE_SUPPRESS;
+}
@@ -0,0 +1,66 @@
+#ifndef HANDLE_DIRECTORY_H
+#define HANDLE_DIRECTORY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The client's view of which handles are online, used to check %M
+// destinations before they cost the server a lookup and an error packet.
+//
+// A %L reply replaces the online list; a message from a handle marks it
+// online and an ERROR_INVALID_DESTINATION reply marks it unknown. Handles can
+// join at any time, so absence from the list only counts while the list is
+// fresh; a handle the server has rejected stays suppressed until it is seen
+// online again. Handles are lowercased on the way in, as the server does, so
+// "Bob" and "bob" are the same entry.
+class HandleDirectory
+{
+public:
+    // How a destination should be treated.
+    enum Verdict
+    {
+        HANDLE_SEND,      // Online, or nothing is known against it.
+        HANDLE_COMPLETED, // Replaced by the only online handle it is a prefix of.
+        HANDLE_AMBIGUOUS, // Not online, and a prefix of several online handles.
+        HANDLE_SUPPRESS   // Known not to exist; sending would only return an error.
+    };
+
+    // A list is trusted for absent handles for freshSeconds after it arrived.
+    explicit HandleDirectory(int freshSeconds = 30);
+
+    // Replaces the online handles with a complete %L list.
+    void replaceOnline(const vector<string> &handles);
+
+    void markOnline(const string &handle);
+    void markUnknown(const string &handle);
+
+    // Checks one destination; on HANDLE_COMPLETED, handle is replaced by
+    // its (lowercase) completion. HANDLE_AMBIGUOUS and HANDLE_SUPPRESS are not sent.
+    Verdict resolve(string &handle);
+
+    // True while the last %L list is recent enough to trust absences.
+    bool isFresh() const;
+
+    size_t onlineCount() const { return online.size(); }
+    size_t unknownCount() const { return unknown.size(); }
+    uint64_t getSuppressed() const { return suppressed; }
+    uint64_t getCompleted() const { return completed; }
+
+private:
+    vector<string> online; // Sorted, so prefixes are one lower_bound() away.
+    set<string> unknown;
+    chrono::seconds freshFor;
+    chrono::steady_clock::time_point listedAt;
+    bool listed;
+
+    uint64_t suppressed;
+    uint64_t completed;
+};
+
+#endif // HANDLE_DIRECTORY_H
@@ -0,0 +1,153 @@
+#include "IntentClassifier.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const uint32_t IntentClassifier::UNIGRAM_SEED;
+const uint32_t IntentClassifier::BIGRAM_SEED;
+
+IntentClassifier::IntentClassifier()
+    : fd(-1), mappedSize(0), mapping(nullptr), header(nullptr), priors(nullptr), weights(nullptr)
+{
+}
+
+IntentClassifier::~IntentClassifier()
+{
+    close();
+}
+
+bool IntentClassifier::load(const string &path)
+{
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror("open intent model");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(IntentModelFileHeader))
+    {
+        cerr << "[ERROR] Intent model file is too small or unreadable." << endl;
+        close();
+        return false;
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap intent model");
+        close();
+        return false;
+    }
+    mapping = mem;
+    mappedSize = st.st_size;
+    const IntentModelFileHeader *candidate = static_cast<const IntentModelFileHeader *>(mem);
+
+    bool valid = memcmp(candidate->magic, INTENT_MODEL_MAGIC, sizeof(candidate->magic)) == 0 &&
+                 candidate->version == INTENT_MODEL_VERSION &&
+                 candidate->classCount == INTENT_CLASS_COUNT &&
+                 candidate->stride == INTENT_CLASS_STRIDE &&
+                 candidate->bucketBits >= INTENT_MIN_BUCKET_BITS &&
+                 candidate->bucketBits <= INTENT_MAX_BUCKET_BITS;
+    size_t expectedSize = sizeof(IntentModelFileHeader);
+    if (valid)
+        expectedSize += ((static_cast<size_t>(1) << candidate->bucketBits) + 1) * INTENT_CLASS_STRIDE * sizeof(float);
+    if (!valid || mappedSize != expectedSize)
+    {
+        cerr << "[ERROR] Not a valid intent model file (bad magic, version or size)." << endl;
+        close();
+        return false;
+    }
+
+    header = candidate;
+    priors = reinterpret_cast<const float *>(static_cast<const uint8_t *>(mapping) + sizeof(IntentModelFileHeader));
+    weights = priors + INTENT_CLASS_STRIDE;
+
+    // Touch the table now rather than on the first messages.
+    madvise(mapping, mappedSize, MADV_WILLNEED);
+    return true;
+}
+
+void IntentClassifier::close()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mappedSize);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    mapping = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    priors = nullptr;
+    weights = nullptr;
+}
+
+Intent IntentClassifier::classify(const char *text, const TokenSpan *tokens, size_t count) const
+{
+    if (header == nullptr)
+        return INTENT_UNKNOWN;
+
+    // Fixed-length rows keep the inner loop a straight vector add.
+    float scores[INTENT_CLASS_STRIDE];
+    memcpy(scores, priors, sizeof(scores));
+    const float *table = weights;
+    forEachFeature(text, tokens, count, header->bucketBits, [&](uint32_t bucket) {
+        const float *row = table + static_cast<size_t>(bucket) * INTENT_CLASS_STRIDE;
+        for (int c = 0; c < INTENT_CLASS_STRIDE; c++)
+            scores[c] += row[c];
+    });
+
+    // Ties go to the lower class, like IntentModel's keyword scores.
+    int best = 0;
+    for (int c = 1; c < INTENT_CLASS_COUNT; c++)
+    {
+        if (scores[c] > scores[best])
+            best = c;
+    }
+    return static_cast<Intent>(best);
+}
+
+bool IntentClassifier::save(const string &path, uint32_t bucketBits, uint32_t examples,
+                            const vector<float> &priorRow, const vector<float> &weightRows)
+{
+    if (bucketBits < INTENT_MIN_BUCKET_BITS || bucketBits > INTENT_MAX_BUCKET_BITS ||
+        priorRow.size() != INTENT_CLASS_STRIDE ||
+        weightRows.size() != (static_cast<size_t>(1) << bucketBits) * INTENT_CLASS_STRIDE)
+    {
+        cerr << "[ERROR] Intent model tables do not match " << bucketBits << " bucket bits." << endl;
+        return false;
+    }
+
+    IntentModelFileHeader fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    memcpy(fileHeader.magic, INTENT_MODEL_MAGIC, sizeof(fileHeader.magic));
+    fileHeader.version = INTENT_MODEL_VERSION;
+    fileHeader.bucketBits = bucketBits;
+    fileHeader.classCount = INTENT_CLASS_COUNT;
+    fileHeader.stride = INTENT_CLASS_STRIDE;
+    fileHeader.examples = examples;
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        perror("open intent model for writing");
+        return false;
+    }
+    bool ok = fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1 &&
+              fwrite(priorRow.data(), sizeof(float), priorRow.size(), file) == priorRow.size() &&
+              fwrite(weightRows.data(), sizeof(float), weightRows.size(), file) == weightRows.size();
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok)
+        cerr << "[ERROR] Failed to write intent model " << path << endl;
+    return ok;
+}
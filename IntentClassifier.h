@@ -0,0 +1,131 @@
+#ifndef INTENT_CLASSIFIER_H
+#define INTENT_CLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IntentModel.h"
+#include "TokenSpan.h"
+
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Binary intent model layout (written by nlptrain, host byte order).
+//
+// An IntentModelFileHeader is followed by INTENT_CLASS_STRIDE log priors and
+// then one row of INTENT_CLASS_STRIDE log likelihoods per feature bucket:
+//
+//     float priors[STRIDE];
+//     float weights[1 << bucketBits][STRIDE];
+//
+// Row c of a bucket is log P(feature | intent c); class INTENT_UNKNOWN is the
+// "none of the commands" label. Padding classes hold 0 in every row and a
+// very negative prior, so they never win.
+// -----------------------------------------------------------------------------
+
+#define INTENT_MODEL_MAGIC "NLPNBAY1"
+#define INTENT_MODEL_VERSION 1
+
+// Scored classes: every Intent plus INTENT_UNKNOWN.
+#define INTENT_CLASS_COUNT (INTENT_COUNT + 1)
+
+// Floats per weight row; a power of two so a row is one aligned 32-byte block.
+#define INTENT_CLASS_STRIDE 8
+
+#define INTENT_MIN_BUCKET_BITS 8
+#define INTENT_MAX_BUCKET_BITS 24
+
+#pragma pack(push, 1)
+struct IntentModelFileHeader
+{
+    char magic[8];       // INTENT_MODEL_MAGIC (not null terminated).
+    uint32_t version;    // INTENT_MODEL_VERSION.
+    uint32_t bucketBits; // log2 of the number of feature buckets.
+    uint32_t classCount; // INTENT_CLASS_COUNT.
+    uint32_t stride;     // INTENT_CLASS_STRIDE.
+    uint32_t examples;   // Training utterances (informational).
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(IntentModelFileHeader) == 32, "IntentModelFileHeader must be 32 bytes");
+
+// Multinomial naive-Bayes intent classifier over hashed unigram and bigram
+// features, scored straight out of a read-only mapping of the model file.
+//
+// classify() adds the prior row and one weight row per feature of the
+// message into a fixed-size score vector, so the cost is one contiguous
+// 32-byte row per token and loading is a single mmap, however large the
+// table is. The mapping is never written after load(), so any number of
+// threads may classify() concurrently as long as none calls load() or close().
+class IntentClassifier
+{
+public:
+    IntentClassifier();
+    ~IntentClassifier();
+
+    // Maps path read-only and validates its header. Returns true on success.
+    bool load(const string &path);
+    void close();
+
+    bool isLoaded() const { return header != nullptr; }
+    uint32_t getBucketBits() const { return header ? header->bucketBits : 0; }
+
+    // The most likely intent of the (lowercased, whitespace-split) tokens of text.
+    Intent classify(const char *text, const TokenSpan *tokens, size_t count) const;
+
+    // Writes a model file; priors has INTENT_CLASS_STRIDE entries and weights
+    // (1 << bucketBits) * INTENT_CLASS_STRIDE. Returns true on success.
+    static bool save(const string &path, uint32_t bucketBits, uint32_t examples,
+                     const vector<float> &priors, const vector<float> &weights);
+
+    // Calls visit(bucket) for the unigram of every token and the bigram of
+    // every adjacent token pair. The trainer and classify() share this, so
+    // both sides hash exactly the same features.
+    template <typename Visitor>
+    static void forEachFeature(const char *text, const TokenSpan *tokens, size_t count,
+                               uint32_t bucketBits, Visitor visit)
+    {
+        uint32_t previous = 0;
+        for (size_t t = 0; t < count; t++)
+        {
+            uint32_t hash = hashToken(UNIGRAM_SEED, text + tokens[t].offset, tokens[t].length);
+            visit(bucketOf(hash, bucketBits));
+            if (t > 0)
+                visit(bucketOf((previous ^ BIGRAM_SEED) * 16777619u ^ hash, bucketBits));
+            previous = hash;
+        }
+    }
+
+private:
+    IntentClassifier(const IntentClassifier &);
+    IntentClassifier &operator=(const IntentClassifier &);
+
+    static const uint32_t UNIGRAM_SEED = 2166136261u;
+    static const uint32_t BIGRAM_SEED = 0x5BD1E995u;
+
+    // FNV-1a of a token.
+    static uint32_t hashToken(uint32_t hash, const char *token, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ static_cast<unsigned char>(token[i])) * 16777619u;
+        return hash;
+    }
+
+    // Multiplicative mix, so the top bits of every feature hash are usable.
+    static uint32_t bucketOf(uint32_t hash, uint32_t bucketBits)
+    {
+        return (hash * 0x9E3779B1u) >> (32 - bucketBits);
+    }
+
+    int fd;
+    size_t mappedSize;
+    void *mapping;
+    const IntentModelFileHeader *header;
+    const float *priors;
+    const float *weights;
+};
+
+#endif // INTENT_CLASSIFIER_H
@@ -0,0 +1,245 @@
+#include "IntentModel.h"
+#include "SpellDictionary.h"
+
+#include <cstring>
+
+using namespace std;
+
+struct IntentKeyword
+{
+    const char *text;
+    Intent intent;
+};
+
+// The bag-of-words vocabulary; a token scores one point for each intent that lists it.
+static const IntentKeyword intentKeywords[] = {
+    {"list", INTENT_LIST},
+    {"client", INTENT_LIST},
+    {"clients", INTENT_LIST},
+    {"show", INTENT_LIST},
+    {"display", INTENT_LIST},
+    {"broadcast", INTENT_BROADCAST},
+    {"all", INTENT_BROADCAST},
+    {"everyone", INTENT_BROADCAST},
+    {"send", INTENT_SEND_MESSAGE},
+    {"message", INTENT_SEND_MESSAGE},
+    {"to", INTENT_SEND_MESSAGE},
+    {"deliver", INTENT_SEND_MESSAGE},
+    {"status", INTENT_STATUS},
+    {"connection", INTENT_STATUS},
+    {"info", INTENT_STATUS},
+    {"exit", INTENT_EXIT},
+    {"quit", INTENT_EXIT},
+    {"close", INTENT_EXIT},
+    {"bye", INTENT_EXIT}};
+
+// Argument anchors, indexed by CommandAnchor. "broadcast" keeps the substring
+// semantics of the original body extraction ("rebroadcast hi" has body "hi").
+static const struct
+{
+    const char *text;
+    KeywordAutomaton::MatchMode mode;
+} commandAnchors[ANCHOR_COUNT] = {
+    {"broadcast", KeywordAutomaton::MATCH_ANYWHERE},
+    {"to", KeywordAutomaton::MATCH_WHOLE_TOKEN}};
+
+static const char *const intentNames[] = {"broadcast", "exit", "list", "send_message", "status", "unknown"};
+
+// FNV-1a step; classify() folds tokens byte by byte with the same function.
+static inline uint32_t hashStep(uint32_t hash, unsigned char c)
+{
+    return (hash ^ c) * 16777619u;
+}
+
+static const uint32_t HASH_SEED = 2166136261u;
+
+// First strictly greater score wins, exactly like the old map iteration.
+static Intent highestScore(const int scores[INTENT_COUNT])
+{
+    Intent best = INTENT_UNKNOWN;
+    int maxScore = 0;
+    for (int intent = 0; intent < INTENT_COUNT; intent++)
+    {
+        if (scores[intent] > maxScore)
+        {
+            maxScore = scores[intent];
+            best = static_cast<Intent>(intent);
+        }
+    }
+    return best;
+}
+
+const IntentModel &IntentModel::instance()
+{
+    static const IntentModel model;
+    return model;
+}
+
+IntentModel::IntentModel() : multiplier(0)
+{
+    const size_t keywordCount = sizeof(intentKeywords) / sizeof(intentKeywords[0]);
+
+    // Search for a multiplier that places every keyword in a distinct slot.
+    for (uint32_t candidate = 0x9E3779B1u; multiplier == 0; candidate += 2)
+    {
+        memset(table, 0, sizeof(table));
+        bool collision = false;
+
+        for (size_t k = 0; k < keywordCount && !collision; k++)
+        {
+            const char *text = intentKeywords[k].text;
+            size_t length = strlen(text);
+            uint32_t hash = HASH_SEED;
+            for (size_t i = 0; i < length; i++)
+                hash = hashStep(hash, static_cast<unsigned char>(text[i]));
+
+            Slot &slot = table[(hash * candidate) >> (32 - TABLE_BITS)];
+            if (slot.length == length && memcmp(slot.text, text, length) == 0)
+            {
+                slot.intents |= 1u << intentKeywords[k].intent;
+                continue;
+            }
+            if (slot.length != 0)
+            {
+                collision = true;
+                break;
+            }
+            slot.length = static_cast<uint8_t>(length);
+            memcpy(slot.text, text, length);
+            slot.intents = 1u << intentKeywords[k].intent;
+        }
+
+        if (!collision)
+            multiplier = candidate;
+    }
+
+    for (size_t k = 0; k < keywordCount; k++)
+    {
+        uint32_t id = addPattern(intentKeywords[k].text, KeywordAutomaton::MATCH_WHOLE_TOKEN);
+        patternIntents[id] |= 1u << intentKeywords[k].intent;
+    }
+    for (int anchor = 0; anchor < ANCHOR_COUNT; anchor++)
+    {
+        uint32_t id = addPattern(commandAnchors[anchor].text, commandAnchors[anchor].mode);
+        patternAnchor[id] = static_cast<int8_t>(anchor);
+    }
+    automaton.compile();
+}
+
+uint32_t IntentModel::addPattern(const char *text, KeywordAutomaton::MatchMode mode)
+{
+    for (uint32_t id = 0; id < automaton.getPatternCount(); id++)
+    {
+        if (automaton.getPatternMode(id) == mode && automaton.getPatternText(id) == text)
+            return id;
+    }
+
+    uint32_t id = automaton.addPattern(text, strlen(text), mode);
+    patternIntents.push_back(0);
+    patternAnchor.push_back(-1);
+    return id;
+}
+
+void IntentModel::vote(uint32_t intents, int scores[INTENT_COUNT])
+{
+    for (int intent = 0; intents != 0 && intent < INTENT_COUNT; intent++)
+    {
+        if (intents & (1u << intent))
+            scores[intent]++;
+    }
+}
+
+uint32_t IntentModel::lookup(const char *token, size_t length) const
+{
+    if (length == 0 || length > MAX_KEYWORD_LENGTH)
+        return 0;
+
+    uint32_t hash = HASH_SEED;
+    for (size_t i = 0; i < length; i++)
+        hash = hashStep(hash, static_cast<unsigned char>(token[i]));
+
+    const Slot &slot = table[slotFor(hash)];
+    if (slot.length != length || memcmp(slot.text, token, length) != 0)
+        return 0;
+    return slot.intents;
+}
+
+Intent IntentModel::classify(const char *text, size_t length) const
+{
+    int scores[INTENT_COUNT] = {0};
+    automaton.scan(text, length, [&](const KeywordAutomaton::Match &match) {
+        vote(patternIntents[match.pattern], scores);
+    });
+    return highestScore(scores);
+}
+
+IntentScan IntentModel::scan(const char *text, size_t length, const TokenSpan *tokens, size_t count,
+                             const SpellDictionary *vocabulary) const
+{
+    IntentScan result;
+    for (int anchor = 0; anchor < ANCHOR_COUNT; anchor++)
+    {
+        result.anchorStart[anchor] = -1;
+        result.anchorEnd[anchor] = -1;
+    }
+
+    int scores[INTENT_COUNT] = {0};
+    automaton.scan(text, length, [&](const KeywordAutomaton::Match &match) {
+        vote(patternIntents[match.pattern], scores);
+        int anchor = patternAnchor[match.pattern];
+        if (anchor >= 0 && result.anchorStart[anchor] < 0)
+        {
+            result.anchorStart[anchor] = static_cast<int32_t>(match.start);
+            result.anchorEnd[anchor] = static_cast<int32_t>(match.end);
+        }
+    });
+
+    // Misspelled keywords only vote when a vocabulary is given.
+    for (size_t t = 0; vocabulary != nullptr && t < count; t++)
+    {
+        const char *token = text + tokens[t].offset;
+        if (lookup(token, tokens[t].length) != 0)
+            continue;
+
+        int distance = 0;
+        int id = vocabulary->lookup(token, tokens[t].length, &distance);
+        if (id >= 0 && distance > 0)
+        {
+            const string &corrected = vocabulary->getWord(id);
+            vote(lookup(corrected.data(), corrected.size()), scores);
+        }
+    }
+
+    result.intent = highestScore(scores);
+    return result;
+}
+
+size_t IntentModel::getKeywordCount()
+{
+    return sizeof(intentKeywords) / sizeof(intentKeywords[0]);
+}
+
+const char *IntentModel::getKeyword(size_t index)
+{
+    return index < getKeywordCount() ? intentKeywords[index].text : nullptr;
+}
+
+const char *IntentModel::intentName(Intent intent)
+{
+    if (intent < 0 || intent > INTENT_UNKNOWN)
+        return intentNames[INTENT_UNKNOWN];
+    return intentNames[intent];
+}
+
+bool IntentModel::intentFromName(const char *name, Intent *intent)
+{
+    for (int i = 0; i <= INTENT_UNKNOWN; i++)
+    {
+        if (strcmp(name, intentNames[i]) == 0)
+        {
+            *intent = static_cast<Intent>(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,115 @@
+#ifndef INTENT_MODEL_H
+#define INTENT_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "KeywordAutomaton.h"
+#include "TokenSpan.h"
+
+class SpellDictionary;
+
+using namespace std;
+
+// Intents in the tie-break order of the old std::map classifier (alphabetical):
+// on equal scores the first intent in this order wins.
+enum Intent
+{
+    INTENT_BROADCAST,
+    INTENT_EXIT,
+    INTENT_LIST,
+    INTENT_SEND_MESSAGE,
+    INTENT_STATUS,
+    INTENT_COUNT,
+    INTENT_UNKNOWN = INTENT_COUNT
+};
+
+// Words that mark where the arguments of a command begin.
+enum CommandAnchor
+{
+    ANCHOR_BROADCAST, // "broadcast" anywhere in the text (the body follows it).
+    ANCHOR_TO,        // "to" as a whole token (the destination follows it).
+    ANCHOR_COUNT
+};
+
+// Everything one pass over a message finds: the winning intent and the byte
+// range of the first occurrence of each anchor (-1 when it does not occur).
+struct IntentScan
+{
+    Intent intent;
+    int32_t anchorStart[ANCHOR_COUNT];
+    int32_t anchorEnd[ANCHOR_COUNT];
+};
+
+// Immutable keyword model used by NLPModel::recognizeIntent.
+//
+// Keywords and command anchors are compiled once into a KeywordAutomaton, so
+// scoring every intent and locating every anchor is a single pass over the
+// text whose cost does not grow with the number of keywords. A perfect hash
+// table (no two keywords share a slot) additionally maps a single token to
+// the intents it votes for. Nothing here allocates after construction, and
+// the shared instance is safe to use from any number of threads.
+class IntentModel
+{
+public:
+    // The process-wide model, built on first use.
+    static const IntentModel &instance();
+
+    // Returns the intent with the highest keyword score, or INTENT_UNKNOWN if
+    // no keyword matched. text does not need to be NUL terminated.
+    Intent classify(const char *text, size_t length) const;
+
+    // classify() plus the anchor positions. tokens are the whitespace-split
+    // tokens of text; with a vocabulary, a token that is not a keyword is
+    // looked up there and, if it is a misspelling of a keyword, votes as that
+    // keyword.
+    IntentScan scan(const char *text, size_t length, const TokenSpan *tokens, size_t count,
+                    const SpellDictionary *vocabulary = nullptr) const;
+
+    // Bitmask (1 << Intent) of the intents token votes for; 0 if it is not a keyword.
+    uint32_t lookup(const char *token, size_t length) const;
+
+    // The keyword vocabulary, for seeding spelling dictionaries.
+    static size_t getKeywordCount();
+    static const char *getKeyword(size_t index);
+
+    // "broadcast", "exit", "list", "send_message", "status" or "unknown".
+    static const char *intentName(Intent intent);
+
+    // Inverse of intentName(); returns false for any other name.
+    static bool intentFromName(const char *name, Intent *intent);
+
+    static const int TABLE_BITS = 6;
+    static const int TABLE_SIZE = 1 << TABLE_BITS;
+    static const size_t MAX_KEYWORD_LENGTH = 15;
+
+private:
+    struct Slot
+    {
+        uint8_t length; // 0 for an empty slot.
+        char text[MAX_KEYWORD_LENGTH];
+        uint32_t intents;
+    };
+
+    IntentModel();
+
+    // Adds pattern to the automaton (once per text and mode) and returns its id.
+    uint32_t addPattern(const char *text, KeywordAutomaton::MatchMode mode);
+
+    // Adds one point per intent in intents to scores.
+    static void vote(uint32_t intents, int scores[INTENT_COUNT]);
+
+    uint32_t slotFor(uint32_t hash) const { return (hash * multiplier) >> (32 - TABLE_BITS); }
+
+    uint32_t multiplier; // Chosen at build time so every keyword gets its own slot.
+    Slot table[TABLE_SIZE];
+
+    // Keywords (whole tokens) and anchors; per pattern id, the intents it
+    // votes for and the anchor it marks (-1 for none).
+    KeywordAutomaton automaton;
+    vector<uint32_t> patternIntents;
+    vector<int8_t> patternAnchor;
+};
+
+#endif // INTENT_MODEL_H
@@ -0,0 +1,115 @@
+#include "KeywordAutomaton.h"
+
+#include <cstring>
+
+// Marks a trie edge that does not exist yet (only while compiling).
+#define NO_STATE 0xFFFFFFFFu
+
+KeywordAutomaton::KeywordAutomaton() : classCount(1), stateCount(1), transitions(1, 0), outputStart(2, 0)
+{
+    memset(byteClass, 0, sizeof(byteClass));
+}
+
+uint32_t KeywordAutomaton::addPattern(const char *text, size_t length, MatchMode mode)
+{
+    Pattern pattern;
+    pattern.text.assign(text, length);
+    pattern.length = static_cast<uint32_t>(length);
+    pattern.mode = mode;
+    patterns.push_back(pattern);
+    return static_cast<uint32_t>(patterns.size() - 1);
+}
+
+void KeywordAutomaton::compile()
+{
+    // Byte classes: one per byte that occurs in a pattern, 0 for the rest.
+    memset(byteClass, 0, sizeof(byteClass));
+    classCount = 1;
+    for (const Pattern &pattern : patterns)
+    {
+        for (unsigned char c : pattern.text)
+        {
+            if (byteClass[c] == 0)
+                byteClass[c] = static_cast<uint16_t>(classCount++);
+        }
+    }
+
+    // Trie of all patterns; its edges are the first entries of the DFA table.
+    transitions.assign(classCount, NO_STATE);
+    stateCount = 1;
+    vector<vector<uint32_t>> ownPatterns(1);
+    for (uint32_t id = 0; id < patterns.size(); id++)
+    {
+        if (patterns[id].length == 0)
+            continue;
+        uint32_t state = 0;
+        for (unsigned char c : patterns[id].text)
+        {
+            uint32_t &next = transitions[state * classCount + byteClass[c]];
+            if (next == NO_STATE)
+            {
+                next = stateCount++;
+                transitions.resize(static_cast<size_t>(stateCount) * classCount, NO_STATE);
+                ownPatterns.push_back(vector<uint32_t>());
+            }
+            // transitions may have moved; read the edge again.
+            state = transitions[state * classCount + byteClass[c]];
+        }
+        ownPatterns[state].push_back(id);
+    }
+
+    // Breadth-first: a state's failure state is shallower, so its row and
+    // outputs are already final when the state is reached.
+    vector<uint32_t> failure(stateCount, 0);
+    vector<vector<uint32_t>> stateOutputs(stateCount);
+    vector<uint32_t> queue;
+    queue.reserve(stateCount);
+
+    for (uint32_t c = 0; c < classCount; c++)
+    {
+        uint32_t &next = transitions[c];
+        if (next == NO_STATE)
+        {
+            next = 0;
+        }
+        else
+        {
+            failure[next] = 0;
+            queue.push_back(next);
+        }
+    }
+
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        uint32_t state = queue[head];
+
+        // Longer (own) patterns first, then those of the suffix chain.
+        stateOutputs[state] = ownPatterns[state];
+        const vector<uint32_t> &inherited = stateOutputs[failure[state]];
+        stateOutputs[state].insert(stateOutputs[state].end(), inherited.begin(), inherited.end());
+
+        for (uint32_t c = 0; c < classCount; c++)
+        {
+            uint32_t &next = transitions[state * classCount + c];
+            uint32_t fallback = transitions[failure[state] * classCount + c];
+            if (next == NO_STATE)
+            {
+                next = fallback;
+            }
+            else
+            {
+                failure[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    outputStart.assign(stateCount + 1, 0);
+    outputs.clear();
+    for (uint32_t state = 0; state < stateCount; state++)
+    {
+        outputStart[state] = static_cast<uint32_t>(outputs.size());
+        outputs.insert(outputs.end(), stateOutputs[state].begin(), stateOutputs[state].end());
+    }
+    outputStart[stateCount] = static_cast<uint32_t>(outputs.size());
+}
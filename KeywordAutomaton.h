@@ -0,0 +1,112 @@
+#ifndef KEYWORD_AUTOMATON_H
+#define KEYWORD_AUTOMATON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Aho–Corasick matcher for a fixed set of byte patterns.
+//
+// compile() turns the pattern trie and its failure links into a dense DFA
+// over byte classes (every byte that occurs in some pattern gets a class of
+// its own; all other bytes share class 0, which always leads back to the
+// root). scan() then makes exactly one table step per input byte and reports
+// every occurrence of every pattern, so its cost depends on the text and the
+// number of matches, not on how many patterns there are.
+//
+// A pattern either matches anywhere or only as a whole whitespace-delimited
+// token. scan() keeps its state in a local variable and only reads the
+// compiled tables, so threads may share one automaton once compile() has
+// returned; addPattern() and compile() need exclusive access.
+class KeywordAutomaton
+{
+public:
+    enum MatchMode : uint8_t
+    {
+        MATCH_ANYWHERE,
+        MATCH_WHOLE_TOKEN
+    };
+
+    // One occurrence: text[start, end) equals pattern.
+    struct Match
+    {
+        uint32_t start;
+        uint32_t end;
+        uint32_t pattern;
+    };
+
+    KeywordAutomaton();
+
+    // Adds a pattern and returns its id (ids count up from 0). Patterns
+    // added after compile() take effect at the next compile().
+    uint32_t addPattern(const char *text, size_t length, MatchMode mode);
+
+    // Builds the DFA from every pattern added so far.
+    void compile();
+
+    size_t getPatternCount() const { return patterns.size(); }
+    size_t getStateCount() const { return stateCount; }
+    const string &getPatternText(uint32_t id) const { return patterns[id].text; }
+    MatchMode getPatternMode(uint32_t id) const { return patterns[id].mode; }
+
+    // Calls visit(const Match &) for every occurrence, in order of end
+    // position; occurrences ending at the same byte come longest first.
+    template <typename Visitor>
+    void scan(const char *text, size_t length, Visitor visit) const
+    {
+        uint32_t state = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            state = transitions[state * classCount + byteClass[static_cast<unsigned char>(text[i])]];
+            for (uint32_t o = outputStart[state]; o < outputStart[state + 1]; o++)
+            {
+                const Pattern &pattern = patterns[outputs[o]];
+                size_t end = i + 1;
+                size_t start = end - pattern.length;
+                if (pattern.mode == MATCH_WHOLE_TOKEN &&
+                    ((start > 0 && !isSeparator(text[start - 1])) || (end < length && !isSeparator(text[end]))))
+                    continue;
+
+                Match match;
+                match.start = static_cast<uint32_t>(start);
+                match.end = static_cast<uint32_t>(end);
+                match.pattern = outputs[o];
+                visit(match);
+            }
+        }
+    }
+
+    // Same separators as "istringstream >> token".
+    static bool isSeparator(char c)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        return u == ' ' || (u >= '\t' && u <= '\r');
+    }
+
+private:
+    struct Pattern
+    {
+        string text;
+        uint32_t length;
+        MatchMode mode;
+    };
+
+    vector<Pattern> patterns;
+
+    uint16_t byteClass[256];
+    uint32_t classCount;
+    uint32_t stateCount;
+
+    // transitions[state * classCount + class]; state 0 is the root.
+    vector<uint32_t> transitions;
+
+    // Patterns ending in state s (its own and those of its suffix states) are
+    // outputs[outputStart[s], outputStart[s + 1]).
+    vector<uint32_t> outputStart;
+    vector<uint32_t> outputs;
+};
+
+#endif // KEYWORD_AUTOMATON_H
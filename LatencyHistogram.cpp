@@ -0,0 +1,166 @@
+#include "LatencyHistogram.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#include <unistd.h>
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    minValue = UINT64_MAX;
+    maxValue = 0;
+}
+
+int LatencyHistogram::bucketFor(uint64_t value)
+{
+    if (value < 2 * SUB_BUCKETS)
+        return static_cast<int>(value);
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+    int sub = static_cast<int>(value >> shift) - SUB_BUCKETS;
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(int index)
+{
+    if (index < 2 * SUB_BUCKETS)
+        return static_cast<uint64_t>(index);
+
+    int shift = index / SUB_BUCKETS - 1;
+    uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+    uint64_t lower = (SUB_BUCKETS + sub) << shift;
+    return lower + ((static_cast<uint64_t>(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets[bucketFor(value)]++;
+    count++;
+    sum += value;
+    if (value < minValue)
+        minValue = value;
+    if (value > maxValue)
+        maxValue = value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < BUCKET_COUNT; i++)
+        buckets[i] += other.buckets[i];
+    count += other.count;
+    sum += other.sum;
+    if (other.count > 0 && other.minValue < minValue)
+        minValue = other.minValue;
+    if (other.maxValue > maxValue)
+        maxValue = other.maxValue;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+    if (p <= 0.0)
+        return getMin();
+    if (p >= 1.0)
+        return maxValue;
+
+    uint64_t rank = static_cast<uint64_t>(p * count);
+    if (rank >= count)
+        rank = count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            uint64_t value = bucketMidpoint(i);
+            // Never report outside the observed range.
+            if (value < minValue)
+                value = minValue;
+            if (value > maxValue)
+                value = maxValue;
+            return value;
+        }
+    }
+    return maxValue;
+}
+
+void LatencyHistogram::printSummary(const string &label, const string &unit) const
+{
+    cout << dec << left << setw(28) << label << right
+         << " n=" << setw(8) << count
+         << " min=" << setw(9) << getMin()
+         << " p50=" << setw(9) << percentile(0.50)
+         << " p90=" << setw(9) << percentile(0.90)
+         << " p99=" << setw(9) << percentile(0.99)
+         << " p99.9=" << setw(9) << percentile(0.999)
+         << " max=" << setw(9) << getMax()
+         << " mean=" << fixed << setprecision(1) << getMean()
+         << " " << unit << endl;
+}
+
+// Loops until all of length bytes are transferred.
+static bool writeAll(int fd, const void *data, size_t length)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (length > 0)
+    {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t length)
+{
+    uint8_t *p = static_cast<uint8_t *>(data);
+    while (length > 0)
+    {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool LatencyHistogram::writeTo(int fd) const
+{
+    uint64_t totals[4] = {count, sum, minValue, maxValue};
+    return writeAll(fd, totals, sizeof(totals)) && writeAll(fd, buckets, sizeof(buckets));
+}
+
+bool LatencyHistogram::readFrom(int fd)
+{
+    uint64_t totals[4];
+    if (!readAll(fd, totals, sizeof(totals)) || !readAll(fd, buckets, sizeof(buckets)))
+        return false;
+    count = totals[0];
+    sum = totals[1];
+    minValue = totals[2];
+    maxValue = totals[3];
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Log-linear histogram of latency samples (any integer unit, usually microseconds).
+//
+// Values below 64 get their own bucket; above that every power of two is split
+// into 32 sub-buckets, giving ~3% relative precision over the full uint64 range.
+// Bucket counts are plain integers, so merging two histograms is exact.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    // Records one sample.
+    void record(uint64_t value);
+
+    // Adds every sample of other into this histogram.
+    void merge(const LatencyHistogram &other);
+
+    // Removes all samples.
+    void reset();
+
+    uint64_t getCount() const { return count; }
+    uint64_t getMin() const { return count ? minValue : 0; }
+    uint64_t getMax() const { return maxValue; }
+    double getMean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+    // Returns the value at percentile p (0.0 - 1.0), accurate to the bucket width.
+    uint64_t percentile(double p) const;
+
+    // Prints "label: count, min, p50, p90, p99, p99.9, max, mean" on one line.
+    void printSummary(const string &label, const string &unit) const;
+
+    // Writes/reads the histogram as raw bytes on a pipe or socket between
+    // processes of the same binary. Return false on a short read/write.
+    bool writeTo(int fd) const;
+    bool readFrom(int fd);
+
+private:
+    static int bucketFor(uint64_t value);
+    static uint64_t bucketMidpoint(int index);
+
+    uint64_t buckets[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t minValue;
+    uint64_t maxValue;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,460 @@
+#include "NLPModel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+#include "TokenSpan.h"
+#include "WorkerPool.h"
+
+// Common spelling mistakes and their corrections.
+struct SpellingCorrection
+{
+    const char *wrong;
+    size_t wrongLength;
+    const char *right;
+    size_t rightLength;
+};
+
+#define CORRECTION(wrong, right) {wrong, sizeof(wrong) - 1, right, sizeof(right) - 1}
+
+static const SpellingCorrection corrections[] = {
+    CORRECTION("helo", "hello"),
+    CORRECTION("teh", "the"),
+    CORRECTION("mesage", "message"),
+    CORRECTION("recieve", "receive"),
+    CORRECTION("adress", "address")};
+
+#undef CORRECTION
+
+// Longest growth of one token by a correction ("helo" -> "hello").
+#define MAX_CORRECTION_GROWTH 1
+
+// Room for the longest fixed prompt or command prefix, plus a corrected destination.
+#define RESPONSE_OVERHEAD 256
+
+// The corrected tokens joined by single spaces, with one span per token,
+// plus the thread's memo of Idle-path answers.
+struct NLPScratch
+{
+    vector<char> normalized;
+    size_t normalizedLength = 0;
+    vector<TokenSpan> tokens;
+
+    ResponseCache cache;
+    uint64_t cacheModelId = 0; // Model whose answers are in cache.
+};
+
+// Reused by every call on this thread; grows to the longest message seen.
+static thread_local NLPScratch threadScratch;
+
+// A cached "%M" command names its destination as typed, so it is only
+// reused when there are no known handles it could be corrected against.
+#define CACHED_SEND_COMMAND 1u
+
+// Source of NLPModel::cacheId; 0 is never used.
+static atomic<uint64_t> nextCacheId(1);
+
+// Messages a thread of processBatch claims at a time; small enough to balance
+// bursts of a few hundred, large enough to keep the shared counter cold.
+#define BATCH_GRAIN 32
+
+// Index of the token that starts at byte offset (a match position from IntentModel::scan).
+static size_t tokenAt(const vector<TokenSpan> &tokens, uint32_t offset)
+{
+    return lower_bound(tokens.begin(), tokens.end(), offset,
+                       [](const TokenSpan &span, uint32_t value) { return span.offset < value; }) -
+           tokens.begin();
+}
+
+// Appends to a fixed output buffer, counting (but not writing) what does not fit.
+struct NLPModel::ResponseWriter
+{
+    char *data;
+    size_t capacity;
+    size_t length;
+
+    ResponseWriter(char *out, size_t outSize) : data(out), capacity(outSize), length(0) {}
+
+    void append(const char *text, size_t textLength)
+    {
+        if (length + 1 < capacity)
+        {
+            size_t room = capacity - 1 - length;
+            memcpy(data + length, text, textLength < room ? textLength : room);
+        }
+        length += textLength;
+    }
+
+    void append(const char *text) { append(text, strlen(text)); }
+    void append(const string &text) { append(text.data(), text.size()); }
+
+    // NUL-terminates the output and returns the untruncated length.
+    size_t finish()
+    {
+        if (capacity > 0)
+            data[length < capacity ? length : capacity - 1] = '\0';
+        return length;
+    }
+};
+
+NLPModel::NLPModel() : fuzzyKeywords(false), cacheId(nextCacheId++)
+{
+    vector<string> keywords;
+    for (size_t i = 0; i < IntentModel::getKeywordCount(); i++)
+        keywords.push_back(IntentModel::getKeyword(i));
+    vocabulary.addWords(keywords);
+}
+
+bool NLPModel::loadDictionary(const string &path)
+{
+    if (!vocabulary.loadFile(path))
+        return false;
+    fuzzyKeywords = true;
+    cacheId = nextCacheId++;
+    return true;
+}
+
+bool NLPModel::loadIntentClassifier(const string &path)
+{
+    if (!classifier.load(path))
+        return false;
+    cacheId = nextCacheId++;
+    return true;
+}
+
+void NLPModel::setThreadCacheCapacity(size_t entries)
+{
+    threadScratch.cache.setCapacity(entries);
+}
+
+ResponseCache::Stats NLPModel::threadCacheStats()
+{
+    return threadScratch.cache.getStats();
+}
+
+shared_ptr<const NLPModel> NLPModel::shared()
+{
+    static const shared_ptr<const NLPModel> model = make_shared<NLPModel>();
+    return model;
+}
+
+shared_ptr<const NLPModel> NLPModel::createWithDictionary(const string &path)
+{
+    return create(path, "");
+}
+
+shared_ptr<const NLPModel> NLPModel::create(const string &dictionaryPath, const string &classifierPath)
+{
+    if (dictionaryPath.empty() && classifierPath.empty())
+        return shared();
+
+    shared_ptr<NLPModel> model = make_shared<NLPModel>();
+    if (!dictionaryPath.empty() && !model->loadDictionary(dictionaryPath))
+        return nullptr;
+    if (!classifierPath.empty() && !model->loadIntentClassifier(classifierPath))
+        return nullptr;
+    return model;
+}
+
+void NLPModel::tokenize(const char *message, size_t length, string &normalized, vector<TokenSpan> &tokens) const
+{
+    NLPScratch &scratch = threadScratch;
+    normalize(message, length, scratch);
+    normalized.assign(scratch.normalized.data(), scratch.normalizedLength);
+    tokens = scratch.tokens;
+}
+
+void NLPModel::correctDestination(const SpellDictionary *knownHandles, const char **handle, size_t *length)
+{
+    if (knownHandles == nullptr || knownHandles->empty())
+        return;
+
+    int distance = 0;
+    int id = knownHandles->lookup(*handle, *length, &distance);
+    if (id < 0 || distance == 0)
+        return;
+
+    const string &corrected = knownHandles->getWord(id);
+    *handle = corrected.data();
+    *length = corrected.size();
+}
+
+void NLPModel::normalize(const char *message, size_t length, NLPScratch &scratch) const
+{
+    // Every token can grow by one byte and needs at most one separator.
+    size_t needed = length + length / 2 * MAX_CORRECTION_GROWTH + 1;
+    if (scratch.normalized.size() < needed)
+        scratch.normalized.resize(needed);
+    scratch.tokens.clear();
+
+    char *out = scratch.normalized.data();
+    size_t written = 0;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        // Whitespace separates tokens, just like "istringstream >> word".
+        while (i < length && isspace(static_cast<unsigned char>(message[i])))
+            i++;
+        if (i == length)
+            break;
+
+        if (!scratch.tokens.empty())
+            out[written++] = ' ';
+
+        // Copy the token lowercased.
+        size_t start = written;
+        while (i < length && !isspace(static_cast<unsigned char>(message[i])))
+            out[written++] = static_cast<char>(tolower(static_cast<unsigned char>(message[i++])));
+
+        // Look the word up without one trailing punctuation mark.
+        size_t wordLength = written - start;
+        char punctuation = 0;
+        if (ispunct(static_cast<unsigned char>(out[written - 1])))
+        {
+            punctuation = out[written - 1];
+            wordLength--;
+        }
+
+        for (const SpellingCorrection &c : corrections)
+        {
+            if (c.wrongLength == wordLength && memcmp(out + start, c.wrong, wordLength) == 0)
+            {
+                memcpy(out + start, c.right, c.rightLength);
+                wordLength = c.rightLength;
+                written = start + wordLength;
+                if (punctuation)
+                    out[written++] = punctuation;
+                break;
+            }
+        }
+
+        TokenSpan span;
+        span.offset = static_cast<uint32_t>(start);
+        span.length = static_cast<uint32_t>(written - start);
+        scratch.tokens.push_back(span);
+    }
+    scratch.normalizedLength = written;
+}
+
+size_t NLPModel::maxResponseSize(const DialogueSession &session, size_t inputLength) const
+{
+    // Normalized text never exceeds inputLength + inputLength / 2 + 1 bytes.
+    return inputLength + inputLength / 2 * MAX_CORRECTION_GROWTH + session.destination.size() + RESPONSE_OVERHEAD;
+}
+
+size_t NLPModel::processMessage(DialogueSession &session, const char *message, size_t length,
+                                char *out, size_t outSize, const SpellDictionary *knownHandles) const
+{
+    ResponseWriter writer(out, outSize);
+    NLPScratch &scratch = threadScratch;
+
+    // Preprocess and spell-correct the message in one pass.
+    normalize(message, length, scratch);
+
+    // If there's a pending command, use new input to complete it.
+    if (session.state != DialogueSession::Idle)
+    {
+        continuePendingCommand(session, scratch, knownHandles, writer);
+        return writer.finish();
+    }
+
+    ResponseCache &cache = scratch.cache;
+    if (scratch.cacheModelId != cacheId)
+    {
+        cache.clear();
+        scratch.cacheModelId = cacheId;
+    }
+
+    const char *key = scratch.normalized.data();
+    bool handlesMayCorrect = knownHandles != nullptr && !knownHandles->empty();
+    const ResponseCache::Entry *cached = cache.find(key, scratch.normalizedLength);
+    if (cached != nullptr && !(handlesMayCorrect && (cached->flags & CACHED_SEND_COMMAND)))
+    {
+        writer.append(cached->value);
+        return writer.finish();
+    }
+
+    IntentScan scan = recognizeIntent(scratch);
+    generateResponse(scan, session, scratch, knownHandles, writer);
+
+    // Remember complete answers that left the session Idle.
+    bool isSend = (scan.intent == INTENT_SEND_MESSAGE);
+    if (session.state == DialogueSession::Idle && writer.length < outSize && !(isSend && handlesMayCorrect))
+        cache.insert(key, scratch.normalizedLength, out, writer.length, isSend ? CACHED_SEND_COMMAND : 0);
+
+    return writer.finish();
+}
+
+void NLPModel::processBatch(NLPBatchItem *items, size_t count, WorkerPool &pool,
+                            const SpellDictionary *knownHandles) const
+{
+    pool.parallelFor(count, BATCH_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            NLPBatchItem &item = items[i];
+            item.response.resize(maxResponseSize(*item.session, item.length));
+            size_t length = processMessage(*item.session, item.message, item.length, &item.response[0],
+                                           item.response.size(), knownHandles);
+            item.response.resize(length);
+        }
+    });
+}
+
+IntentScan NLPModel::recognizeIntent(const NLPScratch &scratch) const
+{
+    // A bag-of-words classifier over the precompiled keyword automaton in IntentModel.
+    IntentScan scan = IntentModel::instance().scan(scratch.normalized.data(), scratch.normalizedLength,
+                                                   scratch.tokens.data(), scratch.tokens.size(),
+                                                   fuzzyKeywords ? &vocabulary : nullptr);
+
+    // A trained model overrides the keyword vote.
+    if (classifier.isLoaded())
+        scan.intent = classifier.classify(scratch.normalized.data(), scratch.tokens.data(), scratch.tokens.size());
+    return scan;
+}
+
+void NLPModel::generateResponse(const IntentScan &scan, DialogueSession &session, const NLPScratch &scratch,
+                                const SpellDictionary *knownHandles, ResponseWriter &out) const
+{
+    const char *text = scratch.normalized.data();
+    const vector<TokenSpan> &tokens = scratch.tokens;
+    Intent intent = scan.intent;
+
+    // Reset state if complete command is formed.
+    session.state = DialogueSession::Idle;
+
+    if (intent == INTENT_LIST)
+    {
+        out.append("%L");
+    }
+    else if (intent == INTENT_BROADCAST)
+    {
+        // The body is everything after the first "broadcast", trimmed.
+        const char *keyword = "broadcast";
+        const char *end = text + scratch.normalizedLength;
+        const char *body = nullptr;
+        if (scan.anchorEnd[ANCHOR_BROADCAST] >= 0)
+            body = text + scan.anchorEnd[ANCHOR_BROADCAST];
+
+        // A misspelled "broadcast" can also carry the intent; its body starts after that token.
+        for (size_t i = 0; body == nullptr && fuzzyKeywords && i < tokens.size(); i++)
+        {
+            int id = vocabulary.lookup(text + tokens[i].offset, tokens[i].length);
+            if (id >= 0 && vocabulary.getWord(id) == keyword)
+                body = text + tokens[i].offset + tokens[i].length;
+        }
+        while (body != nullptr && body < end && *body == ' ')
+            body++;
+
+        if (body == nullptr || body == end)
+        {
+            out.append("Error: No broadcast message provided. Please include a message after 'broadcast'.");
+            return;
+        }
+
+        out.append("%B ");
+        out.append(body, end - body);
+    }
+    else if (intent == INTENT_SEND_MESSAGE)
+    {
+        // "to" separates the command words from the destination.
+        size_t posTo = tokens.size();
+        if (scan.anchorStart[ANCHOR_TO] >= 0)
+            posTo = tokenAt(tokens, static_cast<uint32_t>(scan.anchorStart[ANCHOR_TO]));
+        if (posTo + 1 >= tokens.size())
+        {
+            // Missing destination: set pending state.
+            session.state = DialogueSession::AwaitingDestination;
+            out.append("Please specify a destination handle for your message.");
+            return;
+        }
+
+        const char *destination = text + tokens[posTo + 1].offset;
+        size_t destinationLength = tokens[posTo + 1].length;
+
+        correctDestination(knownHandles, &destination, &destinationLength);
+
+        // The message text is every remaining token, already single-space joined.
+        if (posTo + 2 >= tokens.size())
+        {
+            session.destination.assign(destination, destinationLength);
+            session.state = DialogueSession::AwaitingMessage;
+            out.append("Please provide the message text to send after specifying the destination.");
+            return;
+        }
+        session.reset();
+
+        // Build the structured command.
+        size_t bodyStart = tokens[posTo + 2].offset;
+        out.append("%M 1 ");
+        out.append(destination, destinationLength);
+        out.append(" ", 1);
+        out.append(text + bodyStart, scratch.normalizedLength - bodyStart);
+    }
+    else if (intent == INTENT_STATUS)
+    {
+        out.append("%S");
+    }
+    else if (intent == INTENT_EXIT)
+    {
+        out.append("%E");
+    }
+    else
+    {
+        out.append("Error: Unrecognized command. Try 'list clients', 'broadcast <message>', 'send message to <destination> <message>', 'status', or 'exit'.");
+    }
+}
+
+void NLPModel::continuePendingCommand(DialogueSession &session, const NLPScratch &scratch,
+                                      const SpellDictionary *knownHandles, ResponseWriter &out) const
+{
+    // The normalized input is already trimmed.
+    const char *input = scratch.normalized.data();
+    size_t inputLength = scratch.normalizedLength;
+
+    // When awaiting destination, treat new input as the destination handle.
+    if (session.state == DialogueSession::AwaitingDestination)
+    {
+        if (inputLength == 0)
+        {
+            out.append("Destination cannot be empty. Please specify a valid handle.");
+            return;
+        }
+        const char *destination = input;
+        size_t destinationLength = inputLength;
+        correctDestination(knownHandles, &destination, &destinationLength);
+        session.destination.assign(destination, destinationLength);
+        session.state = DialogueSession::AwaitingMessage;
+        out.append("Destination set to '");
+        out.append(session.destination);
+        out.append("'. Now, please provide the message text.");
+        return;
+    }
+
+    // When awaiting message text, treat new input as the message text.
+    if (session.state == DialogueSession::AwaitingMessage)
+    {
+        if (inputLength == 0)
+        {
+            out.append("Message text cannot be empty. Please provide the text for your message.");
+            return;
+        }
+
+        // Build the full structured command.
+        out.append("%M 1 ");
+        out.append(session.destination);
+        out.append(" ", 1);
+        out.append(input, inputLength);
+        session.reset();
+        return;
+    }
+
+    // If state is somehow invalid, reset.
+    session.reset();
+
+    out.append("Error: Unable to process pending command. Please try again.");
+}
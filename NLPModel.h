@@ -0,0 +1,150 @@
+#ifndef NLP_MODEL_H
+#define NLP_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IntentClassifier.h"
+#include "IntentModel.h"
+#include "ResponseCache.h"
+#include "SpellDictionary.h"
+
+using namespace std;
+
+// Conversation state of one dialogue: all that has to survive between the
+// messages of a multi-turn command. Everything else lives in the shared model.
+struct DialogueSession
+{
+    enum State : uint8_t
+    {
+        Idle,
+        AwaitingDestination,
+        AwaitingMessage
+    };
+
+    State state = Idle;
+    string destination; // Destination handle of a pending send_message.
+
+    void reset()
+    {
+        state = Idle;
+        destination.clear();
+    }
+};
+
+// One message of an NLPModel::processBatch call.
+struct NLPBatchItem
+{
+    DialogueSession *session; // Dialogue the message belongs to.
+    const char *message;
+    size_t length;
+    string response; // Filled in by processBatch.
+};
+
+class WorkerPool;
+
+// Per-thread working memory of NLPModel (normalized text and token spans).
+struct NLPScratch;
+
+// Immutable NLP model: keyword (or trained) classifier, spelling vocabulary and the rules
+// that turn a message into a structured command or a clarifying prompt.
+//
+// All const methods are thread-safe, so one model can be shared by any number
+// of threads and sessions; per-call working memory is thread-local and the
+// only per-dialogue state is the caller's DialogueSession.
+//
+// Answers on the Idle path depend only on the normalized text, so each thread
+// memoizes them in a ResponseCache: a repeated phrasing costs one normalize
+// pass and one hash probe.
+class NLPModel
+{
+public:
+    // A model with the intent keywords only (no fuzzy keyword matching).
+    NLPModel();
+
+    // Loads a word list ("word [frequency]" per line) and enables fuzzy
+    // correction of misspelled command words against it. Only call this
+    // before the model is shared.
+    bool loadDictionary(const string &path);
+
+    // Maps a naive-Bayes intent model written by nlptrain; from then on it,
+    // not the keyword counts, decides the intent of a message (the keyword
+    // scan still locates the command arguments). Only call this before the
+    // model is shared.
+    bool loadIntentClassifier(const string &path);
+
+    // The process-wide default model.
+    static shared_ptr<const NLPModel> shared();
+
+    // A new model with the word list at path loaded; nullptr if it cannot be read.
+    static shared_ptr<const NLPModel> createWithDictionary(const string &path);
+
+    // A new model with the word list and/or intent model loaded (an empty
+    // path skips it, two empty paths give shared()); nullptr if either
+    // cannot be loaded.
+    static shared_ptr<const NLPModel> create(const string &dictionaryPath, const string &classifierPath);
+
+    // Lowercases, spell-corrects and splits message exactly as processMessage
+    // does, so nlptrain trains on the same tokens the classifier will see.
+    void tokenize(const char *message, size_t length, string &normalized, vector<TokenSpan> &tokens) const;
+
+    // Processes one message of session and writes the NUL-terminated response
+    // into out, returning its untruncated length (like snprintf). Destinations
+    // are corrected against knownHandles when given.
+    size_t processMessage(DialogueSession &session, const char *message, size_t length,
+                          char *out, size_t outSize, const SpellDictionary *knownHandles = nullptr) const;
+
+    // processMessage() for every item, spread over the threads of pool. Each
+    // thread reuses its own scratch buffers and response cache. No session
+    // may appear twice in one batch (its messages must be processed in
+    // order, so send them in consecutive batches).
+    void processBatch(NLPBatchItem *items, size_t count, WorkerPool &pool,
+                      const SpellDictionary *knownHandles = nullptr) const;
+
+    // Buffer size that always fits the response to a message of inputLength
+    // bytes in the session's current state.
+    size_t maxResponseSize(const DialogueSession &session, size_t inputLength) const;
+
+    // Entries in the calling thread's response cache (default
+    // ResponseCache::DEFAULT_CAPACITY); 0 disables caching on this thread.
+    static void setThreadCacheCapacity(size_t entries);
+
+    // Hit-rate counters of the calling thread's response cache.
+    static ResponseCache::Stats threadCacheStats();
+
+private:
+    // Bounded writer over the caller's output buffer.
+    struct ResponseWriter;
+
+    // Lowercases, tokenizes and spell-corrects the message in one pass.
+    void normalize(const char *message, size_t length, NLPScratch &scratch) const;
+
+    // Recognizes the intent of the normalized tokens and locates the command anchors.
+    IntentScan recognizeIntent(const NLPScratch &scratch) const;
+
+    // Generates a structured command or clarifying prompt based on the recognized intent.
+    void generateResponse(const IntentScan &scan, DialogueSession &session, const NLPScratch &scratch,
+                          const SpellDictionary *knownHandles, ResponseWriter &out) const;
+
+    // Continues a pending command using the normalized input.
+    void continuePendingCommand(DialogueSession &session, const NLPScratch &scratch,
+                                const SpellDictionary *knownHandles, ResponseWriter &out) const;
+
+    // Replaces *handle/*length with the known handle it is a misspelling of, if any.
+    static void correctDestination(const SpellDictionary *knownHandles, const char **handle, size_t *length);
+
+    // Command words plus any loaded word list.
+    SpellDictionary vocabulary;
+    bool fuzzyKeywords;
+
+    // Optional trained intent model (see loadIntentClassifier).
+    IntentClassifier classifier;
+
+    // Distinguishes this model (and its dictionary) in the per-thread caches.
+    uint64_t cacheId;
+};
+
+#endif // NLP_MODEL_H
@@ -6,31 +6,24 @@
 #include <cctype>
 #include <sstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <map>
 
+#include "NLPModel.h"
+#include "SpellDictionary.h"
+
 using namespace std;
 
+// One dialogue over a shared NLPModel: the session state plus the handles
+// this client knows about. Cheap to create; the model itself is shared by
+// every processor that uses the same word list.
 class NLPProcessor
 {
 public:
-    // A simple enumeration for the dialogue state.
-    enum DialogueState
-    {
-        Idle,
-        AwaitingDestination,
-        AwaitingMessage
-    };
-
-    // A structure to hold a pending command (only send_message is handled here).
-    struct PendingCommand
-    {
-        string commandType; // For now, only "send_message" is used.
-        string destination; // Destination handle (if provided).
-        string messageText; // Message text (if provided).
-    };
-
+    // Uses the process-wide default model.
     NLPProcessor();
+    explicit NLPProcessor(shared_ptr<const NLPModel> model);
     ~NLPProcessor();
 
     // Processes an incoming message and returns either:
@@ -38,31 +31,33 @@ public:
     // - A clarifying prompt if the input is incomplete
     string processMessage(const string &message);
 
-private:
-    // Preprocesses the input (e.g., converts to lowercase, trims, tokenizes).
-    string preprocess(const string &message);
+    // Same as above, but writes the NUL-terminated response into out and
+    // returns its length. If out is too small the response is truncated and
+    // the full length is returned (like snprintf).
+    size_t processMessage(const char *message, size_t length, char *out, size_t outSize);
 
-    // Corrects common spelling mistakes and performs additional normalization.
-    string correctSpelling(const string &message);
+    // Buffer size that always fits the response to a message of inputLength bytes
+    // in the current dialogue state.
+    size_t maxResponseSize(size_t inputLength) const;
 
-    // Recognizes the intent based on the preprocessed (and spell-corrected) message.
-    // Now this function delegates to our ML-style classifier.
-    string recognizeIntent(const string &message);
+    // Switches to a model with the word list at path loaded, enabling fuzzy
+    // correction of misspelled command words. Without a full word list,
+    // ordinary words ("buy", "quiet") would be "corrected" into commands.
+    bool loadDictionary(const string &path);
 
-    // Our new ML-style function that classifies user intent.
-    string classifyIntent(const string &message);
+    // Replaces the handles that destinations are corrected against (e.g. the
+    // result of %L). A destination that is not a known handle but is one edit
+    // away from exactly one of them is replaced by it.
+    void setKnownHandles(const vector<string> &handles);
+    void addKnownHandle(const string &handle);
 
-    // Generates a structured command or clarifying prompt based on the recognized intent.
-    string generateResponse(const string &intent, const string &message);
+    const DialogueSession &getSession() const { return session; }
+    const shared_ptr<const NLPModel> &getModel() const { return model; }
 
-    // Continues a pending command using new input.
-    string continuePendingCommand(const string &newInput);
-
-    // Resets the pending command and dialogue state.
-    void resetPendingCommand();
-
-    DialogueState currentState;
-    PendingCommand pendingCommand;
+private:
+    shared_ptr<const NLPModel> model;
+    DialogueSession session;
+    SpellDictionary knownHandles;
 };
 
-#endif // NLPPROCESSOR_H
\ No newline at end of file
+#endif // NLPPROCESSOR_H
@@ -0,0 +1,130 @@
+#include "NLPWorker.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include <poll.h>
+
+const size_t NLPWorker::DEFAULT_QUEUE_CAPACITY;
+
+NLPWorker::NLPWorker(shared_ptr<const NLPModel> model, size_t queueCapacity)
+    : nlp(model), requests(queueCapacity), results(queueCapacity), pending(0)
+{
+}
+
+NLPWorker::~NLPWorker()
+{
+    stop();
+}
+
+bool NLPWorker::start()
+{
+    if (worker.joinable())
+        return true;
+    if (!requestsReady.open() || !resultsReady.open())
+        return false;
+    worker = thread(&NLPWorker::workerLoop, this);
+    return true;
+}
+
+void NLPWorker::stop()
+{
+    if (!worker.joinable())
+        return;
+
+    // The stop request does not count towards pending, so it may have to
+    // wait for the worker to make room.
+    Request request;
+    request.kind = REQUEST_STOP;
+    while (!requests.tryPush(request))
+        this_thread::yield();
+    requestsReady.notify();
+    worker.join();
+}
+
+bool NLPWorker::push(Request &request)
+{
+    if (pending >= requests.capacity() || !requests.tryPush(request))
+        return false;
+    requestsReady.notify();
+    return true;
+}
+
+bool NLPWorker::submit(const string &line)
+{
+    Request request;
+    request.kind = REQUEST_TRANSLATE;
+    request.text = line;
+    if (!push(request))
+        return false;
+    pending++;
+    return true;
+}
+
+bool NLPWorker::submitPassthrough(const string &line)
+{
+    Request request;
+    request.kind = REQUEST_PASSTHROUGH;
+    request.text = line;
+    if (!push(request))
+        return false;
+    pending++;
+    return true;
+}
+
+bool NLPWorker::setKnownHandles(const vector<string> &handles)
+{
+    Request request;
+    request.kind = REQUEST_SET_HANDLES;
+    request.handles = handles;
+    return push(request);
+}
+
+bool NLPWorker::poll(Result &result)
+{
+    resultsReady.drain();
+    if (!results.tryPop(result))
+        return false;
+    pending--;
+    return true;
+}
+
+void NLPWorker::workerLoop()
+{
+    struct pollfd wakeup;
+    wakeup.fd = requestsReady.getFd();
+    wakeup.events = POLLIN;
+
+    for (;;)
+    {
+        // Drain before checking the queue, so a push after the check still wakes us.
+        requestsReady.drain();
+
+        Request request;
+        while (requests.tryPop(request))
+        {
+            if (request.kind == REQUEST_STOP)
+                return;
+            if (request.kind == REQUEST_SET_HANDLES)
+            {
+                nlp.setKnownHandles(request.handles);
+                continue;
+            }
+
+            Result result;
+            result.translated = (request.kind == REQUEST_TRANSLATE);
+            result.output = result.translated ? nlp.processMessage(request.text) : request.text;
+            result.input = std::move(request.text);
+
+            // Cannot fail: the I/O thread keeps pending within the capacity.
+            results.tryPush(result);
+            resultsReady.notify();
+        }
+
+        if (::poll(&wakeup, 1, -1) < 0 && errno != EINTR)
+        {
+            perror("poll (NLP worker)");
+            return;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef NLP_WORKER_H
+#define NLP_WORKER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NLPProcessor.h"
+#include "SPSCQueue.h"
+#include "WakeupFd.h"
+
+using namespace std;
+
+// Runs an NLPProcessor on its own thread so that an I/O loop never waits for
+// classification.
+//
+// The I/O thread submits lines (and known-handle updates) through one SPSC
+// queue and collects the results from another; each direction has a WakeupFd,
+// and the result one goes into the I/O loop's poll set. Requests are handled
+// strictly in order, so the dialogue state sees the same sequence it would
+// inline. All public methods except the constructor and destructor must be
+// called from the same (I/O) thread.
+class NLPWorker
+{
+public:
+    struct Result
+    {
+        string input;
+        string output;   // Structured command or prompt; input itself when not translated.
+        bool translated; // False for lines submitted with submitPassthrough().
+    };
+
+    explicit NLPWorker(shared_ptr<const NLPModel> model, size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+    ~NLPWorker();
+
+    // Starts the worker thread. Returns false if the wakeup descriptors cannot be created.
+    bool start();
+
+    // Stops and joins the worker thread; pending requests are dropped.
+    void stop();
+
+    // Descriptor to add to the poll set; readable when results are ready.
+    int getResultFd() const { return resultsReady.getFd(); }
+
+    // Queues a natural-language line. Returns false when the queue is full.
+    bool submit(const string &line);
+
+    // Queues a line that comes back unchanged behind the lines already
+    // queued, so a strict command typed after a natural-language one still
+    // runs after it. Returns false when the queue is full.
+    bool submitPassthrough(const string &line);
+
+    // Replaces the handles destinations are corrected against, in order
+    // with the lines around it. Returns false when the queue is full.
+    bool setKnownHandles(const vector<string> &handles);
+
+    // Takes the next finished result; false when there is none yet.
+    bool poll(Result &result);
+
+    // Lines submitted whose results have not been taken yet.
+    size_t getPending() const { return pending; }
+
+    static const size_t DEFAULT_QUEUE_CAPACITY = 256;
+
+private:
+    enum RequestKind
+    {
+        REQUEST_TRANSLATE,
+        REQUEST_PASSTHROUGH,
+        REQUEST_SET_HANDLES,
+        REQUEST_STOP
+    };
+
+    struct Request
+    {
+        RequestKind kind;
+        string text;
+        vector<string> handles;
+    };
+
+    NLPWorker(const NLPWorker &);
+    NLPWorker &operator=(const NLPWorker &);
+
+    bool push(Request &request);
+    void workerLoop();
+
+    NLPProcessor nlp; // Only touched by the worker thread once started.
+    SPSCQueue<Request> requests;
+    SPSCQueue<Result> results;
+    WakeupFd requestsReady;
+    WakeupFd resultsReady;
+    thread worker;
+
+    // Requests in flight plus unclaimed results; kept at or below the queue
+    // capacity so the worker never finds the result queue full.
+    size_t pending;
+};
+
+#endif // NLP_WORKER_H
@@ -0,0 +1,393 @@
+#ifndef PDU_SCHEMA_H
+#define PDU_SCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+
+#include "chatFlags.h"
+
+using namespace std;
+
+// Typed, zero-copy access to chat PDU payloads.
+//
+// Every payload is built from a handful of field kinds: a handle
+// ([1 byte length][bytes], no terminator), a list of handles (a 1-byte count
+// followed by that many handles), a 4-byte count in network order, and
+// trailing text that runs to a '\0' or the end of the payload. Each flag's
+// layout is written once below as a schema struct. Its parse() checks every
+// length against the received bytes and leaves the fields pointing into
+// them; its build() writes the fields straight into the caller's outbound
+// buffer. A schema's smallest encoding must match the flag's minLength in
+// chatFlags.h, which the static_asserts at the end check.
+
+// -----------------------------------------------------------------------------
+// Field views. They point into the payload they were parsed from and are only
+// valid as long as it is.
+
+struct PDU_Handle
+{
+    const char *data;
+    uint8_t length;
+
+    PDU_Handle() : data(nullptr), length(0) {}
+    PDU_Handle(const char *data, uint8_t length) : data(data), length(length) {}
+
+    string str() const { return string(data, length); }
+};
+
+struct PDU_Text
+{
+    const char *data;
+    size_t length;   // Up to, not including, the terminator.
+    bool terminated; // False when the payload ended without a '\0'.
+
+    PDU_Text() : data(nullptr), length(0), terminated(false) {}
+
+    string str() const { return string(data, length); }
+};
+
+// Handles already validated by PDU_Cursor::readHandleList(), so iterating
+// needs no further bounds checks.
+class PDU_HandleList
+{
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator(const uint8_t *position, size_t left) : position(position), left(left) {}
+
+        PDU_Handle operator*() const { return PDU_Handle(reinterpret_cast<const char *>(position + 1), position[0]); }
+        const_iterator &operator++()
+        {
+            position += 1 + position[0];
+            left--;
+            return *this;
+        }
+        bool operator!=(const const_iterator &other) const { return left != other.left; }
+
+    private:
+        const uint8_t *position;
+        size_t left;
+    };
+
+    PDU_HandleList() : first(nullptr), count(0) {}
+    PDU_HandleList(const uint8_t *first, uint8_t count) : first(first), count(count) {}
+
+    size_t size() const { return count; }
+    const_iterator begin() const { return const_iterator(first, count); }
+    const_iterator end() const { return const_iterator(nullptr, 0); }
+
+private:
+    const uint8_t *first;
+    uint8_t count;
+};
+
+// -----------------------------------------------------------------------------
+// Reads fields from a received payload. A read past the end returns an empty
+// field and leaves the cursor failed, so a parse only checks ok() once.
+class PDU_Cursor
+{
+public:
+    PDU_Cursor(const uint8_t *payload, size_t length) : payload(payload), length(length), offset(0), failed(false) {}
+
+    bool ok() const { return !failed; }
+    size_t remaining() const { return failed ? 0 : length - offset; }
+
+    uint8_t readByte()
+    {
+        if (remaining() < 1)
+        {
+            failed = true;
+            return 0;
+        }
+        return payload[offset++];
+    }
+
+    uint32_t readUint32()
+    {
+        if (remaining() < 4)
+        {
+            failed = true;
+            return 0;
+        }
+        uint32_t value;
+        memcpy(&value, payload + offset, sizeof(value));
+        offset += sizeof(value);
+        return ntohl(value);
+    }
+
+    PDU_Handle readHandle()
+    {
+        uint8_t handleLength = readByte();
+        if (!ok() || remaining() < handleLength)
+        {
+            failed = true;
+            return PDU_Handle();
+        }
+        PDU_Handle handle(reinterpret_cast<const char *>(payload + offset), handleLength);
+        offset += handleLength;
+        return handle;
+    }
+
+    PDU_HandleList readHandleList()
+    {
+        uint8_t count = readByte();
+        const uint8_t *first = payload + offset;
+        for (int i = 0; i < count && ok(); i++)
+            readHandle();
+        return ok() ? PDU_HandleList(first, count) : PDU_HandleList();
+    }
+
+    // Takes the rest of the payload, which must hold at least one byte.
+    PDU_Text readText()
+    {
+        PDU_Text text;
+        if (remaining() < 1)
+        {
+            failed = true;
+            return text;
+        }
+        text.data = reinterpret_cast<const char *>(payload + offset);
+        const void *terminator = memchr(text.data, '\0', length - offset);
+        text.terminated = (terminator != nullptr);
+        text.length = text.terminated ? static_cast<const char *>(terminator) - text.data : length - offset;
+        offset = length;
+        return text;
+    }
+
+private:
+    const uint8_t *payload;
+    size_t length;
+    size_t offset;
+    bool failed;
+};
+
+// Writes fields into an outbound buffer. A write that does not fit (or a
+// handle longer than 255 bytes) is dropped and leaves the builder failed;
+// finish() then returns 0.
+class PDU_Builder
+{
+public:
+    PDU_Builder(uint8_t *buffer, size_t capacity) : buffer(buffer), capacity(capacity), offset(0), failed(false) {}
+
+    bool ok() const { return !failed; }
+
+    // Payload length written, or 0 if anything failed to fit.
+    size_t finish() const { return failed ? 0 : offset; }
+
+    void writeByte(uint8_t value)
+    {
+        if (reserve(1))
+            buffer[offset++] = value;
+    }
+
+    void writeUint32(uint32_t value)
+    {
+        if (!reserve(4))
+            return;
+        value = htonl(value);
+        memcpy(buffer + offset, &value, sizeof(value));
+        offset += sizeof(value);
+    }
+
+    void writeHandle(const char *data, size_t length)
+    {
+        if (length > UINT8_MAX || !reserve(1 + length))
+        {
+            failed = true;
+            return;
+        }
+        buffer[offset++] = static_cast<uint8_t>(length);
+        memcpy(buffer + offset, data, length);
+        offset += length;
+    }
+    void writeHandle(const char *handle) { writeHandle(handle, strlen(handle)); }
+    void writeHandle(const string &handle) { writeHandle(handle.data(), handle.size()); }
+    void writeHandle(const string *handle) { writeHandle(handle->data(), handle->size()); }
+    void writeHandle(const PDU_Handle &handle) { writeHandle(handle.data, handle.length); }
+
+    // Writes the text followed by its '\0'.
+    void writeText(const char *data, size_t length)
+    {
+        if (!reserve(length + 1))
+            return;
+        memcpy(buffer + offset, data, length);
+        offset += length;
+        buffer[offset++] = '\0';
+    }
+
+private:
+    bool reserve(size_t bytes)
+    {
+        if (failed || capacity - offset < bytes)
+            failed = true;
+        return !failed;
+    }
+
+    uint8_t *buffer;
+    size_t capacity;
+    size_t offset;
+    bool failed;
+};
+
+// -----------------------------------------------------------------------------
+// Schemas. parse() returns false when the payload does not match the layout.
+// build() returns the payload length written, or 0 when it does not fit.
+
+// [handle]: registration, unknown destination and one handle of a list.
+template <int Flag>
+struct HandlePDU
+{
+    static const int FLAG = Flag;
+    static const int MIN_LENGTH = 1;
+
+    PDU_Handle handle;
+
+    bool parse(const uint8_t *payload, size_t length)
+    {
+        PDU_Cursor cursor(payload, length);
+        handle = cursor.readHandle();
+        return cursor.ok();
+    }
+
+    template <typename Handle>
+    static size_t build(uint8_t *buffer, size_t capacity, const Handle &handle)
+    {
+        PDU_Builder out(buffer, capacity);
+        out.writeHandle(handle);
+        return out.finish();
+    }
+};
+
+typedef HandlePDU<CLIENT_INIT_PACKET_TO_SERVER> RegistrationPDU;
+typedef HandlePDU<ERROR_INVALID_DESTINATION> InvalidDestinationPDU;
+typedef HandlePDU<LIST_RESPONSE_HANDLE> ListHandlePDU;
+
+// [sender][text]
+struct BroadcastPDU
+{
+    static const int FLAG = BROADCAST_PACKET;
+    static const int MIN_LENGTH = 2;
+
+    PDU_Handle sender;
+    PDU_Text text;
+
+    bool parse(const uint8_t *payload, size_t length)
+    {
+        PDU_Cursor cursor(payload, length);
+        sender = cursor.readHandle();
+        text = cursor.readText();
+        return cursor.ok();
+    }
+
+    static size_t build(uint8_t *buffer, size_t capacity, const string &sender, const char *text, size_t textLength)
+    {
+        PDU_Builder out(buffer, capacity);
+        out.writeHandle(sender);
+        out.writeText(text, textLength);
+        return out.finish();
+    }
+
+    // Everything before the text, for senders that gather the text and its
+    // '\0' from elsewhere (see PDU_Send_And_Recv::sendv).
+    static size_t buildHeader(uint8_t *buffer, size_t capacity, const string &sender)
+    {
+        PDU_Builder out(buffer, capacity);
+        out.writeHandle(sender);
+        return out.finish();
+    }
+};
+
+// [sender][destination count]([destination])*[text]
+struct MessagePDU
+{
+    static const int FLAG = MESSAGE_PACKET;
+    static const int MIN_LENGTH = 3;
+
+    PDU_Handle sender;
+    PDU_HandleList destinations;
+    PDU_Text text;
+
+    bool parse(const uint8_t *payload, size_t length)
+    {
+        PDU_Cursor cursor(payload, length);
+        sender = cursor.readHandle();
+        destinations = cursor.readHandleList();
+        text = cursor.readText();
+        return cursor.ok();
+    }
+
+    // Destinations are [first, last); each element may be anything
+    // PDU_Builder::writeHandle() accepts.
+    template <typename HandleIterator>
+    static size_t build(uint8_t *buffer, size_t capacity, const string &sender,
+                        HandleIterator first, HandleIterator last, const char *text, size_t textLength)
+    {
+        size_t headerLength = buildHeader(buffer, capacity, sender, first, last);
+        if (headerLength == 0)
+            return 0;
+        PDU_Builder out(buffer + headerLength, capacity - headerLength);
+        out.writeText(text, textLength);
+        return out.ok() ? headerLength + out.finish() : 0;
+    }
+
+    // The routing header (sender and destinations) alone, so it can be built
+    // once and sent ahead of every text segment.
+    template <typename HandleIterator>
+    static size_t buildHeader(uint8_t *buffer, size_t capacity, const string &sender,
+                              HandleIterator first, HandleIterator last)
+    {
+        PDU_Builder out(buffer, capacity);
+        out.writeHandle(sender);
+        size_t count = 0;
+        for (HandleIterator it = first; it != last; ++it)
+            count++;
+        if (count > UINT8_MAX)
+            return 0;
+        out.writeByte(static_cast<uint8_t>(count));
+        for (HandleIterator it = first; it != last; ++it)
+            out.writeHandle(*it);
+        return out.finish();
+    }
+};
+
+// [4-byte handle count]
+struct ListCountPDU
+{
+    static const int FLAG = LIST_RESPONSE_NUM;
+    static const int MIN_LENGTH = 4;
+
+    uint32_t count;
+
+    bool parse(const uint8_t *payload, size_t length)
+    {
+        PDU_Cursor cursor(payload, length);
+        count = cursor.readUint32();
+        return cursor.ok();
+    }
+
+    static size_t build(uint8_t *buffer, size_t capacity, uint32_t count)
+    {
+        PDU_Builder out(buffer, capacity);
+        out.writeUint32(count);
+        return out.finish();
+    }
+};
+
+// The smallest payload each schema parses (and builds) is exactly what
+// checkChatFlag() lets through for its flag.
+#define PDU_SCHEMA_MATCHES_FLAG_TABLE(Schema) \
+    static_assert(Schema::MIN_LENGTH == chatFlagTable[Schema::FLAG].minLength, #Schema " disagrees with CHAT_FLAGS minLength")
+PDU_SCHEMA_MATCHES_FLAG_TABLE(RegistrationPDU);
+PDU_SCHEMA_MATCHES_FLAG_TABLE(InvalidDestinationPDU);
+PDU_SCHEMA_MATCHES_FLAG_TABLE(ListHandlePDU);
+PDU_SCHEMA_MATCHES_FLAG_TABLE(BroadcastPDU);
+PDU_SCHEMA_MATCHES_FLAG_TABLE(MessagePDU);
+PDU_SCHEMA_MATCHES_FLAG_TABLE(ListCountPDU);
+#undef PDU_SCHEMA_MATCHES_FLAG_TABLE
+
+#endif // PDU_SCHEMA_H
@@ -2,31 +2,53 @@
 
 #include <iostream>
 #include <iomanip>
-#include <sstream>
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
+#include <climits>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
 using namespace std;
 
-// Helper function to dump raw bytes in hex as a string.
-static std::string hexDump(const uint8_t *buffer, int length)
+const int PDU_Send_And_Recv::PDU_MAX_SEND_PARTS;
+
+// Helper function to write raw bytes in hex to a stream, without building a string.
+static void writeHex(ostream &out, const uint8_t *buffer, int length)
 {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
+    char oldFill = out.fill('0');
+    ios::fmtflags oldFlags = out.flags();
+    out << std::hex;
     for (int i = 0; i < length; i++) {
-        oss << std::setw(2) << static_cast<int>(buffer[i]) << " ";
+        out << std::setw(2) << static_cast<int>(buffer[i]) << " ";
     }
-    return oss.str();
+    out.flags(oldFlags);
+    out.fill(oldFill);
 }
 
 // Helper function to print raw bytes in hex directly.
 void debugHexDump(const uint8_t *buffer, int length)
 {
-    cout << hexDump(buffer, length) << endl;
+    writeHex(cout, buffer, length);
+    cout << endl;
+}
+
+// Logs one sent PDU; payload is the concatenation of parts.
+static void logSentPDU(uint16_t totalLength, int flag, const struct iovec *parts, int count)
+{
+    cout << "PDU sent:" << endl;
+    cout << "PDU Size: " << totalLength << " Flag: " << flag << " Payload: ";
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(parts[i].iov_base);
+        for (size_t j = 0; j < parts[i].iov_len; j++)
+        {
+            cout << hex << (int)bytes[j] << " ";
+        }
+    }
+    cout << "\n\n";
 }
 
 // Receives a PDU: first reads the header, then the payload.
@@ -92,9 +114,34 @@ int PDU_Send_And_Recv::recvBuf(int clientSocket, uint8_t *dataBuffer, int *flag)
     return payloadBytes;
 }
 
-// Sends a PDU: constructs a header, prepends it to the payload, and sends the complete buffer.
+// Sends a PDU whose payload is one contiguous buffer.
 int PDU_Send_And_Recv::sendBuf(int socketNumber, uint8_t *dataBuffer, uint16_t lengthOfData, int flagValue)
 {
+    struct iovec payload;
+    payload.iov_base = dataBuffer;
+    payload.iov_len = lengthOfData;
+    return sendv(socketNumber, flagValue, &payload, lengthOfData > 0 ? 1 : 0);
+}
+
+// Sends a PDU: the header and every payload part are gathered by sendmsg(),
+// resuming after a partial send until the whole PDU is out.
+int PDU_Send_And_Recv::sendv(int socketNumber, int flagValue, const struct iovec *payloadParts, int partCount)
+{
+    if (partCount < 0 || partCount > PDU_MAX_SEND_PARTS)
+    {
+        cerr << "[ERROR] sendv: " << partCount << " payload parts (at most " << PDU_MAX_SEND_PARTS << ")" << endl;
+        return -1;
+    }
+
+    size_t lengthOfData = 0;
+    for (int i = 0; i < partCount; i++)
+        lengthOfData += payloadParts[i].iov_len;
+    if (lengthOfData > UINT16_MAX - SIZE_CHAT_HEADER)
+    {
+        cerr << "[ERROR] sendv: payload of " << lengthOfData << " bytes does not fit in a PDU" << endl;
+        return -1;
+    }
+
     // Total PDU length = header size + payload length.
     uint16_t totalLength = lengthOfData + SIZE_CHAT_HEADER;
 
@@ -103,29 +150,51 @@ int PDU_Send_And_Recv::sendBuf(int socketNumber, uint8_t *dataBuffer, uint16_t l
     header.PDU_Length = htons(totalLength);
     header.flag = static_cast<uint8_t>(flagValue);
 
-    // Create a buffer to hold the complete PDU.
-    uint8_t PDU_Buffer[totalLength];
-    memcpy(PDU_Buffer, &header, SIZE_CHAT_HEADER);
-    if (lengthOfData > 0)
-    {
-        memcpy(PDU_Buffer + SIZE_CHAT_HEADER, dataBuffer, lengthOfData);
-    }
+    // The header goes first; the caller's parts follow it unchanged.
+    struct iovec parts[1 + PDU_MAX_SEND_PARTS];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = SIZE_CHAT_HEADER;
+    int count = 1;
+    for (int i = 0; i < partCount; i++)
+        if (payloadParts[i].iov_len > 0)
+            parts[count++] = payloadParts[i];
 
-    // Debug: Dump the assembled header and payload.
+    // Debug: Dump the header and payload.
     cout << "[DEBUG] Assembled complete PDU:" << endl;
     cout << "[DEBUG] Total PDU size: " << totalLength << " bytes" << endl;
     cout << "[DEBUG] Header bytes: ";
     debugHexDump((uint8_t *)&header, SIZE_CHAT_HEADER);
     if (lengthOfData > 0)
     {
-        cout << "[DEBUG] Payload bytes: " << hexDump(dataBuffer, lengthOfData) << endl;
+        cout << "[DEBUG] Payload bytes: ";
+        for (int i = 1; i < count; i++)
+            writeHex(cout, static_cast<const uint8_t *>(parts[i].iov_base), parts[i].iov_len);
+        cout << endl;
     }
 
-    // Loop to ensure the entire PDU is sent.
-    int totalSent = 0;
+    int totalSent = sendAll(socketNumber, parts, count, totalLength);
+
+    // Final logging.
+    logSentPDU(totalLength, header.flag, payloadParts, partCount);
+
+    return totalSent;
+}
+
+// Sends every byte of parts, resuming after a partial send. Exits on a socket
+// error, like the rest of this class.
+int PDU_Send_And_Recv::sendAll(int socketNumber, struct iovec *parts, int count, size_t totalLength)
+{
+    size_t totalSent = 0;
+    struct iovec *next = parts;
     while (totalSent < totalLength)
     {
-        int bytesSent = send(socketNumber, PDU_Buffer + totalSent, totalLength - totalSent, 0);
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = next;
+        message.msg_iovlen = count - (next - parts);
+
+        ssize_t bytesSent = sendmsg(socketNumber, &message, 0);
+        sendCalls++;
         if (bytesSent < 0)
         {
             perror("send error");
@@ -139,16 +208,19 @@ int PDU_Send_And_Recv::sendBuf(int socketNumber, uint8_t *dataBuffer, uint16_t l
         totalSent += bytesSent;
         cout << "[DEBUG] sendBuf: Sent " << bytesSent << " bytes, total sent: " 
              << totalSent << " of " << totalLength << " bytes" << endl;
-    }
 
-    // Final logging.
-    cout << "PDU sent:" << endl;
-    cout << "PDU Size: " << totalLength << " Flag: " << (int)header.flag << " Payload: ";
-    for (int i = 0; i < lengthOfData; i++)
-    {
-        cout << hex << (int)dataBuffer[i] << " ";
+        // Skip the parts that went out completely and trim the one cut short.
+        size_t advance = bytesSent;
+        while (next < parts + count && advance >= next->iov_len)
+        {
+            advance -= next->iov_len;
+            next++;
+        }
+        if (advance > 0)
+        {
+            next->iov_base = static_cast<uint8_t *>(next->iov_base) + advance;
+            next->iov_len -= advance;
+        }
     }
-    cout << "\n\n";
-
-    return totalSent;
+    return static_cast<int>(totalSent);
 }
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 
+#include <sys/uio.h>
+
 using namespace std; 
 
 // The macro “#define VALID_ZERO_PAYLOAD -2” is used as a special return value from 
@@ -52,6 +54,8 @@ static_assert(SIZE_CHAT_HEADER == 3, "SIZE_CHAT_HEADER must equal 3 bytes. Pleas
 
 class PDU_Send_And_Recv {
     public:
+        PDU_Send_And_Recv() : sendCalls(0) {}
+
         // Receives a PDU from clientSocket. 
         // The payload (excluding header) is stored in dataBuffer.
         // The flag from the header is output via *flag.
@@ -62,6 +66,23 @@ class PDU_Send_And_Recv {
         // lengthOfData is the number of payload bytes.
         // Returns the total number of bytes sent.
         int sendBuf(int socketNumber, uint8_t *dataBuffer, uint16_t lengthOfData, int flag);
+
+        // Sends one PDU whose payload is the concatenation of the partCount
+        // iovecs in payloadParts (at most PDU_MAX_SEND_PARTS). The header and
+        // the parts go out with sendmsg() without being copied together.
+        // Returns the total number of bytes sent, or -1 if there are too many
+        // parts or they add up to more than a PDU can hold.
+        int sendv(int socketNumber, int flag, const struct iovec *payloadParts, int partCount);
+
+        // sendmsg() calls made by this object, for syscalls-per-message statistics.
+        uint64_t getSendCalls() const { return sendCalls; }
+
+        static const int PDU_MAX_SEND_PARTS = 15;
+
+    private:
+        int sendAll(int socketNumber, struct iovec *parts, int count, size_t totalLength);
+
+        uint64_t sendCalls;
 };
 
 #endif // PDU_SEND_AND_RECV_H
\ No newline at end of file
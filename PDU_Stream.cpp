@@ -0,0 +1,194 @@
+#include "PDU_Stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// Inbound buffer size; one read can drain many PDUs.
+#define STREAM_READ_CHUNK (64 * 1024)
+
+// Most unparsed input held at once; the rest stays in the socket buffer.
+#define STREAM_MAX_BUFFERED (16 * STREAM_READ_CHUNK)
+
+// A closed peer must surface as an error from send(), not kill the process.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// flush() must not wait even on a socket left in blocking mode.
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
+
+PDU_Stream::PDU_Stream()
+    : socketNum(-1), corrupt(false), inbound(STREAM_READ_CHUNK), inStart(0), inEnd(0), outStart(0),
+      reservedStart(0), sendCalls(0), queuedPDUs(0)
+{
+}
+
+bool PDU_Stream::attach(int socket, bool nonBlocking)
+{
+    socketNum = socket;
+    if (!nonBlocking)
+        return true;
+    int flags = fcntl(socketNum, F_GETFL, 0);
+    if (flags < 0 || fcntl(socketNum, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror("fcntl O_NONBLOCK");
+        return false;
+    }
+    return true;
+}
+
+bool PDU_Stream::fill()
+{
+    // Move the partial PDU left over from the last fill to the front.
+    if (inStart > 0)
+    {
+        memmove(inbound.data(), inbound.data() + inStart, inEnd - inStart);
+        inEnd -= inStart;
+        inStart = 0;
+    }
+
+    while (true)
+    {
+        // Hand a full buffer to the caller before reading more.
+        if (inEnd == inbound.size())
+        {
+            if (inbound.size() >= STREAM_MAX_BUFFERED)
+                return true;
+            inbound.resize(inbound.size() + STREAM_READ_CHUNK);
+        }
+
+        ssize_t bytes = recv(socketNum, inbound.data() + inEnd, inbound.size() - inEnd, 0);
+        if (bytes > 0)
+        {
+            inEnd += bytes;
+            continue;
+        }
+        if (bytes == 0)
+            return false;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        perror("recv error on stream");
+        return false;
+    }
+}
+
+bool PDU_Stream::nextPDU(int *flag, const uint8_t **payload, uint16_t *length)
+{
+    if (corrupt || inEnd - inStart < SIZE_CHAT_HEADER)
+        return false;
+
+    PDU_Header header;
+    memcpy(&header, inbound.data() + inStart, SIZE_CHAT_HEADER);
+    uint16_t pduLength = ntohs(header.PDU_Length);
+    if (pduLength < SIZE_CHAT_HEADER)
+    {
+        corrupt = true;
+        return false;
+    }
+    if (inEnd - inStart < pduLength)
+        return false;
+
+    *flag = header.flag;
+    *payload = inbound.data() + inStart + SIZE_CHAT_HEADER;
+    *length = static_cast<uint16_t>(pduLength - SIZE_CHAT_HEADER);
+    inStart += pduLength;
+    return true;
+}
+
+void PDU_Stream::queue(int flag, const uint8_t *payload, uint16_t length)
+{
+    uint8_t *destination = reservePDU(length);
+    if (length > 0)
+        memcpy(destination, payload, length);
+    commitPDU(flag, length);
+}
+
+uint8_t *PDU_Stream::reservePDU(uint16_t maxLength)
+{
+    // Reclaim the sent prefix once it is most of the buffer, or before the
+    // buffer would have to grow, so a stream that never fully drains does
+    // not keep every byte it has sent.
+    size_t needed = outbound.size() + SIZE_CHAT_HEADER + maxLength;
+    if (outStart > 0 && (outStart > outbound.size() / 2 || needed > outbound.capacity()))
+    {
+        outbound.erase(outbound.begin(), outbound.begin() + outStart);
+        outStart = 0;
+    }
+
+    reservedStart = outbound.size();
+    outbound.resize(reservedStart + SIZE_CHAT_HEADER + maxLength);
+    return outbound.data() + reservedStart + SIZE_CHAT_HEADER;
+}
+
+void PDU_Stream::commitPDU(int flag, uint16_t length)
+{
+    if (flag < 0)
+    {
+        outbound.resize(reservedStart);
+        return;
+    }
+
+    PDU_Header header;
+    header.PDU_Length = htons(static_cast<uint16_t>(length + SIZE_CHAT_HEADER));
+    header.flag = static_cast<uint8_t>(flag);
+    memcpy(outbound.data() + reservedStart, &header, SIZE_CHAT_HEADER);
+    outbound.resize(reservedStart + SIZE_CHAT_HEADER + length);
+    queuedPDUs++;
+}
+
+size_t PDU_Stream::queueSegments(int flag, const uint8_t *routingHeader, uint16_t headerLength, const char *text,
+                                 size_t textLength, size_t maxSegment)
+{
+    if (maxSegment == 0 || SIZE_CHAT_HEADER + headerLength + maxSegment + 1 > UINT16_MAX)
+        return 0;
+
+    size_t position = 0;
+    size_t segments = 0;
+    do
+    {
+        size_t segmentLength = min(maxSegment, textLength - position);
+        uint16_t payloadLength = static_cast<uint16_t>(headerLength + segmentLength + 1);
+        uint8_t *payload = reservePDU(payloadLength);
+        memcpy(payload, routingHeader, headerLength);
+        memcpy(payload + headerLength, text + position, segmentLength);
+        payload[headerLength + segmentLength] = '\0';
+        commitPDU(flag, payloadLength);
+        position += segmentLength;
+        segments++;
+    } while (position < textLength);
+    return segments;
+}
+
+bool PDU_Stream::flush()
+{
+    while (outStart < outbound.size())
+    {
+        ssize_t bytes = send(socketNum, outbound.data() + outStart, outbound.size() - outStart, MSG_NOSIGNAL | MSG_DONTWAIT);
+        sendCalls++;
+        if (bytes > 0)
+        {
+            outStart += bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        perror("send error on stream");
+        return false;
+    }
+
+    outbound.clear();
+    outStart = 0;
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef PDU_STREAM_H
+#define PDU_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PDU_Send_And_Recv.h"
+
+using namespace std;
+
+// Non-blocking PDU framing for an event loop.
+//
+// Unlike PDU_Send_And_Recv, which blocks until a whole PDU has been read or
+// written, PDU_Stream reads whatever the socket has into an inbound buffer
+// and hands out every complete PDU in it, and collects outgoing PDUs in an
+// outbound buffer that is written with as few send() calls as the socket
+// allows. A partial PDU simply waits for the next fill().
+class PDU_Stream
+{
+public:
+    PDU_Stream();
+
+    // Uses socketNum for all I/O and switches it to non-blocking mode. A
+    // caller that only queues output and keeps reading the socket with
+    // blocking calls passes nonBlocking = false; flush() never waits either way.
+    bool attach(int socketNum, bool nonBlocking = true);
+    int getSocket() const { return socketNum; }
+
+    // Reads everything currently available. Returns false once the peer has
+    // closed the connection or on a socket error.
+    bool fill();
+
+    // Pops the next complete PDU. payload points into the stream and stays
+    // valid until the next fill(). Returns false when no complete PDU is
+    // buffered or the stream is corrupt (see isCorrupt).
+    bool nextPDU(int *flag, const uint8_t **payload, uint16_t *length);
+
+    // True after a header announced a PDU shorter than its own header.
+    bool isCorrupt() const { return corrupt; }
+
+    // Appends one PDU to the outbound buffer; nothing is sent until flush().
+    void queue(int flag, const uint8_t *payload, uint16_t length);
+
+    // Builds a PDU in place: reservePDU() returns room for up to maxLength
+    // payload bytes at the end of the outbound buffer, and commitPDU() writes
+    // the header for the length actually used. Nothing else may be queued in
+    // between; a negative flag abandons the PDU.
+    uint8_t *reservePDU(uint16_t maxLength);
+    void commitPDU(int flag, uint16_t length);
+
+    // Queues textLength bytes of text as PDUs of at most maxSegment text
+    // bytes, each laid out as [routingHeader][segment]['\0'] (%M/%B); empty
+    // text still queues one PDU. The header is copied into every PDU, since
+    // the caller's copy need not outlive the call. Returns the number of
+    // PDUs queued, or 0 if one would not fit.
+    size_t queueSegments(int flag, const uint8_t *routingHeader, uint16_t headerLength, const char *text,
+                         size_t textLength, size_t maxSegment);
+
+    // Writes as much of the outbound buffer as the socket accepts. Returns
+    // false on a socket error; a full socket buffer is not an error.
+    bool flush();
+
+    bool hasPendingOutput() const { return outStart < outbound.size(); }
+    size_t pendingOutputBytes() const { return outbound.size() - outStart; }
+
+    // Number of send() calls and PDUs queued, for batching statistics.
+    uint64_t getSendCalls() const { return sendCalls; }
+    uint64_t getQueuedPDUs() const { return queuedPDUs; }
+
+private:
+    int socketNum;
+    bool corrupt;
+
+    // Unparsed bytes are inbound[inStart, inEnd).
+    vector<uint8_t> inbound;
+    size_t inStart;
+    size_t inEnd;
+
+    // Unsent bytes are outbound[outStart, end).
+    vector<uint8_t> outbound;
+    size_t outStart;
+    size_t reservedStart; // Header position of the PDU being built.
+
+    uint64_t sendCalls;
+    uint64_t queuedPDUs;
+};
+
+#endif // PDU_STREAM_H
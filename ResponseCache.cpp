@@ -0,0 +1,161 @@
+#include "ResponseCache.h"
+
+// Index slots per entry (load factor <= 0.5 keeps probe sequences short).
+#define CACHE_INDEX_SLACK 2
+
+const size_t ResponseCache::DEFAULT_CAPACITY;
+const int32_t ResponseCache::EMPTY_SLOT;
+
+void ResponseCache::Stats::add(const Stats &other)
+{
+    lookups += other.lookups;
+    hits += other.hits;
+    insertions += other.insertions;
+    evictions += other.evictions;
+}
+
+ResponseCache::ResponseCache(size_t capacity) : capacity(0), used(0), hand(0)
+{
+    setCapacity(capacity);
+}
+
+uint64_t ResponseCache::hashKey(const char *key, size_t length)
+{
+    // FNV-1a, as in IntentModel and SpellDictionary.
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void ResponseCache::setCapacity(size_t newCapacity)
+{
+    capacity = newCapacity;
+    entries.clear();
+    entries.resize(capacity);
+
+    size_t slots = 16;
+    while (slots < capacity * CACHE_INDEX_SLACK)
+        slots *= 2;
+    index.assign(capacity ? slots : 0, EMPTY_SLOT);
+    used = 0;
+    hand = 0;
+}
+
+void ResponseCache::clear()
+{
+    for (size_t i = 0; i < used; i++)
+    {
+        entries[i].key.clear();
+        entries[i].value.clear();
+    }
+    index.assign(index.size(), EMPTY_SLOT);
+    used = 0;
+    hand = 0;
+}
+
+const ResponseCache::Entry *ResponseCache::find(const char *key, size_t length)
+{
+    if (capacity == 0)
+        return nullptr;
+    stats.lookups++;
+
+    uint64_t hash = hashKey(key, length);
+    size_t mask = index.size() - 1;
+    for (size_t position = static_cast<size_t>(hash) & mask; index[position] != EMPTY_SLOT;
+         position = (position + 1) & mask)
+    {
+        Entry &entry = entries[index[position]];
+        if (entry.hash == hash && entry.key.size() == length && entry.key.compare(0, length, key, length) == 0)
+        {
+            entry.referenced = true;
+            stats.hits++;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+size_t ResponseCache::indexPosition(int32_t slot) const
+{
+    size_t mask = index.size() - 1;
+    size_t position = static_cast<size_t>(entries[slot].hash) & mask;
+    while (index[position] != slot)
+        position = (position + 1) & mask;
+    return position;
+}
+
+void ResponseCache::unindex(int32_t slot)
+{
+    size_t mask = index.size() - 1;
+    size_t hole = indexPosition(slot);
+    index[hole] = EMPTY_SLOT;
+
+    // Move back every later entry of the run whose home is at or before the hole.
+    for (size_t position = (hole + 1) & mask; index[position] != EMPTY_SLOT; position = (position + 1) & mask)
+    {
+        size_t home = static_cast<size_t>(entries[index[position]].hash) & mask;
+        if (((position - home) & mask) >= ((position - hole) & mask))
+        {
+            index[hole] = index[position];
+            index[position] = EMPTY_SLOT;
+            hole = position;
+        }
+    }
+}
+
+int32_t ResponseCache::claimSlot()
+{
+    if (used < capacity)
+        return static_cast<int32_t>(used++);
+
+    // Second chance: skip (and clear) entries referenced since the last pass.
+    while (entries[hand].referenced)
+    {
+        entries[hand].referenced = false;
+        hand = (hand + 1) % capacity;
+    }
+    int32_t victim = static_cast<int32_t>(hand);
+    hand = (hand + 1) % capacity;
+
+    unindex(victim);
+    stats.evictions++;
+    return victim;
+}
+
+void ResponseCache::insert(const char *key, size_t keyLength, const char *value, size_t valueLength, uint32_t flags)
+{
+    if (capacity == 0)
+        return;
+
+    uint64_t hash = hashKey(key, keyLength);
+    size_t mask = index.size() - 1;
+    size_t position = static_cast<size_t>(hash) & mask;
+    for (; index[position] != EMPTY_SLOT; position = (position + 1) & mask)
+    {
+        Entry &entry = entries[index[position]];
+        if (entry.hash == hash && entry.key.size() == keyLength && entry.key.compare(0, keyLength, key, keyLength) == 0)
+        {
+            entry.value.assign(value, valueLength);
+            entry.flags = flags;
+            return;
+        }
+    }
+
+    // Evicting may shift the probe sequence, so look for the free position afterwards.
+    int32_t slot = claimSlot();
+    Entry &entry = entries[slot];
+    entry.hash = hash;
+    entry.key.assign(key, keyLength);
+    entry.value.assign(value, valueLength);
+    entry.flags = flags;
+    entry.referenced = false;
+
+    for (position = static_cast<size_t>(hash) & mask; index[position] != EMPTY_SLOT; position = (position + 1) & mask)
+        ;
+    index[position] = slot;
+    stats.insertions++;
+}
@@ -0,0 +1,86 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Bounded text -> text memo with CLOCK (second-chance) eviction.
+//
+// Entries live in a fixed ring of capacity slots; an open-addressing index
+// maps a key hash to its slot, so a lookup is one hash of the key plus one
+// probe sequence. A hit sets the entry's reference bit; when the ring is
+// full, the clock hand clears reference bits until it finds an entry that
+// was not used since its last pass and reuses that slot.
+//
+// Not thread-safe: keep one cache per thread.
+class ResponseCache
+{
+public:
+    struct Entry
+    {
+        uint64_t hash;
+        string key;
+        string value;
+        uint32_t flags; // Caller-defined, stored with the value.
+        bool referenced;
+    };
+
+    struct Stats
+    {
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint64_t insertions = 0;
+        uint64_t evictions = 0;
+
+        double hitRate() const { return lookups ? static_cast<double>(hits) / lookups : 0.0; }
+        void add(const Stats &other);
+    };
+
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    explicit ResponseCache(size_t capacity = DEFAULT_CAPACITY);
+
+    // Drops every entry and resizes the ring; 0 disables the cache.
+    void setCapacity(size_t capacity);
+    size_t getCapacity() const { return capacity; }
+    size_t size() const { return used; }
+
+    // Drops every entry; the statistics are kept.
+    void clear();
+
+    // Returns the entry for key, or nullptr. Counts towards the hit rate.
+    const Entry *find(const char *key, size_t length);
+
+    // Adds or replaces the value for key, evicting if the cache is full.
+    void insert(const char *key, size_t keyLength, const char *value, size_t valueLength, uint32_t flags = 0);
+
+    const Stats &getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    static const int32_t EMPTY_SLOT = -1;
+
+    static uint64_t hashKey(const char *key, size_t length);
+
+    // Index position of slot, which must be indexed.
+    size_t indexPosition(int32_t slot) const;
+
+    // Removes slot from the index, shifting later probes back (no tombstones).
+    void unindex(int32_t slot);
+
+    // Slot to (re)use for a new entry.
+    int32_t claimSlot();
+
+    size_t capacity;
+    size_t used;
+    size_t hand;
+    vector<Entry> entries;
+    vector<int32_t> index;
+    Stats stats;
+};
+
+#endif // RESPONSE_CACHE_H
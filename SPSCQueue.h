@@ -0,0 +1,88 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread.
+//
+// The ring holds a power-of-two number of slots. The producer only writes
+// tail and the consumer only writes head; each publishes with a release
+// store that the other side reads with acquire, so an element is fully
+// written before the consumer can see it. Each side also keeps a private
+// copy of the other's index and only re-reads the shared one when the ring
+// looks full (or empty), which keeps the two cache lines from bouncing.
+template <typename T>
+class SPSCQueue
+{
+public:
+    // capacity is rounded up to a power of two.
+    explicit SPSCQueue(size_t capacity) : head(0), cachedTail(0), tail(0), cachedHead(0)
+    {
+        size_t slots = 2;
+        while (slots < capacity)
+            slots *= 2;
+        ring.resize(slots);
+        mask = slots - 1;
+    }
+
+    size_t capacity() const { return ring.size(); }
+
+    // Producer: moves item into the queue; false (item untouched) when full.
+    bool tryPush(T &item)
+    {
+        size_t position = tail.load(memory_order_relaxed);
+        if (position - cachedHead == ring.size())
+        {
+            cachedHead = head.load(memory_order_acquire);
+            if (position - cachedHead == ring.size())
+                return false;
+        }
+        ring[position & mask] = std::move(item);
+        tail.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer: moves the oldest element into item; false when empty.
+    bool tryPop(T &item)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        if (position == cachedTail)
+        {
+            cachedTail = tail.load(memory_order_acquire);
+            if (position == cachedTail)
+                return false;
+        }
+        item = std::move(ring[position & mask]);
+        head.store(position + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    SPSCQueue(const SPSCQueue &);
+    SPSCQueue &operator=(const SPSCQueue &);
+
+    // Keeps the consumer's and the producer's fields on separate cache lines.
+    static const size_t CACHE_LINE = 64;
+
+    vector<T> ring;
+    size_t mask;
+    char padding0[CACHE_LINE];
+
+    // Consumer side.
+    atomic<size_t> head;
+    size_t cachedTail;
+    char padding1[CACHE_LINE - sizeof(atomic<size_t>) - sizeof(size_t)];
+
+    // Producer side.
+    atomic<size_t> tail;
+    size_t cachedHead;
+    char padding2[CACHE_LINE - sizeof(atomic<size_t>) - sizeof(size_t)];
+};
+
+#endif // SPSC_QUEUE_H
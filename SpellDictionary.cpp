@@ -0,0 +1,325 @@
+#include "SpellDictionary.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// Deletes of a 32-character word at distance 2: 1 + 32 + 496.
+#define MAX_DELETE_VARIANTS 529
+
+// FNV-1a over token, leaving out the positions set in skipMask.
+static uint64_t hashWithout(const char *token, size_t length, uint64_t skipMask)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (skipMask & (1ull << i))
+            continue;
+        hash ^= static_cast<unsigned char>(token[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Hashes token and every string made by deleting up to maxDistance (1 or 2)
+// characters from it. Returns the number of hashes written to out; with
+// unique set, repeated deletes ("hello" without either 'l') are dropped.
+static size_t deleteHashes(const char *token, size_t length, int maxDistance, uint64_t *out, bool unique = true)
+{
+    size_t count = 0;
+    out[count++] = hashWithout(token, length, 0);
+    for (size_t i = 0; i < length; i++)
+    {
+        out[count++] = hashWithout(token, length, 1ull << i);
+        if (maxDistance < 2)
+            continue;
+        for (size_t j = i + 1; j < length; j++)
+            out[count++] = hashWithout(token, length, (1ull << i) | (1ull << j));
+    }
+
+    if (!unique)
+        return count;
+    sort(out, out + count);
+    return std::unique(out, out + count) - out;
+}
+
+// Optimal string alignment distance, or maxDistance + 1 once it is exceeded.
+static int boundedEditDistance(const char *a, size_t aLength, const char *b, size_t bLength, int maxDistance)
+{
+    int lengthGap = static_cast<int>(aLength) - static_cast<int>(bLength);
+    if (abs(lengthGap) > maxDistance)
+        return maxDistance + 1;
+
+    int rows[3][SpellDictionary::MAX_WORD_LENGTH + 1];
+    int *previous2 = rows[0];
+    int *previous = rows[1];
+    int *current = rows[2];
+
+    for (size_t j = 0; j <= bLength; j++)
+        previous[j] = static_cast<int>(j);
+
+    for (size_t i = 1; i <= aLength; i++)
+    {
+        current[0] = static_cast<int>(i);
+        int rowMinimum = current[0];
+        for (size_t j = 1; j <= bLength; j++)
+        {
+            int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            int best = min(min(previous[j] + 1, current[j - 1] + 1), previous[j - 1] + cost);
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+                best = min(best, previous2[j - 2] + 1);
+            current[j] = best;
+            rowMinimum = min(rowMinimum, best);
+        }
+        if (rowMinimum > maxDistance)
+            return maxDistance + 1;
+
+        int *recycled = previous2;
+        previous2 = previous;
+        previous = current;
+        current = recycled;
+    }
+    return previous[bLength];
+}
+
+// Index slots per entry is kept at or above this (load factor <= 0.5).
+#define INDEX_SLACK 2
+
+SpellDictionary::SpellDictionary(int maxEditDistance)
+    : maxDistance(maxEditDistance < 1 ? 1 : (maxEditDistance > 2 ? 2 : maxEditDistance)), indexEntries(0), indexedWords(0)
+{
+}
+
+void SpellDictionary::clear()
+{
+    words.clear();
+    frequencies.clear();
+    index.clear();
+    indexEntries = 0;
+    indexedWords = 0;
+}
+
+bool SpellDictionary::isCorrectable(const char *token, size_t length)
+{
+    if (length < MIN_CORRECTION_LENGTH || length > MAX_WORD_LENGTH)
+        return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (isdigit(static_cast<unsigned char>(token[i])))
+            return false;
+    }
+    return true;
+}
+
+void SpellDictionary::insertSlot(uint64_t hash, uint32_t id)
+{
+    size_t mask = index.size() - 1;
+    size_t position = static_cast<size_t>(hash) & mask;
+    while (index[position].wordId != EMPTY_SLOT)
+        position = (position + 1) & mask;
+    index[position].fingerprint = static_cast<uint32_t>(hash >> 32);
+    index[position].wordId = id;
+    indexEntries++;
+}
+
+void SpellDictionary::indexWord(uint32_t id)
+{
+    uint64_t hashes[MAX_DELETE_VARIANTS];
+    const string &word = words[id];
+    size_t count = deleteHashes(word.data(), word.size(), maxDistance, hashes);
+    reserveIndex(count);
+    for (size_t i = 0; i < count; i++)
+        insertSlot(hashes[i], id);
+    indexedWords = id + 1;
+}
+
+void SpellDictionary::reserveIndex(size_t entries)
+{
+    size_t needed = (indexEntries + entries) * INDEX_SLACK;
+    if (index.size() >= needed)
+        return;
+
+    size_t slots = 1024;
+    while (slots < needed * 2)
+        slots *= 2;
+
+    IndexSlot empty;
+    empty.fingerprint = 0;
+    empty.wordId = EMPTY_SLOT;
+    index.assign(slots, empty);
+    indexEntries = 0;
+
+    // The slots only keep half of each hash, so re-derive them from the words.
+    uint64_t hashes[MAX_DELETE_VARIANTS];
+    for (uint32_t id = 0; id < indexedWords; id++)
+    {
+        size_t count = deleteHashes(words[id].data(), words[id].size(), maxDistance, hashes);
+        for (size_t i = 0; i < count; i++)
+            insertSlot(hashes[i], id);
+    }
+}
+
+void SpellDictionary::addWord(const string &word, uint32_t frequency)
+{
+    addWeightedWords(vector<WeightedWord>(1, WeightedWord(word, frequency)));
+}
+
+void SpellDictionary::addWords(const vector<string> &newWords)
+{
+    vector<WeightedWord> batch;
+    batch.reserve(newWords.size());
+    for (const string &word : newWords)
+        batch.push_back(WeightedWord(word, 1));
+    addWeightedWords(batch);
+}
+
+void SpellDictionary::addWeightedWords(vector<WeightedWord> batch)
+{
+    // Fold duplicates inside the batch first; they are not indexed yet.
+    sort(batch.begin(), batch.end());
+
+    // Grow the index once for the whole batch (about length + 1 entries per word).
+    size_t estimate = 0;
+    for (const WeightedWord &entry : batch)
+        estimate += entry.first.size() + 1;
+    reserveIndex(estimate);
+
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        const string &word = batch[i].first;
+        uint32_t frequency = batch[i].second;
+        while (i + 1 < batch.size() && batch[i + 1].first == word)
+            frequency += batch[++i].second;
+
+        if (word.empty() || word.size() > MAX_WORD_LENGTH)
+            continue;
+
+        int existing = find(word.data(), word.size());
+        if (existing >= 0)
+        {
+            frequencies[existing] += frequency;
+            continue;
+        }
+
+        uint32_t id = static_cast<uint32_t>(words.size());
+        words.push_back(word);
+        frequencies.push_back(frequency);
+        indexWord(id);
+    }
+}
+
+bool SpellDictionary::loadFile(const string &path)
+{
+    ifstream file(path.c_str());
+    if (!file)
+    {
+        cerr << "[ERROR] Unable to open dictionary file " << path << endl;
+        return false;
+    }
+
+    vector<WeightedWord> loaded;
+    string line;
+    while (getline(file, line))
+    {
+        istringstream fields(line);
+        string word;
+        if (!(fields >> word) || word[0] == '#')
+            continue;
+        transform(word.begin(), word.end(), word.begin(), [](unsigned char c)
+                  { return tolower(c); });
+
+        unsigned long frequency = 1;
+        fields >> frequency;
+        loaded.push_back(WeightedWord(word, static_cast<uint32_t>(frequency > 0 ? frequency : 1)));
+    }
+    addWeightedWords(loaded);
+    return true;
+}
+
+int SpellDictionary::find(const char *token, size_t length) const
+{
+    if (length == 0 || length > MAX_WORD_LENGTH || index.empty())
+        return -1;
+
+    uint64_t hash = hashWithout(token, length, 0);
+    uint32_t fingerprint = static_cast<uint32_t>(hash >> 32);
+    size_t mask = index.size() - 1;
+    for (size_t position = static_cast<size_t>(hash) & mask; index[position].wordId != EMPTY_SLOT;
+         position = (position + 1) & mask)
+    {
+        if (index[position].fingerprint != fingerprint)
+            continue;
+        const string &word = words[index[position].wordId];
+        if (word.size() == length && memcmp(word.data(), token, length) == 0)
+            return static_cast<int>(index[position].wordId);
+    }
+    return -1;
+}
+
+int SpellDictionary::lookup(const char *token, size_t length, int *distance) const
+{
+    int exact = find(token, length);
+    if (exact >= 0 || !isCorrectable(token, length))
+    {
+        if (distance != nullptr)
+            *distance = 0;
+        return exact;
+    }
+
+    // Repeated probes are harmless here, so skip the de-duplication.
+    uint64_t hashes[MAX_DELETE_VARIANTS];
+    size_t count = deleteHashes(token, length, maxDistance, hashes, false);
+
+    // Start every probe's cache miss before walking any of them.
+    size_t mask = index.size() - 1;
+    for (size_t h = 0; h < count && !index.empty(); h++)
+        __builtin_prefetch(&index[static_cast<size_t>(hashes[h]) & mask]);
+
+    int best = -1;
+    int bestDistance = maxDistance + 1;
+    uint32_t bestFrequency = 0;
+    bool tie = false;
+
+    for (size_t h = 0; h < count && !index.empty(); h++)
+    {
+        uint32_t fingerprint = static_cast<uint32_t>(hashes[h] >> 32);
+        for (size_t position = static_cast<size_t>(hashes[h]) & mask; index[position].wordId != EMPTY_SLOT;
+             position = (position + 1) & mask)
+        {
+            if (index[position].fingerprint != fingerprint)
+                continue;
+            int id = static_cast<int>(index[position].wordId);
+            if (id == best)
+                continue;
+
+            const string &word = words[id];
+            int d = boundedEditDistance(token, length, word.data(), word.size(), maxDistance);
+            if (d > maxDistance)
+                continue;
+
+            if (d < bestDistance || (d == bestDistance && frequencies[id] > bestFrequency))
+            {
+                best = id;
+                bestDistance = d;
+                bestFrequency = frequencies[id];
+                tie = false;
+            }
+            else if (d == bestDistance && frequencies[id] == bestFrequency)
+            {
+                tie = true;
+            }
+        }
+    }
+
+    if (best < 0 || tie)
+        return -1;
+    if (distance != nullptr)
+        *distance = bestDistance;
+    return best;
+}
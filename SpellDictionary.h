@@ -0,0 +1,92 @@
+#ifndef SPELL_DICTIONARY_H
+#define SPELL_DICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Fuzzy word lookup using symmetric-delete (SymSpell) indexing.
+//
+// Every word is indexed under itself and each string obtained by deleting up
+// to maxEditDistance characters from it. A lookup generates the same deletes
+// of the query, so candidates are found with a handful of hash probes instead
+// of a scan of the dictionary; each candidate is then verified with an
+// optimal-string-alignment (Damerau) edit distance.
+//
+// find() and lookup() probe the index with stack-local hashes and never
+// rehash, so concurrent lookups need no locking; adding or loading words
+// can grow the index and must not overlap them.
+class SpellDictionary
+{
+public:
+    explicit SpellDictionary(int maxEditDistance = 1);
+
+    // Adds a lowercase word. Adding an existing word raises its frequency,
+    // which breaks ties between equally distant candidates.
+    void addWord(const string &word, uint32_t frequency = 1);
+
+    // Adds many words with a single index rebuild.
+    void addWords(const vector<string> &words);
+
+    // Loads one "word [frequency]" per line; blank lines and '#' comments are
+    // skipped. Returns false if the file cannot be opened.
+    bool loadFile(const string &path);
+
+    void clear();
+
+    size_t size() const { return words.size(); }
+    bool empty() const { return words.empty(); }
+    int getMaxEditDistance() const { return maxDistance; }
+    const string &getWord(int id) const { return words[id]; }
+
+    // Returns the id of token if it is in the dictionary, otherwise -1.
+    int find(const char *token, size_t length) const;
+
+    // Returns the id of the closest word within the edit distance, or -1 if
+    // there is none, if two candidates tie, or if the token is not worth
+    // correcting (see isCorrectable). *distance receives the edit distance.
+    int lookup(const char *token, size_t length, int *distance = nullptr) const;
+
+    // Tokens that are too short or too long, or that contain digits, are
+    // never corrected: numbers, timestamps and numbered handles are too
+    // easily turned into a different valid value.
+    static bool isCorrectable(const char *token, size_t length);
+
+    static const size_t MIN_CORRECTION_LENGTH = 4;
+    static const size_t MAX_WORD_LENGTH = 32;
+
+private:
+    // Open-addressing slot: the upper half of a word's (or delete's) hash
+    // and the word id. Slots with equal hashes simply sit next to each other.
+    struct IndexSlot
+    {
+        uint32_t fingerprint;
+        uint32_t wordId;
+    };
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+    typedef pair<string, uint32_t> WeightedWord;
+
+    // Adds (word, frequency) pairs and indexes the new ones.
+    void addWeightedWords(vector<WeightedWord> batch);
+
+    // Inserts word id under itself and all of its deletes.
+    void indexWord(uint32_t id);
+    void insertSlot(uint64_t hash, uint32_t id);
+
+    // Makes room for at least entries more entries, rehashing if needed.
+    void reserveIndex(size_t entries);
+
+    int maxDistance;
+    vector<string> words;
+    vector<uint32_t> frequencies;
+    vector<IndexSlot> index;
+    size_t indexEntries;
+    uint32_t indexedWords; // Words [0, indexedWords) are in the index.
+};
+
+#endif // SPELL_DICTIONARY_H
@@ -0,0 +1,61 @@
+#include "TerminalFrame.h"
+
+using namespace std;
+
+TerminalFrame::TerminalFrame(ostream &out)
+    : out(out), maxMessages(0), minRedrawInterval(0), lastRedraw(), frameMessages(0), collapsed(0),
+      framesDrawn(0), messagesShown(0), messagesCollapsedTotal(0)
+{
+}
+
+void TerminalFrame::addMessage(const char *sender, size_t senderLength, const char *text, size_t textLength)
+{
+    if (maxMessages > 0 && frameMessages >= maxMessages)
+    {
+        collapsed++;
+        return;
+    }
+    frame.append(sender, senderLength);
+    frame.append(": ", 2);
+    frame.append(text, textLength);
+    frame.push_back('\n');
+    frameMessages++;
+}
+
+void TerminalFrame::addLine(const string &line)
+{
+    frame.append(line);
+    frame.push_back('\n');
+}
+
+int TerminalFrame::msUntilRedraw() const
+{
+    if (!hasPending())
+        return -1;
+    chrono::steady_clock::duration wait = lastRedraw + minRedrawInterval - chrono::steady_clock::now();
+    if (wait <= chrono::steady_clock::duration::zero())
+        return 0;
+    // Round up so a poll() with this timeout wakes once the frame is due.
+    return static_cast<int>(chrono::duration_cast<chrono::milliseconds>(wait).count()) + 1;
+}
+
+bool TerminalFrame::render(bool force)
+{
+    if (!hasPending() || (!force && msUntilRedraw() > 0))
+        return false;
+
+    if (collapsed > 0)
+        frame.append("[" + to_string(collapsed) + " more messages]\n");
+
+    out.write(frame.data(), frame.size());
+    out.flush();
+
+    framesDrawn++;
+    messagesShown += frameMessages;
+    messagesCollapsedTotal += collapsed;
+    frame.clear();
+    frameMessages = 0;
+    collapsed = 0;
+    lastRedraw = chrono::steady_clock::now();
+    return true;
+}
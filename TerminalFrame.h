@@ -0,0 +1,65 @@
+#ifndef TERMINAL_FRAME_H
+#define TERMINAL_FRAME_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// Collects the client's terminal output between redraws.
+//
+// Handlers append incoming messages and notices to the frame instead of
+// writing (and flushing) a line each; render() writes the whole frame with a
+// single write and flush. Redraws can be capped to one per interval, and a
+// frame can be limited to a number of chat messages, the rest of a flood
+// being shown as one "[N more messages]" line.
+class TerminalFrame
+{
+public:
+    explicit TerminalFrame(ostream &out);
+
+    // At most this many chat messages per frame; 0 shows them all.
+    void setMaxMessages(size_t messages) { maxMessages = messages; }
+
+    // At least this long between two redraws; 0 redraws whenever asked.
+    void setMinRedrawInterval(int milliseconds) { minRedrawInterval = chrono::milliseconds(milliseconds); }
+
+    // Appends "sender: text" as a chat message, which may be collapsed.
+    void addMessage(const char *sender, size_t senderLength, const char *text, size_t textLength);
+
+    // Appends a line that is always shown (errors, lists, notices).
+    void addLine(const string &line);
+
+    bool hasPending() const { return !frame.empty() || collapsed > 0; }
+
+    // Milliseconds until the pending frame may be drawn: 0 when due, -1 when
+    // nothing is pending. Suitable as a poll() timeout.
+    int msUntilRedraw() const;
+
+    // Draws the pending frame if it is due, or regardless with force.
+    // Returns true when something was written.
+    bool render(bool force = false);
+
+    uint64_t getFramesDrawn() const { return framesDrawn; }
+    uint64_t getMessagesShown() const { return messagesShown; }
+    uint64_t getMessagesCollapsed() const { return messagesCollapsedTotal; }
+
+private:
+    ostream &out;
+    string frame;
+    size_t maxMessages;
+    chrono::milliseconds minRedrawInterval;
+    chrono::steady_clock::time_point lastRedraw;
+
+    size_t frameMessages; // Chat messages shown in the pending frame.
+    size_t collapsed;     // Chat messages left out of the pending frame.
+
+    uint64_t framesDrawn;
+    uint64_t messagesShown;
+    uint64_t messagesCollapsedTotal;
+};
+
+#endif // TERMINAL_FRAME_H
@@ -0,0 +1,16 @@
+#ifndef TOKEN_SPAN_H
+#define TOKEN_SPAN_H
+
+#include <cstdint>
+
+using namespace std;
+
+// A token inside a text buffer, stored as an offset so the span stays valid
+// when the buffer it points into is reallocated.
+struct TokenSpan
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+#endif // TOKEN_SPAN_H
@@ -0,0 +1,320 @@
+#include "TrafficCapture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// The ring starts on a cache-line boundary after the file header.
+#define CAPTURE_DATA_OFFSET 128
+#define CAPTURE_ALIGNMENT 8
+
+static_assert(sizeof(CaptureFileHeader) <= CAPTURE_DATA_OFFSET, "CaptureFileHeader must fit before the ring");
+
+// Rounds n up to the record alignment.
+static inline uint64_t alignRecord(uint64_t n)
+{
+    return (n + CAPTURE_ALIGNMENT - 1) & ~static_cast<uint64_t>(CAPTURE_ALIGNMENT - 1);
+}
+
+static inline uint64_t steadyNowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TrafficCapture::TrafficCapture()
+    : fd(-1), mappedSize(0), mapping(nullptr), header(nullptr), ring(nullptr),
+      startSteadyNs(0), nextConnectionId(1)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    close();
+}
+
+bool TrafficCapture::open(const char *path, size_t sizeBytes)
+{
+    close();
+
+    if (sizeBytes < CAPTURE_DATA_OFFSET + 4096)
+    {
+        cerr << "[ERROR] Capture file size too small: " << sizeBytes << " bytes." << endl;
+        return false;
+    }
+    // Keep the ring a multiple of the record alignment.
+    sizeBytes = CAPTURE_DATA_OFFSET + ((sizeBytes - CAPTURE_DATA_OFFSET) & ~static_cast<size_t>(CAPTURE_ALIGNMENT - 1));
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("open capture file");
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(sizeBytes)) < 0)
+    {
+        perror("ftruncate capture file");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    void *mem = mmap(nullptr, sizeBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap capture file");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    mapping = static_cast<uint8_t *>(mem);
+    mappedSize = sizeBytes;
+    header = reinterpret_cast<CaptureFileHeader *>(mapping);
+    ring = mapping + CAPTURE_DATA_OFFSET;
+
+    memset(header, 0, sizeof(CaptureFileHeader));
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->dataOffset = CAPTURE_DATA_OFFSET;
+    header->ringCapacity = sizeBytes - CAPTURE_DATA_OFFSET;
+    header->startUnixNs = chrono::duration_cast<chrono::nanoseconds>(
+                              chrono::system_clock::now().time_since_epoch()).count();
+
+    startSteadyNs = steadyNowNs();
+    nextConnectionId = 1;
+    socketToConnection.clear();
+    return true;
+}
+
+void TrafficCapture::close()
+{
+    if (mapping != nullptr)
+    {
+        msync(mapping, mappedSize, MS_SYNC);
+        munmap(mapping, mappedSize);
+    }
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    mapping = nullptr;
+    header = nullptr;
+    ring = nullptr;
+    mappedSize = 0;
+}
+
+uint32_t TrafficCapture::connectionFor(int socketNumber)
+{
+    if (socketNumber < 0)
+        return 0;
+    if (static_cast<size_t>(socketNumber) >= socketToConnection.size())
+        socketToConnection.resize(socketNumber + 1, 0);
+    if (socketToConnection[socketNumber] == 0)
+        socketToConnection[socketNumber] = nextConnectionId++;
+    return socketToConnection[socketNumber];
+}
+
+void TrafficCapture::recordConnect(int socketNumber)
+{
+    if (!isOpen())
+        return;
+    // A new accept on a reused socket number always starts a new connection.
+    if (socketNumber >= 0 && static_cast<size_t>(socketNumber) < socketToConnection.size())
+        socketToConnection[socketNumber] = 0;
+    appendRecord(CAPTURE_RECORD_CONNECT, 0, connectionFor(socketNumber), nullptr, 0);
+}
+
+void TrafficCapture::recordPDU(int socketNumber, int flag, const uint8_t *payload, int payloadLength)
+{
+    if (!isOpen())
+        return;
+    if (payloadLength < 0)
+        payloadLength = 0;
+    appendRecord(CAPTURE_RECORD_PDU, static_cast<uint8_t>(flag), connectionFor(socketNumber),
+                 payload, static_cast<uint16_t>(payloadLength));
+}
+
+void TrafficCapture::recordDisconnect(int socketNumber)
+{
+    if (!isOpen())
+        return;
+    appendRecord(CAPTURE_RECORD_DISCONNECT, 0, connectionFor(socketNumber), nullptr, 0);
+    if (socketNumber >= 0 && static_cast<size_t>(socketNumber) < socketToConnection.size())
+        socketToConnection[socketNumber] = 0;
+}
+
+void TrafficCapture::evictRange(uint64_t begin, uint64_t end)
+{
+    while (header->liveRecords > 0 && header->headOffset >= begin && header->headOffset < end)
+    {
+        const CaptureRecordHeader *oldest =
+            reinterpret_cast<const CaptureRecordHeader *>(ring + header->headOffset);
+        if (oldest->kind != CAPTURE_RECORD_PAD)
+            header->evictedRecords++;
+
+        header->headOffset += oldest->length;
+        if (header->headOffset >= header->ringCapacity)
+            header->headOffset = 0;
+        header->liveRecords--;
+    }
+}
+
+void TrafficCapture::appendRecord(uint8_t kind, uint8_t flag, uint32_t connectionId,
+                                  const uint8_t *payload, uint16_t payloadLength)
+{
+    uint64_t recordLength = alignRecord(sizeof(CaptureRecordHeader) + payloadLength);
+    uint64_t capacity = header->ringCapacity;
+    if (recordLength > capacity)
+        return;
+
+    if (header->liveRecords == 0)
+        header->headOffset = header->tailOffset;
+
+    // Not enough room before the end of the ring: fill the rest with a PAD and wrap.
+    if (header->tailOffset + recordLength > capacity)
+    {
+        uint64_t padStart = header->tailOffset;
+        evictRange(padStart, capacity);
+
+        CaptureRecordHeader *pad = reinterpret_cast<CaptureRecordHeader *>(ring + padStart);
+        pad->length = static_cast<uint32_t>(capacity - padStart);
+        pad->kind = CAPTURE_RECORD_PAD;
+        header->liveRecords++;
+        header->tailOffset = 0;
+    }
+
+    evictRange(header->tailOffset, header->tailOffset + recordLength);
+    if (header->liveRecords == 0)
+        header->headOffset = header->tailOffset;
+
+    CaptureRecordHeader *record = reinterpret_cast<CaptureRecordHeader *>(ring + header->tailOffset);
+    record->length = static_cast<uint32_t>(recordLength);
+    record->kind = kind;
+    record->flag = flag;
+    record->payloadLength = payloadLength;
+    record->connectionId = connectionId;
+    record->reserved = 0;
+    record->timestampNs = steadyNowNs() - startSteadyNs;
+    if (payloadLength > 0 && payload != nullptr)
+        memcpy(record + 1, payload, payloadLength);
+
+    header->tailOffset += recordLength;
+    if (header->tailOffset >= capacity)
+        header->tailOffset = 0;
+    header->liveRecords++;
+    header->totalRecords++;
+}
+
+// -----------------------------------------------------------------------------
+// CaptureReader
+// -----------------------------------------------------------------------------
+
+CaptureReader::CaptureReader()
+    : fd(-1), mappedSize(0), mapping(nullptr), header(nullptr), ring(nullptr), position(0), remaining(0)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+bool CaptureReader::open(const char *path)
+{
+    close();
+
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("open capture file");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CaptureFileHeader))
+    {
+        cerr << "[ERROR] Capture file is too small or unreadable." << endl;
+        close();
+        return false;
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        perror("mmap capture file");
+        close();
+        return false;
+    }
+    mapping = static_cast<uint8_t *>(mem);
+    mappedSize = st.st_size;
+    header = reinterpret_cast<const CaptureFileHeader *>(mapping);
+
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CAPTURE_VERSION ||
+        header->dataOffset + header->ringCapacity > mappedSize)
+    {
+        cerr << "[ERROR] Not a valid capture file (bad magic, version or size)." << endl;
+        close();
+        return false;
+    }
+
+    ring = mapping + header->dataOffset;
+    position = header->headOffset;
+    remaining = header->liveRecords;
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mappedSize);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    mapping = nullptr;
+    header = nullptr;
+    ring = nullptr;
+    mappedSize = 0;
+    remaining = 0;
+}
+
+bool CaptureReader::next(CaptureRecord &record)
+{
+    while (remaining > 0)
+    {
+        // Only length and kind are guaranteed for a PAD at the very end of the ring.
+        const CaptureRecordHeader *rh = reinterpret_cast<const CaptureRecordHeader *>(ring + position);
+        if (rh->length < CAPTURE_ALIGNMENT || position + rh->length > header->ringCapacity)
+        {
+            cerr << "[ERROR] Corrupt capture record at ring offset " << position << "." << endl;
+            remaining = 0;
+            return false;
+        }
+
+        position += rh->length;
+        if (position >= header->ringCapacity)
+            position = 0;
+        remaining--;
+
+        if (rh->kind == CAPTURE_RECORD_PAD)
+            continue;
+
+        record.kind = rh->kind;
+        record.flag = rh->flag;
+        record.connectionId = rh->connectionId;
+        record.timestampNs = rh->timestampNs;
+        record.payloadLength = rh->payloadLength;
+        record.payload = reinterpret_cast<const uint8_t *>(rh + 1);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,145 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Binary capture file layout.
+//
+// The file is preallocated and mmap'd; it starts with a CaptureFileHeader
+// followed by a ring of variable-length records. Every record begins with a
+// CaptureRecordHeader and is padded to an 8-byte boundary. When a record does
+// not fit before the end of the ring, the remainder is filled with a PAD record
+// and writing wraps to the beginning, evicting the oldest records.
+// -----------------------------------------------------------------------------
+
+#define CAPTURE_MAGIC "CHATCAP1"
+#define CAPTURE_VERSION 1
+#define CAPTURE_DEFAULT_SIZE_MB 64
+
+// Record kinds stored in CaptureRecordHeader::kind.
+enum CaptureRecordKind
+{
+    CAPTURE_RECORD_PDU = 0,        // An inbound PDU (flag + payload).
+    CAPTURE_RECORD_CONNECT = 1,    // A new connection was accepted.
+    CAPTURE_RECORD_DISCONNECT = 2, // The connection was closed.
+    CAPTURE_RECORD_PAD = 0xFF      // Filler up to the end of the ring.
+};
+
+#pragma pack(push, 1)
+struct CaptureFileHeader
+{
+    char magic[8];          // CAPTURE_MAGIC (not null terminated).
+    uint32_t version;       // CAPTURE_VERSION.
+    uint32_t dataOffset;    // Offset of the ring from the start of the file.
+    uint64_t ringCapacity;  // Size of the ring in bytes.
+    uint64_t headOffset;    // Ring offset of the oldest live record.
+    uint64_t tailOffset;    // Ring offset where the next record is written.
+    uint64_t liveRecords;   // Number of records (including PADs) in the ring.
+    uint64_t totalRecords;  // Records written since the capture started.
+    uint64_t evictedRecords; // Records overwritten because the ring wrapped.
+    int64_t startUnixNs;    // Wall-clock time the capture started.
+};
+
+struct CaptureRecordHeader
+{
+    uint32_t length;        // Total record length in bytes (header + payload + padding).
+    uint8_t kind;           // CaptureRecordKind.
+    uint8_t flag;           // PDU flag (CAPTURE_RECORD_PDU only).
+    uint16_t payloadLength; // Number of payload bytes following the header.
+    uint32_t connectionId;  // Server-assigned connection ID.
+    uint32_t reserved;
+    uint64_t timestampNs;   // Nanoseconds since the capture started.
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CaptureRecordHeader) == 24, "CaptureRecordHeader must be 24 bytes");
+
+// A decoded record as returned by CaptureReader.
+struct CaptureRecord
+{
+    uint8_t kind;
+    uint8_t flag;
+    uint32_t connectionId;
+    uint64_t timestampNs;
+    const uint8_t *payload; // Points into the mapped file; valid until the reader closes.
+    uint16_t payloadLength;
+};
+
+// Writes inbound traffic into a preallocated, mmap'd capture ring.
+class TrafficCapture
+{
+public:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    // Creates (or truncates) path, preallocates sizeBytes and maps it.
+    // Returns true on success.
+    bool open(const char *path, size_t sizeBytes);
+
+    // Unmaps and closes the capture file.
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+
+    // Records that a connection was accepted on socketNumber and assigns it a new connection ID.
+    void recordConnect(int socketNumber);
+
+    // Records an inbound PDU received on socketNumber.
+    void recordPDU(int socketNumber, int flag, const uint8_t *payload, int payloadLength);
+
+    // Records that the connection on socketNumber was closed.
+    void recordDisconnect(int socketNumber);
+
+private:
+    // Appends one record to the ring, evicting old records as needed.
+    void appendRecord(uint8_t kind, uint8_t flag, uint32_t connectionId,
+                      const uint8_t *payload, uint16_t payloadLength);
+
+    // Evicts live records whose start offset lies in [begin, end).
+    void evictRange(uint64_t begin, uint64_t end);
+
+    // Returns the connection ID assigned to socketNumber (assigning one if needed).
+    uint32_t connectionFor(int socketNumber);
+
+    int fd;
+    size_t mappedSize;
+    uint8_t *mapping;
+    CaptureFileHeader *header;
+    uint8_t *ring;
+    uint64_t startSteadyNs;
+    uint32_t nextConnectionId;
+    vector<uint32_t> socketToConnection; // Indexed by socket number; 0 = none.
+};
+
+// Reads records back out of a capture file in the order they were written.
+class CaptureReader
+{
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    // Maps path read-only and validates its header. Returns true on success.
+    bool open(const char *path);
+    void close();
+
+    // Fetches the next record; returns false when all live records have been read.
+    bool next(CaptureRecord &record);
+
+    const CaptureFileHeader *getHeader() const { return header; }
+
+private:
+    int fd;
+    size_t mappedSize;
+    uint8_t *mapping;
+    const CaptureFileHeader *header;
+    const uint8_t *ring;
+    uint64_t position;
+    uint64_t remaining;
+};
+
+#endif // TRAFFIC_CAPTURE_H
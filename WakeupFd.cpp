@@ -0,0 +1,83 @@
+#include "WakeupFd.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+WakeupFd::WakeupFd() : readFd(-1), writeFd(-1)
+{
+}
+
+WakeupFd::~WakeupFd()
+{
+    close();
+}
+
+bool WakeupFd::open()
+{
+    close();
+
+#ifdef __linux__
+    readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readFd < 0)
+    {
+        perror("eventfd");
+        return false;
+    }
+    writeFd = readFd;
+#else
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+        perror("pipe");
+        return false;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    readFd = fds[0];
+    writeFd = fds[1];
+#endif
+    return true;
+}
+
+void WakeupFd::close()
+{
+    if (writeFd >= 0 && writeFd != readFd)
+        ::close(writeFd);
+    if (readFd >= 0)
+        ::close(readFd);
+    readFd = -1;
+    writeFd = -1;
+}
+
+void WakeupFd::notify()
+{
+    // A full pipe (EAGAIN) or counter already means "readable"; nothing is lost.
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t written = write(writeFd, &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t written = write(writeFd, &one, sizeof(one));
+#endif
+    if (written < 0 && errno != EAGAIN && errno != EINTR)
+        perror("wakeup write");
+}
+
+void WakeupFd::drain()
+{
+    // An eventfd read resets the counter; a pipe needs reading until empty.
+    char buffer[64];
+    while (read(readFd, buffer, sizeof(buffer)) > 0)
+        ;
+}
@@ -0,0 +1,37 @@
+#ifndef WAKEUP_FD_H
+#define WAKEUP_FD_H
+
+using namespace std;
+
+// A file descriptor that another thread can make readable, so a thread
+// blocked in poll() wakes up without a timeout. Uses an eventfd on Linux
+// and a non-blocking pipe elsewhere; notifications that arrive before the
+// reader drains collapse into one wakeup.
+class WakeupFd
+{
+public:
+    WakeupFd();
+    ~WakeupFd();
+
+    // Creates the descriptor(s). Returns false (after perror) on failure.
+    bool open();
+    void close();
+
+    // Descriptor to poll for POLLIN.
+    int getFd() const { return readFd; }
+
+    // Makes getFd() readable. Safe to call from any thread.
+    void notify();
+
+    // Consumes pending notifications; call before looking for new work.
+    void drain();
+
+private:
+    WakeupFd(const WakeupFd &);
+    WakeupFd &operator=(const WakeupFd &);
+
+    int readFd;
+    int writeFd; // Same as readFd for an eventfd.
+};
+
+#endif // WAKEUP_FD_H
@@ -0,0 +1,88 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t threads)
+    : generation(0), busyWorkers(0), stopping(false), task(nullptr), count(0), grain(1), next(0)
+{
+    if (threads == 0)
+        threads = thread::hardware_concurrency();
+    for (size_t i = 1; i < threads; i++)
+        workers.push_back(thread(&WorkerPool::workerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+}
+
+void WorkerPool::parallelFor(size_t newCount, size_t newGrain, const function<void(size_t, size_t)> &newTask)
+{
+    if (newCount == 0)
+        return;
+    if (newGrain == 0)
+        newGrain = 1;
+
+    // Not worth waking anyone for a single chunk.
+    if (workers.empty() || newCount <= newGrain)
+    {
+        newTask(0, newCount);
+        return;
+    }
+
+    lock_guard<mutex> call(callMutex);
+    {
+        lock_guard<mutex> lock(jobMutex);
+        task = &newTask;
+        count = newCount;
+        grain = newGrain;
+        next.store(0);
+        busyWorkers = workers.size();
+        generation++;
+    }
+    jobReady.notify_all();
+
+    runChunks();
+
+    // The job (and newTask) must outlive every worker that is still in it.
+    unique_lock<mutex> lock(jobMutex);
+    jobDone.wait(lock, [this] { return busyWorkers == 0; });
+    task = nullptr;
+}
+
+void WorkerPool::runChunks()
+{
+    for (;;)
+    {
+        size_t begin = next.fetch_add(grain);
+        if (begin >= count)
+            return;
+        size_t end = begin + grain < count ? begin + grain : count;
+        (*task)(begin, end);
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return generation != seen || stopping; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        lock_guard<mutex> lock(jobMutex);
+        if (--busyWorkers == 0)
+            jobDone.notify_one();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of threads for data-parallel loops.
+//
+// parallelFor() splits [0, count) into chunks of grain indices that the
+// workers and the calling thread claim one at a time from a shared counter,
+// so uneven chunks balance themselves. The workers are long-lived: anything
+// they keep in thread_local storage (such as NLPModel's scratch buffers and
+// response cache) is reused from one call to the next.
+//
+// One parallelFor() runs at a time; calls from several threads are serialized.
+class WorkerPool
+{
+public:
+    // threads counts the calling thread, so a pool of 1 starts no workers;
+    // 0 means one per hardware thread.
+    explicit WorkerPool(size_t threads = 0);
+    ~WorkerPool();
+
+    // Total threads that run tasks (workers + caller).
+    size_t size() const { return workers.size() + 1; }
+
+    // Calls task(begin, end) on disjoint ranges covering [0, count) and
+    // returns when all of them are done.
+    void parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)> &task);
+
+private:
+    WorkerPool(const WorkerPool &);
+    WorkerPool &operator=(const WorkerPool &);
+
+    void workerLoop();
+
+    // Claims and runs chunks of the current job until none are left.
+    void runChunks();
+
+    vector<thread> workers;
+
+    mutex callMutex; // Serializes parallelFor().
+    mutex jobMutex;
+    condition_variable jobReady;
+    condition_variable jobDone;
+    uint64_t generation; // Bumped for every job; workers wait for a change.
+    size_t busyWorkers;
+    bool stopping;
+
+    // The current job.
+    const function<void(size_t, size_t)> *task;
+    size_t count;
+    size_t grain;
+    atomic<size_t> next;
+};
+
+#endif // WORKER_POOL_H
@@ -23,13 +23,20 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
 
 #include "pollLib.h" 
 #include "networks.h"
 #include "PDU_Send_And_Recv.h"
+#include "PDU_Stream.h"
 #include "ConnectionStats.h"
+#include "TerminalFrame.h"
+#include "HandleDirectory.h"
 #include "chatFlags.h"
+#include "PDU_Schema.h"
 #include "NLPProcessor.h" // Include the NLP module
+#include "NLPWorker.h"	  // Runs it off the I/O loop
 
 // For simulation mode:
 #include <thread>
@@ -37,6 +44,13 @@
 #include <chrono>
 #include <random>
 #include <fstream>
+#include <atomic>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include "LatencyHistogram.h"
+#include "AsyncLogSink.h"
 
 using namespace std;
 
@@ -81,23 +95,11 @@ static std::string hexDump(const uint8_t *buffer, int length)
 #define CMD_CURRENT_CONNECTION_STATUS "%S"
 #define CMD_EXIT "%E"
 
-// Packet flags
-#define CLIENT_INIT_PACKET_TO_SERVER 1
-#define BROADCAST_PACKET 4
-#define MESSAGE_PACKET 5
-#define EXIT_PACKET 8
-
-#define LIST_REQUEST_PACKET 0x0A  // Sent by client to request list (%L)
-#define LIST_RESPONSE_NUM 0x0B	  // Server sends: 4-byte number of handles
-#define LIST_RESPONSE_HANDLE 0x0C // Server sends: one handle (1 byte length + handle)
-#define LIST_RESPONSE_END 0x0D	  // Server sends: end-of-list marker
+// Packet flags (values, directions and minimum lengths) come from CHAT_FLAGS in chatFlags.h.
 
 // The maximum total bytes allowed for the text portion in each packet (including null terminator).
 #define MAX_TEXT_PER_PACKET 200
 
-// Confirm good handle flag (registration confirmation).
-#define CONFIRM_GOOD_HANDLE 2
-
 // ---------------------------------------------------------------------------
 // Global variables
 // ---------------------------------------------------------------------------
@@ -107,52 +109,214 @@ thread_local string g_clientHandle;
 static int g_socketNum = -1;
 static ConnectionStats connStats; // Global instance for tracking connection stats.
 
+// The interactive client's connection. Everything it sends is queued here and
+// written as the socket accepts it (POLLOUT), so a long paste or a slow server
+// never blocks reading stdin or the socket; PDUs go out in the order they were
+// queued. Replies are read with one fill() per wakeup and all handled at once.
+static PDU_Stream g_server;
+
+// Output of the packet handlers, drawn once per loop iteration (or at most
+// once per --redraw-ms) instead of a flushed line per message.
+static TerminalFrame g_frame(cout);
+
+// Online handles as last seen, for checking %M destinations before sending.
+static HandleDirectory g_directory;
+static bool g_exitAcknowledged = false; // EXIT_ACK received after %E.
+
+// %L responses are collected as they arrive through processIncomingPacket(),
+// so chat messages keep flowing while a list is being received.
+enum ListRetrievalState
+{
+	LIST_IDLE,			// No %L request outstanding.
+	LIST_AWAIT_COUNT,	// Request sent; waiting for LIST_RESPONSE_NUM.
+	LIST_AWAIT_HANDLES	// Receiving LIST_RESPONSE_HANDLE until LIST_RESPONSE_END.
+};
+
+struct ListRetrieval
+{
+	ListRetrievalState state = LIST_IDLE;
+	int outstanding = 0;	 // %L requests sent and not yet ended; the server answers in order.
+	uint32_t expected = 0;	 // Count announced by the server.
+	vector<string> handles;			// Handles of the list being received.
+	vector<string> finishedHandles; // Most recently completed list, kept apart from the next one.
+	bool finished = false;			// finishedHandles waits for takeFinishedList().
+};
+
+static ListRetrieval g_list;
+
+// ---------------------------------------------------------------------------
+// Simulation scenario configuration and results
+// ---------------------------------------------------------------------------
+// How a "slow reader" simulated client consumes its socket.
+enum SlowReaderMode
+{
+	SLOW_READER_STOP,	// Stops reading until every simulated client has finished sending.
+	SLOW_READER_TRICKLE // Reads one PDU every trickleMs milliseconds.
+};
+
+struct SimulationConfig
+{
+	int numClients = 0;
+	int totalMessages = 30;					 // Messages sent by each simulated client.
+	double slowFraction = 0.0;				 // Fraction of clients that are slow readers.
+	SlowReaderMode slowMode = SLOW_READER_STOP;
+	int trickleMs = 200;					 // Delay between reads in trickle mode.
+	int slowReceiveBuffer = 4096;			 // SO_RCVBUF for slow readers, so backpressure builds quickly.
+	string reportFile;						 // Optional CSV file that gets one summary row appended.
+	LogFormat logFormat = LOG_FORMAT_TEXT;	 // Format of the simclient_<n>_log files.
+	int workers = 1;						 // Worker processes; more than 1 enables coordinator mode.
+};
+
+// Messages on the worker <-> coordinator pipes (one byte each, results follow WORKER_MSG_RESULTS).
+#define WORKER_MSG_DONE_SENDING 'D' // Worker -> coordinator: every local client has finished sending.
+#define WORKER_MSG_RESULTS 'R'		// Worker -> coordinator: the four result histograms and NLP cache counters follow.
+#define WORKER_MSG_RELEASE 'G'		// Coordinator -> worker: every worker has finished sending.
+
+// Pipes between the coordinator and one worker process.
+struct WorkerProcess
+{
+	pid_t pid = -1;
+	int resultFd = -1;	// Coordinator reads WORKER_MSG_DONE_SENDING / WORKER_MSG_RESULTS here.
+	int releaseFd = -1; // Coordinator writes WORKER_MSG_RELEASE here.
+	int firstClient = 0;
+	int lastClient = 0; // Exclusive.
+	bool alive = true;
+};
+
+// Latency results shared by all simulated clients (merged under resultsMutex).
+struct SimulationResults
+{
+	mutex resultsMutex;
+	LatencyHistogram healthyDeliveryUs; // Send-to-receive latency seen by healthy clients.
+	LatencyHistogram slowDeliveryUs;	// Send-to-receive latency seen by slow readers.
+	LatencyHistogram healthySendUs;		// Time healthy clients spent inside a send command.
+	LatencyHistogram slowSendUs;		// Time slow readers spent inside a send command.
+	ResponseCache::Stats nlpCache;		// NLP response cache counters of every client thread.
+};
+
+static SimulationResults g_simResults;
+static atomic<int> g_sendersRemaining(0); // Simulated clients still sending messages.
+static AsyncLogSink g_simLogSink;		  // Shared writer for every simclient_<n>_log file.
+
 // ---------------------------------------------------------------------------
 // Function declarations
 // ---------------------------------------------------------------------------
 int readFromStdin(char *buffer);
-void checkArgs(int argc, char *argv[]);
+void checkArgs(int argc, char *argv[], string &dictionaryPath, string &intentModelPath, int &redrawMs, int &maxFrameMessages);
 void connection_setup(int socketNum, const char *handle);
-void processIncomingPacket(int socketNum);
+void processIncomingPackets();
 
+static bool parseMessageCommand(char *text, vector<string> &destinations, const char **message);
 void handleMessageCommand(int socketNum, const char *input);
 void handleBroadcastCommand(int socketNum, const char *input);
 void handleListCommand(int socketNum);
+bool takeFinishedList(vector<string> &handles);
 void handleExitCommand(int socketNum);
+static void flushOutbound();
+bool runCommand(const char *command, bool translated);
 
-// New function
-int readNBytes(int socketNum, uint8_t *buffer, int n);
 int connectToServer(const string &server, int port, const string &handle);
-void sendRegistration(int sock, const string &handle, PDU_Send_And_Recv &pdu, ofstream &logFile);
+void sendRegistration(int sock, const string &handle, PDU_Send_And_Recv &pdu, LogBuffer &log);
 string generateNLPCommand(bool isBroadcast, const string &handle, const vector<string> &simHandles, default_random_engine &eng, uniform_int_distribution<int> &recipientDist);
-void simulateMessageLoop(int sock, int totalMessages, const string &handle, const vector<string> &simHandles, NLPProcessor &nlp, default_random_engine &eng, uniform_int_distribution<int> &recipientDist, PDU_Send_And_Recv &pdu, ofstream &logFile);
-void sendExitCommand(int sock, PDU_Send_And_Recv &pdu, ofstream &logFile);
-void simulateClient(int clientId, const string &server, int port, int totalMessages, const vector<string> &simHandles);
+static void sendSimulatedText(int sock, const string &command, PDU_Send_And_Recv &pdu);
+void simulateMessageLoop(int sock, int totalMessages, const string &handle, const vector<string> &simHandles, NLPProcessor &nlp, default_random_engine &eng, uniform_int_distribution<int> &recipientDist, PDU_Send_And_Recv &pdu, LogBuffer &log, LatencyHistogram &sendLatency);
+void sendExitCommand(int sock, PDU_Send_And_Recv &pdu, LogBuffer &log);
+void simulateClient(int clientId, const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles);
+bool parseSimulationOptions(int argc, char *argv[], int firstOption, SimulationConfig &config);
+void printSimulationReport(const SimulationConfig &config, double elapsedSeconds);
+void runSimulatedClients(const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles, int firstClient, int lastClient, int releaseFd, int resultFd);
+int runSimulationCoordinator(const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles);
+int runBatch(const string &server, int port, const string &handle, const char *inputPath);
+static bool validHandle(const char *handle);
 
 // Helper function for receiver thread.
-void receiverThread(int sock, ofstream &logFile, PDU_Send_And_Recv &pdu);
+void receiverThread(int sock, int logChannel, PDU_Send_And_Recv &pdu, bool slowReader, const SimulationConfig &config, LatencyHistogram &deliveryLatency);
 int randomDelay(int base, int range);
 
+// Microseconds on the monotonic clock; used to timestamp simulated messages.
+static uint64_t steadyNowUs()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the text portion of a received %M/%B payload, or nullptr if malformed.
+static const char *findMessageText(const uint8_t *payload, int len, int flag)
+{
+	PDU_Text text;
+	if (flag == MESSAGE_PACKET)
+	{
+		MessagePDU message;
+		if (!message.parse(payload, len))
+			return nullptr;
+		text = message.text;
+	}
+	else
+	{
+		BroadcastPDU broadcast;
+		if (!broadcast.parse(payload, len))
+			return nullptr;
+		text = broadcast.text;
+	}
+	return text.terminated ? text.data : nullptr;
+}
+
+// Extracts the " ts=<microseconds>" stamp that simulated clients append to every message.
+static bool extractSendTimestamp(const char *text, uint64_t &timestampUs)
+{
+	const char *stamp = strstr(text, "ts=");
+	if (stamp == nullptr)
+		return false;
+	char *end = nullptr;
+	unsigned long long value = strtoull(stamp + 3, &end, 10);
+	if (end == stamp + 3)
+		return false;
+	timestampUs = value;
+	return true;
+}
+
 // Helper function for receiver thread.
-void receiverThread(int sock, std::ofstream &logFile, PDU_Send_And_Recv &pdu)
+// Slow readers either stop reading until every sender is done or read at a trickle.
+// The receiver logs through its own LogBuffer on the client's log channel.
+void receiverThread(int sock, int logChannel, PDU_Send_And_Recv &pdu, bool slowReader, const SimulationConfig &config, LatencyHistogram &deliveryLatency)
 {
 	const int bufSize = 1024;
 	uint8_t buffer[bufSize];
 	int flag;
+	LogBuffer log(g_simLogSink, logChannel);
+
+	if (slowReader && config.slowMode == SLOW_READER_STOP)
+	{
+		log.line("[Receiver] Slow reader: not reading until all senders finish.");
+		while (g_sendersRemaining.load() > 0)
+			this_thread::sleep_for(chrono::milliseconds(10));
+		log.line("[Receiver] Slow reader: resuming.");
+	}
 
 	while (true)
 	{
+		if (slowReader && config.slowMode == SLOW_READER_TRICKLE && g_sendersRemaining.load() > 0)
+			this_thread::sleep_for(chrono::milliseconds(config.trickleMs));
+
 		int len = pdu.recvBuf(sock, buffer, &flag);
-		if (len <= 0)
+		if (len == -1)
 			break;
-		logFile << "[Received] Flag: " << flag << ", Len: " << len << ", Data: ";
-		for (int i = 0; i < len; i++)
+		if (len == VALID_ZERO_PAYLOAD)
+			len = 0;
+
+		if (len > 0 && (flag == MESSAGE_PACKET || flag == BROADCAST_PACKET))
 		{
-			logFile << std::hex << (int)buffer[i] << " ";
+			uint64_t sentUs = 0;
+			const char *text = findMessageText(buffer, len, flag);
+			if (text != nullptr && extractSendTimestamp(text, sentUs))
+			{
+				uint64_t nowUs = steadyNowUs();
+				deliveryLatency.record(nowUs > sentUs ? nowUs - sentUs : 0);
+			}
 		}
-		logFile << std::dec << std::endl;
+
+		log.received(flag, buffer, len);
 	}
-	logFile << "[Receiver] Connection closed." << std::endl;
+	log.line("[Receiver] Connection closed.");
 }
 
 int randomDelay(int base, int range)
@@ -179,15 +343,13 @@ int connectToServer(const string &server, int port, const string &handle) {
 }
 
 // Helper function to send the registration packet.
-void sendRegistration(int sock, const string &handle, PDU_Send_And_Recv &pdu, ofstream &logFile) {
-	uint8_t regPayload[256];
-	uint8_t hLen = static_cast<uint8_t>(handle.size());
-	regPayload[0] = hLen;
-	memcpy(regPayload + 1, handle.c_str(), hLen);
-	int regBytes = pdu.sendBuf(sock, regPayload, 1 + hLen, CLIENT_INIT_PACKET_TO_SERVER);
+void sendRegistration(int sock, const string &handle, PDU_Send_And_Recv &pdu, LogBuffer &log) {
+	uint8_t regPayload[1 + UINT8_MAX];
+	size_t regLength = RegistrationPDU::build(regPayload, sizeof(regPayload), handle);
+	int regBytes = pdu.sendBuf(sock, regPayload, regLength, CLIENT_INIT_PACKET_TO_SERVER);
 
 	cout << "Sent registration packet: Handle = " << handle << ", Bytes sent = " << regBytes << endl;
-	logFile << "Sent registration packet: Handle = " << handle << ", Bytes sent = " << regBytes << endl;
+	log.line("Sent registration packet: Handle = " + handle + ", Bytes sent = " + to_string(regBytes));
 }
 
 // Helper function to generate an NLP command. If isBroadcast is true, returns a broadcast command; otherwise, selects a random recipient. 
@@ -205,56 +367,110 @@ string generateNLPCommand(bool isBroadcast, const string &handle, const vector<s
 	}
 }
 
+// Helper function to send a structured %M or %B command from a simulator
+// thread. g_server, g_directory and connStats belong to the interactive poll
+// loop, so each simulated client writes its own blocking socket directly,
+// one sendv() per segment.
+static void sendSimulatedText(int sock, const string &command, PDU_Send_And_Recv &pdu) {
+	char text[MAXBUF];
+	strncpy(text, command.c_str(), MAXBUF);
+	text[MAXBUF - 1] = '\0';
+
+	uint8_t routingHeader[MAXBUF - MAX_TEXT_PER_PACKET];
+	size_t headerSize = 0;
+	const char *message = "";
+	int flag;
+	if (command.compare(0, 2, "%M") == 0) {
+		vector<string> destinations;
+		if (!parseMessageCommand(text, destinations, &message))
+			return;
+		headerSize = MessagePDU::buildHeader(routingHeader, sizeof(routingHeader), g_clientHandle, destinations.begin(), destinations.end());
+		flag = MESSAGE_PACKET;
+	} else {
+		strtok(text, " ");
+		char *rest = strtok(nullptr, "\n");
+		if (rest != nullptr)
+			message = rest;
+		headerSize = BroadcastPDU::buildHeader(routingHeader, sizeof(routingHeader), g_clientHandle);
+		flag = BROADCAST_PACKET;
+	}
+	if (headerSize == 0) {
+		LOG_ERROR("Simulated command header too long: " << command);
+		return;
+	}
+
+	const size_t MAX_SEGMENT = MAX_TEXT_PER_PACKET - 1;
+	size_t messageLen = strlen(message);
+	size_t position = 0;
+	do {
+		size_t segmentLength = min(MAX_SEGMENT, messageLen - position);
+		struct iovec parts[] = {{routingHeader, headerSize},
+								{const_cast<char *>(message + position), segmentLength},
+								{const_cast<char *>(""), 1}};
+		if (pdu.sendv(sock, flag, parts, 3) < 0)
+			return;
+		position += segmentLength;
+	} while (position < messageLen);
+}
+
 // Helper function to simulate sending messages.
-void simulateMessageLoop(int sock, int totalMessages, const string &handle, const vector<string> &simHandles, NLPProcessor &nlp, default_random_engine &eng, uniform_int_distribution<int> &recipientDist, PDU_Send_And_Recv &pdu, ofstream &logFile) {
+// Every message carries a " ts=<microseconds>" stamp so receivers can measure delivery latency.
+void simulateMessageLoop(int sock, int totalMessages, const string &handle, const vector<string> &simHandles, NLPProcessor &nlp, default_random_engine &eng, uniform_int_distribution<int> &recipientDist, PDU_Send_And_Recv &pdu, LogBuffer &log, LatencyHistogram &sendLatency) {
 	for (int i = 0; i < totalMessages; i++) {
 		this_thread::sleep_for(chrono::milliseconds(randomDelay(100, 400)));
 		bool isBroadcast = (rand() % 2 == 0);
 		string nlCommand = generateNLPCommand(isBroadcast, handle, simHandles, eng, recipientDist);
+		uint64_t sendStartUs = steadyNowUs();
 
 		cout << "[Sent Raw] " << nlCommand << endl;
-		logFile << "[Sent Raw] " << nlCommand << endl;
+		log.line("[Sent Raw] " + nlCommand);
 
+		// The stamp goes on after conversion so repeated phrasings hit the NLP cache.
 		string structuredCommand = nlp.processMessage(nlCommand);
+		if (structuredCommand.compare(0, 2, "%M") == 0 || structuredCommand.compare(0, 2, "%B") == 0)
+			structuredCommand += " ts=" + to_string(sendStartUs);
 
 		cout << "[Converted] " << structuredCommand << endl;
-		logFile << "[Converted] " << structuredCommand << endl;
+		log.line("[Converted] " + structuredCommand);
 
 		// Process the structured command based on its type. 
-		if (structuredCommand.substr(0, 2) == "%M")
-			handleMessageCommand(sock, structuredCommand.c_str());
-		else if (structuredCommand.substr(0, 2) == "%B")
-			handleBroadcastCommand(sock, structuredCommand.c_str());
+		if (structuredCommand.substr(0, 2) == "%M" || structuredCommand.substr(0, 2) == "%B")
+			sendSimulatedText(sock, structuredCommand, pdu);
 		else if (structuredCommand.substr(0, 2) == "%L")
-			handleListCommand(sock);
+			pdu.sendBuf(sock, nullptr, 0, CLIENT_TO_SERVER_LIST_OF_HANDLES); // The receiver thread logs the reply.
 		else {
 			// For any other command, send it directly.
 			int flagToSend = 0;
 
 			pdu.sendBuf(sock, reinterpret_cast<uint8_t *>(const_cast<char *>(structuredCommand.c_str())), structuredCommand.length(), flagToSend);
 		}
+		sendLatency.record(steadyNowUs() - sendStartUs);
 
 		cout << "[Sent Structured] " << structuredCommand << endl;
-		logFile << "[Sent Structured] " << structuredCommand << endl;
+		log.line("[Sent Structured] " + structuredCommand);
 	}
 }
 
 // Helper function to send the exit command. 
-void sendExitCommand(int sock, PDU_Send_And_Recv &pdu, ofstream &logFile) {
+void sendExitCommand(int sock, PDU_Send_And_Recv &pdu, LogBuffer &log) {
 	string exitCommand = "%E";
-	int exitBytes = pdu.sendBuf(sock, reinterpret_cast<uint8_t *>(const_cast<char *>(exitCommand.c_str())), exitCommand.length(), EXIT_PACKET);
+	int exitBytes = pdu.sendBuf(sock, reinterpret_cast<uint8_t *>(const_cast<char *>(exitCommand.c_str())), exitCommand.length(), CLIENT_TO_SERVER_EXIT);
 
 	if (exitBytes != (int)(SIZE_CHAT_HEADER + exitCommand.length())) {
 		LOG_ERROR("Failed to send exit command properly. Socket may have been closed.");
 	} else {
 		cout << "Sent exit command." << endl;
-		logFile << "Sent exit command." << endl;
+		log.line("Sent exit command.");
 	}
 }
 
 // Revised simulateClient() using helper functions. 
-void simulateClient(int clientId, const string &server, int port, int totalMessages, const vector<string> &simHandles)
+// The last slowFraction of the clients act as slow readers.
+void simulateClient(int clientId, const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles)
 {
+	int slowCount = static_cast<int>(config.slowFraction * config.numClients + 0.5);
+	bool slowReader = clientId >= config.numClients - slowCount;
+
 	// Use the handle provided in the simHandles vector.
 	string handle = simHandles[clientId];
 	// Set the thread-local client handle for this simulation.
@@ -264,25 +480,36 @@ void simulateClient(int clientId, const string &server, int port, int totalMessa
 	int sock = connectToServer(server, port, handle);
 
 	if (sock < 0) {
+		g_sendersRemaining--;
 		return;
 	}
 
-	// Open a log file.
-	ofstream logFile ("simclient_" + to_string(clientId) + "_log.txt");
+	// A small receive buffer makes a stalled reader push back on the server quickly.
+	if (slowReader) {
+		int rcvBuf = config.slowReceiveBuffer;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+	}
+
+	// Open a log channel on the shared asynchronous sink.
+	const char *logExtension = (config.logFormat == LOG_FORMAT_BINARY) ? "_log.bin" : "_log.txt";
+	int logChannel = g_simLogSink.openChannel("simclient_" + to_string(clientId) + logExtension);
+	LogBuffer log(g_simLogSink, logChannel);
 
 	cout << "Client " << handle << " log start." << endl;
-	logFile << "Client " << handle << " log start." << endl;
+	log.line("Client " + handle + " log start.");
 
 	PDU_Send_And_Recv pdu;
 
 	// Send registration packet. 
-	sendRegistration(sock, handle, pdu, logFile);
+	sendRegistration(sock, handle, pdu, log);
 
 	// Wait for a short period to allow all clients to register. 
 	this_thread::sleep_for(chrono::seconds(2));
 
 	// Start a receiver thread to log incoming messages. 
-	thread recvThread(receiverThread, sock, ref(logFile), ref(pdu));
+	LatencyHistogram deliveryLatency;
+	LatencyHistogram sendLatency;
+	thread recvThread(receiverThread, sock, logChannel, ref(pdu), slowReader, cref(config), ref(deliveryLatency));
 
 	// Create an NLPProcessor instance.
 	NLPProcessor nlp;
@@ -291,17 +518,31 @@ void simulateClient(int clientId, const string &server, int port, int totalMessa
 	uniform_int_distribution<int> recipientDist(0, simHandles.size() - 1);
 
 	// Simulate sending messages. 
-	simulateMessageLoop(sock, totalMessages, handle, simHandles, nlp, eng, recipientDist, pdu, logFile);
+	simulateMessageLoop(sock, config.totalMessages, handle, simHandles, nlp, eng, recipientDist, pdu, log, sendLatency);
+
+	// Wait for everyone to finish sending so stopped readers resume before exits start.
+	g_sendersRemaining--;
+	while (g_sendersRemaining.load() > 0)
+		this_thread::sleep_for(chrono::milliseconds(10));
 
 	// Finally, send an exit command.
-	sendExitCommand(sock, pdu, logFile);
+	sendExitCommand(sock, pdu, log);
 
 	this_thread::sleep_for(chrono::milliseconds(100));
 	recvThread.join();
 	close(sock);
 
+	{
+		lock_guard<mutex> lock(g_simResults.resultsMutex);
+		(slowReader ? g_simResults.slowDeliveryUs : g_simResults.healthyDeliveryUs).merge(deliveryLatency);
+		(slowReader ? g_simResults.slowSendUs : g_simResults.healthySendUs).merge(sendLatency);
+		g_simResults.nlpCache.add(NLPModel::threadCacheStats());
+	}
+
 	cout << handle << " simulation complete." << endl;
-	logFile << handle << " simulation complete." << endl;
+	log.line(handle + " simulation complete.");
+	log.flush();
+	g_simLogSink.closeChannel(logChannel);
 }
 
 int main(int argc, char *argv[])
@@ -310,19 +551,23 @@ int main(int argc, char *argv[])
 	signal(SIGPIPE, SIG_IGN);
 
 	// Check for simulation mode: if extra arguments "--simulate" and number are provided.
+	// Usage: cclient <handle> <server> <port> --simulate <clients> [scenario options]
 	bool simulationMode = false;
-	int numClients = 0;
+	SimulationConfig simConfig;
 
-	if (argc == 6 && std::string(argv[4]) == "--simulate")
+	if (argc >= 6 && std::string(argv[4]) == "--simulate")
 	{
 		simulationMode = true;
-		numClients = atoi(argv[5]);
+		simConfig.numClients = atoi(argv[5]);
+		if (!parseSimulationOptions(argc, argv, 6, simConfig))
+			exit(1);
 	}
 
 	if (simulationMode)
 	{
 		// Build a list of simulated handles for all clients in lowercase.
 		vector<std::string> simHandles;
+		int numClients = simConfig.numClients;
 
 		for (int i = 0; i < numClients; i++)
 		{
@@ -334,37 +579,35 @@ int main(int argc, char *argv[])
 
 		std::string server = argv[2];
 		int port = atoi(argv[3]);
-		std::vector<std::thread> clients;
-		// For simulation, have each client send, say, 30 messages.
-		int totalMessages = 30;
-
-		for (int i = 0; i < numClients; i++)
-		{
-			clients.push_back(std::thread(simulateClient, i, server, port, totalMessages, simHandles));
-		}
 
-		for (auto &t : clients)
-			t.join();
+		if (simConfig.workers > 1)
+			return runSimulationCoordinator(server, port, simConfig, simHandles);
 
+		auto simStart = chrono::steady_clock::now();
+		runSimulatedClients(server, port, simConfig, simHandles, 0, numClients, -1, -1);
+		printSimulationReport(simConfig, chrono::duration<double>(chrono::steady_clock::now() - simStart).count());
 		return 0;
 	}
 
+	// Batch mode: cclient <handle> <server> <port> --batch [file|-]
+	if ((argc == 5 || argc == 6) && std::string(argv[4]) == "--batch")
+	{
+		if (!validHandle(argv[1]))
+			exit(1);
+		return runBatch(argv[2], atoi(argv[3]), argv[1], argc == 6 ? argv[5] : "-");
+	}
+
 	LOG_DEBUG("Client active socket (g_socketNum): " << g_socketNum);
 
 	system("clear");
-	checkArgs(argc, argv);
+	string dictionaryPath, intentModelPath;
+	int redrawMs = 0, maxFrameMessages = 0;
+	checkArgs(argc, argv, dictionaryPath, intentModelPath, redrawMs, maxFrameMessages);
+	g_frame.setMinRedrawInterval(redrawMs);
+	g_frame.setMaxMessages(maxFrameMessages);
 
-	// Additional check: ensure the handle begins with a letter.
-	if (!isalpha(argv[1][0]))
-	{
-		LOG_ERROR("Handle must start with a letter.");
-		exit(1);
-	}
-	if (strlen(argv[1]) > MAX_NAME_LEN)
-	{
-		LOG_ERROR("Handle exceeds maximum allowed length of " << MAX_NAME_LEN);
+	if (!validHandle(argv[1]))
 		exit(1);
-	}
 
 	// Store the client's handle globally.
 	g_clientHandle = argv[1];
@@ -381,6 +624,9 @@ int main(int argc, char *argv[])
 	}
 	LOG_INFO("Connected to server on socket " << g_socketNum);
 
+	if (!g_server.attach(g_socketNum))
+		exit(1);
+
 	// Add STDIN and the socket to the poll set.
 	addToPollSet(STDIN_FILENO);
 	addToPollSet(g_socketNum);
@@ -388,620 +634,1240 @@ int main(int argc, char *argv[])
 	// Register with the server using the client handle.
 	LOG_DEBUG("Calling connection_setup(...) to register handle once.");
 	connection_setup(g_socketNum, g_clientHandle.c_str());
-	LOG_DEBUG("Registration packet sent to server.");
+	flushOutbound();
+	LOG_DEBUG("Registration packet queued for the server.");
 
 	char inputBuffer[MAXBUF] = {0};
 
-	NLPProcessor nlp; // Create an NLPProcessor instance (could also be created on-demand).
+	// Optional word list for fuzzy correction of misspelled commands and
+	// trained intent model (mapped once here, shared read-only from then on).
+	shared_ptr<const NLPModel> nlpModel = NLPModel::create(dictionaryPath, intentModelPath);
+	if (!nlpModel)
+		exit(1);
+
+	// Natural-language lines are translated on a worker thread; its results
+	// wake this loop through their own descriptor in the poll set.
+	NLPWorker nlp(nlpModel);
+	if (!nlp.start())
+		exit(1);
+	addToPollSet(nlp.getResultFd());
 
-	// Asynchronous loop: poll for events on STDIN or the socket.
-	while (true)
+	// Asynchronous loop: poll for events on STDIN, the socket or NLP results.
+	// After %E only the socket is watched, until the server acknowledges.
+	bool exiting = false;
+	while (!g_exitAcknowledged)
 	{
-		int ready_fd = pollCall(-1); // Blocks until an event occurs.
+		// Blocks until an event occurs, or until a held-back frame is due.
+		int ready_fd = pollCall(g_frame.msUntilRedraw());
 		LOG_DEBUG("pollCall returned FD: " << ready_fd);
 
 		if (ready_fd == STDIN_FILENO)
 		{
-			// Print a prompt here so the user knows to type a command.
-			cout << "$: ";
+			// Show what arrived before the prompt and the command's own output.
+			g_frame.render(true);
+
+			// Print a prompt here so the user knows to type a command,
+			// with whatever is still waiting to be sent.
+			if (g_server.hasPendingOutput())
+				cout << "$ [" << g_server.pendingOutputBytes() << " bytes queued]: ";
+			else
+				cout << "$: ";
 			cout.flush();
 
 			int len = readFromStdin(inputBuffer);
 
 			if (len <= 0)
+			{
+				// At end of input stop watching stdin rather than spin on it.
+				if (feof(stdin))
+					removeFromPollSet(STDIN_FILENO);
 				continue;
+			}
 
 			// If the input does not start with '%', assume natural language.
+			// A strict command waits behind any line still being translated.
+			bool queued = true;
 			if (inputBuffer[0] != '%')
+				queued = nlp.submit(inputBuffer);
+			else if (nlp.getPending() > 0)
+				queued = nlp.submitPassthrough(inputBuffer);
+			else
+				exiting = runCommand(inputBuffer, false);
+
+			if (!queued)
+				cout << "Error: Too many commands waiting for translation; please retry." << endl;
+		}
+		else if (ready_fd == nlp.getResultFd())
+		{
+			g_frame.render(true);
+			NLPWorker::Result result;
+			while (!exiting && nlp.poll(result))
+				exiting = runCommand(result.output.c_str(), result.translated);
+		}
+		else if (ready_fd == g_socketNum)
+		{
+			// POLLOUT is handled by the flush below; read only when there is input.
+			if (getPollEvents(g_socketNum) & (POLLIN | POLLHUP | POLLERR))
 			{
-				// Process using NLP to convert into a structured command.
-				string structuredCommand = nlp.processMessage(inputBuffer);
-
-				// Display the converted structured command.
-				cout << "Converted command: " << structuredCommand << endl;
-
-				// If the NLP module returns an error message, display it.
-				if (structuredCommand.find("Error:") == 0)
-				{
-					cout << structuredCommand << endl;
-					continue;
-				}
-				else
-				{
-					// For debugging, show the structured command.
-					LOG_DEBUG("NLP converted input to: " << structuredCommand);
-					// Now, process the structured command as if the user had typed it.
-					if (strncasecmp(structuredCommand.c_str(), CMD_MESSAGE, strlen(CMD_MESSAGE)) == 0)
-					{
-						handleMessageCommand(g_socketNum, structuredCommand.c_str());
-					}
-					else if (strncasecmp(structuredCommand.c_str(), CMD_BROADCAST, strlen(CMD_BROADCAST)) == 0)
-					{
-						handleBroadcastCommand(g_socketNum, structuredCommand.c_str());
-					}
-					else if (strncasecmp(structuredCommand.c_str(), CMD_LIST, strlen(CMD_LIST)) == 0)
-					{
-						handleListCommand(g_socketNum);
-					}
-					else if (strncasecmp(structuredCommand.c_str(), CMD_CURRENT_CONNECTION_STATUS, strlen(CMD_CURRENT_CONNECTION_STATUS)) == 0)
-					{
-						connStats.printStats();
-					}
-					else if (strncasecmp(structuredCommand.c_str(), CMD_EXIT, strlen(CMD_EXIT)) == 0)
-					{
-						handleExitCommand(g_socketNum);
-						break;
-					}
-					else
-					{
-						cout << "Unknown structured command: " << structuredCommand << endl;
-					}
-				}
-			}
-			else // If input starts with '%', process as a strict command.
-			{
-				if (strncasecmp(inputBuffer, CMD_MESSAGE, strlen(CMD_MESSAGE)) == 0)
-				{
-					LOG_DEBUG("User typed %M command");
-					handleMessageCommand(g_socketNum, inputBuffer);
-				}
-				else if (strncasecmp(inputBuffer, CMD_BROADCAST, strlen(CMD_BROADCAST)) == 0)
-				{
-					LOG_DEBUG("User typed %B command");
-					handleBroadcastCommand(g_socketNum, inputBuffer);
-				}
-				else if (strncasecmp(inputBuffer, CMD_LIST, strlen(CMD_LIST)) == 0)
-				{
-					LOG_DEBUG("User typed %L command");
-					handleListCommand(g_socketNum);
-				}
-				else if (strncasecmp(inputBuffer, CMD_CURRENT_CONNECTION_STATUS, strlen(CMD_CURRENT_CONNECTION_STATUS)) == 0)
-				{
-					connStats.printStats();
-				}
-				else if (strncasecmp(inputBuffer, CMD_EXIT, strlen(CMD_EXIT)) == 0)
-				{
-					LOG_DEBUG("User typed %E command");
-					handleExitCommand(g_socketNum);
-					break;
-				}
-				else
-				{
-					cout << "Invalid command" << endl;
-				}
+				LOG_DEBUG("Processing incoming data on socket: " << g_socketNum);
+				// Process every packet the server has sent so far.
+				processIncomingPackets();
+
+				// A finished %L list also teaches the NLP module the current handles.
+				vector<string> listedHandles;
+				if (takeFinishedList(listedHandles) && !nlp.setKnownHandles(listedHandles))
+					LOG_ERROR("NLP queue full; known handles not updated.");
 			}
 		}
-		else if (ready_fd == g_socketNum)
+
+		// Send what the socket takes now; POLLOUT wakes us for the rest.
+		flushOutbound();
+
+		// Draw this iteration's output, unless the redraw rate holds it back.
+		g_frame.render();
+
+		if (exiting)
 		{
-			LOG_DEBUG("Processing incoming data on socket: " << g_socketNum);
-			// Process incoming packet from the server.
-			processIncomingPacket(g_socketNum);
+			removeFromPollSet(STDIN_FILENO);
+			removeFromPollSet(nlp.getResultFd());
 		}
 	}
+	g_frame.render(true);
+	nlp.stop();
 	close(g_socketNum);
 	return 0;
 }
 
 // ---------------------------------------------------------------------------
-// Reads a line from STDIN into buffer. Returns the length (excluding newline).
+// Runs one command line: a strict "%X ..." command typed by the user, or the
+// output of the NLP worker (translated == true), which may also be an error
+// or a clarifying prompt. Returns true when the client should exit.
 // ---------------------------------------------------------------------------
-int readFromStdin(char *buffer)
+bool runCommand(const char *command, bool translated)
 {
-	if (fgets(buffer, MAXBUF, stdin) == nullptr)
-		return 0;
+	if (translated)
+	{
+		// Display the converted structured command.
+		cout << "Converted command: " << command << endl;
 
-	size_t len = strlen(buffer);
-	if (len > 0 && buffer[len - 1] == '\n')
+		// If the NLP module returns an error message or a prompt, stop here.
+		if (strncmp(command, "Error:", 6) == 0)
+		{
+			cout << command << endl;
+			return false;
+		}
+		// For debugging, show the structured command.
+		LOG_DEBUG("NLP converted input to: " << command);
+	}
+
+	if (strncasecmp(command, CMD_MESSAGE, strlen(CMD_MESSAGE)) == 0)
 	{
-		buffer[len - 1] = '\0';
-		len--;
+		LOG_DEBUG("Running %M command");
+		handleMessageCommand(g_socketNum, command);
 	}
-	return static_cast<int>(len);
+	else if (strncasecmp(command, CMD_BROADCAST, strlen(CMD_BROADCAST)) == 0)
+	{
+		LOG_DEBUG("Running %B command");
+		handleBroadcastCommand(g_socketNum, command);
+	}
+	else if (strncasecmp(command, CMD_LIST, strlen(CMD_LIST)) == 0)
+	{
+		LOG_DEBUG("Running %L command");
+		handleListCommand(g_socketNum);
+	}
+	else if (strncasecmp(command, CMD_CURRENT_CONNECTION_STATUS, strlen(CMD_CURRENT_CONNECTION_STATUS)) == 0)
+	{
+		connStats.printStats();
+		cout << "Handle directory: " << g_directory.onlineCount() << " online, " << g_directory.unknownCount()
+			 << " unknown, " << g_directory.getCompleted() << " completed, " << g_directory.getSuppressed()
+			 << " sends suppressed" << (g_directory.isFresh() ? "" : " (list stale; %L refreshes it)") << endl;
+	}
+	else if (strncasecmp(command, CMD_EXIT, strlen(CMD_EXIT)) == 0)
+	{
+		LOG_DEBUG("Running %E command");
+		handleExitCommand(g_socketNum);
+		return true;
+	}
+	else if (translated)
+	{
+		cout << "Unknown structured command: " << command << endl;
+	}
+	else
+	{
+		cout << "Invalid command" << endl;
+	}
+	return false;
 }
 
 // ---------------------------------------------------------------------------
-// Checks command-line arguments.
+// Parses the scenario options that follow "--simulate <clients>":
+//   --messages <n>         messages sent by each client (default 30)
+//   --slow-fraction <f>    fraction of clients that are slow readers (0.0 - 1.0)
+//   --slow-mode stop|trickle
+//   --trickle-ms <ms>      delay between reads for trickle readers (default 200)
+//   --slow-rcvbuf <bytes>  receive buffer for slow readers (default 4096)
+//   --report-file <path>   append a CSV summary row for tracking over time
+//   --log-format text|binary|none  format of the per-client logs (default text)
+//   --workers <n>          split the clients over n worker processes
 // ---------------------------------------------------------------------------
-void checkArgs(int argc, char *argv[])
+bool parseSimulationOptions(int argc, char *argv[], int firstOption, SimulationConfig &config)
 {
-	if (argc != 4)
+	for (int i = firstOption; i < argc; i++)
 	{
-		LOG_ERROR("Usage: cclient [handle] [server-name] [server-port]");
-		exit(1);
+		string arg(argv[i]);
+		bool hasValue = (i + 1 < argc);
+
+		if (arg == "--messages" && hasValue)
+			config.totalMessages = atoi(argv[++i]);
+		else if (arg == "--slow-fraction" && hasValue)
+			config.slowFraction = atof(argv[++i]);
+		else if (arg == "--slow-mode" && hasValue)
+		{
+			string mode(argv[++i]);
+			if (mode == "stop")
+				config.slowMode = SLOW_READER_STOP;
+			else if (mode == "trickle")
+				config.slowMode = SLOW_READER_TRICKLE;
+			else
+			{
+				LOG_ERROR("Unknown slow reader mode: " << mode << " (expected stop or trickle)");
+				return false;
+			}
+		}
+		else if (arg == "--trickle-ms" && hasValue)
+			config.trickleMs = atoi(argv[++i]);
+		else if (arg == "--slow-rcvbuf" && hasValue)
+			config.slowReceiveBuffer = atoi(argv[++i]);
+		else if (arg == "--report-file" && hasValue)
+			config.reportFile = argv[++i];
+		else if (arg == "--workers" && hasValue)
+			config.workers = atoi(argv[++i]);
+		else if (arg == "--log-format" && hasValue)
+		{
+			string format(argv[++i]);
+			if (format == "text")
+				config.logFormat = LOG_FORMAT_TEXT;
+			else if (format == "binary")
+				config.logFormat = LOG_FORMAT_BINARY;
+			else if (format == "none")
+				config.logFormat = LOG_FORMAT_NONE;
+			else
+			{
+				LOG_ERROR("Unknown log format: " << format << " (expected text, binary or none)");
+				return false;
+			}
+		}
+		else
+		{
+			LOG_ERROR("Unknown simulation option: " << arg);
+			LOG_ERROR("Usage: cclient <handle> <server> <port> --simulate <clients> [--messages n] [--slow-fraction f] "
+					  "[--slow-mode stop|trickle] [--trickle-ms ms] [--slow-rcvbuf bytes] [--report-file path] "
+					  "[--log-format text|binary|none] [--workers n]");
+			return false;
+		}
+	}
+
+	if (config.numClients < 2 || config.totalMessages < 0 || config.slowFraction < 0.0 ||
+		config.slowFraction > 1.0 || config.trickleMs < 0 || config.slowReceiveBuffer <= 0 ||
+		config.workers < 1 || config.workers > config.numClients)
+	{
+		LOG_ERROR("Invalid simulation options (need >= 2 clients, a slow fraction between 0 and 1 and at most one worker per client).");
+		return false;
 	}
+	return true;
 }
 
 // ---------------------------------------------------------------------------
-// Sends the initial connection (registration) packet with the client handle.
+// Runs simulated clients [firstClient, lastClient) in this process, one thread each.
+// In a worker process releaseFd/resultFd are the pipes to the coordinator: the
+// "everyone finished sending" point is then global across all workers, and the
+// result histograms are written back instead of being printed.
 // ---------------------------------------------------------------------------
-void connection_setup(int socketNum, const char *handle)
+void runSimulatedClients(const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles, int firstClient, int lastClient, int releaseFd, int resultFd)
 {
-	LOG_DEBUG("connection_setup: Using socket " << socketNum << " to send registration packet.");
+	bool isWorker = (resultFd >= 0);
+	vector<thread> clients;
 
-	PDU_Send_And_Recv pdu;
-
-	uint8_t buffer[MAXBUF] = {0};
-	uint8_t nameLength = static_cast<uint8_t>(strlen(handle));
+	// A worker holds one extra sender slot until the coordinator releases it.
+	g_sendersRemaining = (lastClient - firstClient) + (isWorker ? 1 : 0);
+	g_simLogSink.start(config.logFormat);
 
-	// Build payload: [1 byte handle length][handle chars]
-	buffer[0] = nameLength;
-	memcpy(buffer + 1, handle, nameLength);
-
-	uint16_t payload_len = 1 + nameLength;
+	thread barrier;
+	if (isWorker)
+	{
+		barrier = thread([releaseFd, resultFd]() {
+			while (g_sendersRemaining.load() > 1)
+				this_thread::sleep_for(chrono::milliseconds(10));
+			char message = WORKER_MSG_DONE_SENDING;
+			if (write(resultFd, &message, 1) != 1 || read(releaseFd, &message, 1) != 1)
+				LOG_ERROR("Lost the coordinator; releasing local clients.");
+			g_sendersRemaining--;
+		});
+	}
 
-	LOG_DEBUG("Sending registration packet: flag=" << CLIENT_INIT_PACKET_TO_SERVER
-												   << ", payload_len=" << payload_len
-												   << ", handle=" << handle);
+	for (int i = firstClient; i < lastClient; i++)
+	{
+		clients.push_back(thread(simulateClient, i, server, port, cref(config), cref(simHandles)));
+	}
 
-	// Optional hex dump for debugging:
-	LOG_DEBUG("Registration packet payload hex dump: "
-			  << hexDump(buffer, payload_len));
+	for (auto &t : clients)
+		t.join();
+	if (barrier.joinable())
+		barrier.join();
+	g_simLogSink.stop();
 
-	// Send the registration packet and record statistics.
-	int bytesSent = pdu.sendBuf(socketNum, buffer, payload_len, CLIENT_INIT_PACKET_TO_SERVER);
-	connStats.recordSent(bytesSent);
-	connStats.recordMessageSent();
+	if (isWorker)
+	{
+		lock_guard<mutex> lock(g_simResults.resultsMutex);
+		char message = WORKER_MSG_RESULTS;
+		if (write(resultFd, &message, 1) != 1 ||
+			!g_simResults.healthyDeliveryUs.writeTo(resultFd) || !g_simResults.slowDeliveryUs.writeTo(resultFd) ||
+			!g_simResults.healthySendUs.writeTo(resultFd) || !g_simResults.slowSendUs.writeTo(resultFd) ||
+			write(resultFd, &g_simResults.nlpCache, sizeof(ResponseCache::Stats)) != sizeof(ResponseCache::Stats))
+		{
+			LOG_ERROR("Failed to send results to the coordinator.");
+		}
+	}
 }
 
-// ---------------------------------------------------------------------------
-// Processes incoming packets from the server and displays messages or errors.
-// ---------------------------------------------------------------------------
-void processIncomingPacket(int socketNum)
+// Reads exactly length bytes from fd. Returns false on EOF or error.
+static bool readFully(int fd, void *data, size_t length)
 {
-	LOG_DEBUG("processIncomingPacket: Receiving data on socket " << socketNum);
-
-	PDU_Send_And_Recv pdu;
-	uint8_t dataBuffer[MAXBUF] = {0};
-	int flag;
-	int len = pdu.recvBuf(socketNum, dataBuffer, &flag);
-
-	// Instead of assuming the header is 3 bytes, use SIZE_CHAT_HEADER.
-	const int headerSize = SIZE_CHAT_HEADER; // Defined in PDU_Send_And_Recv.h
-
-	if (len >= 0)
+	uint8_t *p = static_cast<uint8_t *>(data);
+	while (length > 0)
 	{
-		connStats.recordReceived(len + headerSize);
-		if (flag == MESSAGE_PACKET || flag == BROADCAST_PACKET)
-			connStats.recordMessageReceived();
+		ssize_t n = read(fd, p, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		length -= n;
 	}
+	return true;
+}
 
-	// Log the flag both as a number and as a string with its description.
-	LOG_DEBUG("Received packet from server: flag="
-			  << flag << " (" << chatFlagToString(flag) << ") - " << chatFlagDescription(flag)
-			  << ", len=" << len
-			  << ", hex=" << hexDump(dataBuffer, (len < 16 ? len : 16)) << "...");
+// Reads one message byte from a worker. Returns false if the worker went away.
+static bool readWorkerMessage(WorkerProcess &worker, char expected)
+{
+	char message = 0;
+	ssize_t n;
+	do
+	{
+		n = read(worker.resultFd, &message, 1);
+	} while (n < 0 && errno == EINTR);
 
-	if (len == -1)
+	if (n != 1 || message != expected)
 	{
-		cout << "Server terminated connection." << endl;
-		exit(1);
+		LOG_ERROR("Worker " << worker.pid << " (clients " << worker.firstClient << "-" << worker.lastClient - 1
+							<< ") exited early.");
+		worker.alive = false;
+		return false;
 	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Coordinator: forks config.workers processes, gives each a contiguous slice
+// of the simulated handles, and merges their histograms into one report.
+// Must run before any thread is started (fork only copies the calling thread).
+// ---------------------------------------------------------------------------
+int runSimulationCoordinator(const string &server, int port, const SimulationConfig &config, const vector<string> &simHandles)
+{
+	vector<WorkerProcess> workers(config.workers);
+	auto simStart = chrono::steady_clock::now();
 
-	// If we received a valid packet with zero-length payload...
-	if (len == VALID_ZERO_PAYLOAD)
+	for (int w = 0; w < config.workers; w++)
 	{
-		if (flag == CONFIRM_GOOD_HANDLE)
-		{
-			cout << "Registration confirmed by server." << endl;
-		}
-		else
+		WorkerProcess &worker = workers[w];
+		worker.firstClient = static_cast<int>(static_cast<long>(config.numClients) * w / config.workers);
+		worker.lastClient = static_cast<int>(static_cast<long>(config.numClients) * (w + 1) / config.workers);
+
+		int resultPipe[2];
+		int releasePipe[2];
+		if (pipe(resultPipe) < 0 || pipe(releasePipe) < 0)
 		{
-			LOG_DEBUG("Received valid zero-length payload with flag=" << flag);
+			perror("pipe");
+			exit(1);
 		}
-		// No further processing needed for this packet.
-		return;
-	}
 
-	// Process based on the flag.
-	if (flag == MESSAGE_PACKET || flag == BROADCAST_PACKET)
-	{
-		// Format: [1 byte sender handle length][sender handle][text message (null terminated)]
-		if (len < 2)
+		cout.flush();
+		pid_t pid = fork();
+		if (pid < 0)
 		{
-			LOG_ERROR("Invalid message/broadcast packet: too short");
-			return;
+			perror("fork");
+			exit(1);
 		}
-
-		uint8_t senderLen = dataBuffer[0];
-
-		if (senderLen + 1 > (uint8_t)len)
+		if (pid == 0)
 		{
-			LOG_ERROR("Sender length exceeds packet length");
-			return;
+			// Worker: close every coordinator-side descriptor, run the slice, exit.
+			for (int other = 0; other < w; other++)
+			{
+				close(workers[other].resultFd);
+				close(workers[other].releaseFd);
+			}
+			close(resultPipe[0]);
+			close(releasePipe[1]);
+			runSimulatedClients(server, port, config, simHandles, worker.firstClient, worker.lastClient, releasePipe[0], resultPipe[1]);
+			_exit(0);
 		}
 
-		char sender[MAX_NAME_LEN + 1] = {0};
-
-		memcpy(sender, dataBuffer + 1, senderLen);
-		sender[senderLen] = '\0';
-
-		const char *message = (const char *)(dataBuffer + 1 + senderLen);
-
-		cout << sender << ": " << message << endl;
+		close(resultPipe[1]);
+		close(releasePipe[0]);
+		worker.pid = pid;
+		worker.resultFd = resultPipe[0];
+		worker.releaseFd = releasePipe[1];
+		cout << "Started worker " << pid << " for clients " << worker.firstClient << "-" << worker.lastClient - 1 << endl;
 	}
-	else if (flag == LIST_RESPONSE_NUM || flag == LIST_RESPONSE_HANDLE || flag == LIST_RESPONSE_END)
+
+	// Release every worker once all of them have finished sending.
+	for (auto &worker : workers)
+		readWorkerMessage(worker, WORKER_MSG_DONE_SENDING);
+	for (auto &worker : workers)
 	{
-		// %L command responses are handled in handleListCommand(), so you might ignore them here.
-		LOG_DEBUG("Received a list response packet (flag=" << flag << ").");
+		char message = WORKER_MSG_RELEASE;
+		if (worker.alive && write(worker.releaseFd, &message, 1) != 1)
+			worker.alive = false;
 	}
-	else if (flag == 7)
+
+	// Merge the worker histograms exactly (bucket counts add).
+	int failedWorkers = 0;
+	for (auto &worker : workers)
 	{
-		// Error packet for non-existent destination.
-		if (len < 2)
+		LatencyHistogram healthyDelivery, slowDelivery, healthySend, slowSend;
+		ResponseCache::Stats nlpCache;
+		if (!worker.alive || !readWorkerMessage(worker, WORKER_MSG_RESULTS) ||
+			!healthyDelivery.readFrom(worker.resultFd) || !slowDelivery.readFrom(worker.resultFd) ||
+			!healthySend.readFrom(worker.resultFd) || !slowSend.readFrom(worker.resultFd) ||
+			!readFully(worker.resultFd, &nlpCache, sizeof(nlpCache)))
 		{
-			LOG_ERROR("Invalid error packet: too short for handle length");
-			return;
+			failedWorkers++;
 		}
-
-		uint8_t destLen = dataBuffer[0];
-
-		if (1 + destLen > (uint8_t)len)
+		else
 		{
-			LOG_ERROR("Destination handle length exceeds packet length");
-			return;
+			g_simResults.healthyDeliveryUs.merge(healthyDelivery);
+			g_simResults.slowDeliveryUs.merge(slowDelivery);
+			g_simResults.healthySendUs.merge(healthySend);
+			g_simResults.slowSendUs.merge(slowSend);
+			g_simResults.nlpCache.add(nlpCache);
 		}
+		close(worker.resultFd);
+		close(worker.releaseFd);
+		waitpid(worker.pid, nullptr, 0);
+	}
 
-		char dest[MAX_NAME_LEN + 1] = {0};
-		memcpy(dest, dataBuffer + 1, destLen);
-		dest[destLen] = '\0';
+	if (failedWorkers > 0)
+		LOG_ERROR(failedWorkers << " of " << config.workers << " workers did not report results; the report is partial.");
 
-		cout << "Error: Client with handle " << dest << " does not exist." << endl;
-	}
-	else if (flag == 9)
-	{ // ACK for exit.
-		cout << "Exit ACK received." << endl;
-	}
-	else
-	{
-		LOG_DEBUG("Received an unrecognized flag from server: " << flag);
-		cout << "Received packet with flag " << flag << endl;
-	}
+	cout << "Merged results from " << config.workers - failedWorkers << " worker processes." << endl;
+	printSimulationReport(config, chrono::duration<double>(chrono::steady_clock::now() - simStart).count());
+	return failedWorkers > 0 ? 1 : 0;
 }
 
 // ---------------------------------------------------------------------------
-// Handles the %M command (send message to specific clients).
-// Expected format: %M <num-handles> <destHandle1> [destHandle2 ...] <message>
+// Prints the slow-consumer report and optionally appends it to the CSV report file.
 // ---------------------------------------------------------------------------
-void handleMessageCommand(int socketNum, const char *input)
+void printSimulationReport(const SimulationConfig &config, double elapsedSeconds)
 {
-	char temp[MAXBUF];
-	strncpy(temp, input, MAXBUF);
-	temp[MAXBUF - 1] = '\0';
+	lock_guard<mutex> lock(g_simResults.resultsMutex);
+	int slowCount = static_cast<int>(config.slowFraction * config.numClients + 0.5);
+	const char *modeName = (config.slowMode == SLOW_READER_STOP) ? "stop" : "trickle";
+
+	cout << "===========================================================" << endl;
+	cout << dec << "Simulation report: " << config.numClients << " clients, " << slowCount << " slow readers ("
+		 << modeName << "), " << config.totalMessages << " messages each, " << elapsedSeconds << " s" << endl;
+	g_simResults.healthyDeliveryUs.printSummary("healthy delivery latency", "us");
+	g_simResults.slowDeliveryUs.printSummary("slow-reader delivery latency", "us");
+	g_simResults.healthySendUs.printSummary("healthy send time", "us");
+	g_simResults.slowSendUs.printSummary("slow-reader send time", "us");
+	const ResponseCache::Stats &cache = g_simResults.nlpCache;
+	cout << "NLP cache: " << cache.hits << " hits / " << cache.lookups << " lookups (" << 100.0 * cache.hitRate()
+		 << "%), " << cache.evictions << " evictions" << endl;
+	if (config.workers == 1)
+		cout << "Log sink: " << g_simLogSink.getBytesWritten() << " bytes in " << g_simLogSink.getWriteBatches() << " write batches" << endl;
+	cout << "===========================================================" << endl;
+
+	if (config.reportFile.empty())
+		return;
 
-	// Tokenize the input.
-	char *token = strtok(temp, " "); // Should be "%M"
-	token = strtok(nullptr, " ");	 // Number of destination handles.
+	ifstream existing(config.reportFile.c_str());
+	bool writeHeader = !existing.good() || existing.peek() == ifstream::traits_type::eof();
+	existing.close();
 
-	if (token == nullptr)
+	ofstream report(config.reportFile.c_str(), ios::app);
+	if (!report)
 	{
-		cout << "Invalid %M command format" << endl;
+		LOG_ERROR("Unable to open report file " << config.reportFile);
 		return;
 	}
+	if (writeHeader)
+	{
+		report << "unix_time,clients,slow_readers,slow_mode,trickle_ms,messages,elapsed_s,"
+			   << "healthy_n,healthy_p50_us,healthy_p99_us,healthy_max_us,"
+			   << "slow_n,slow_p50_us,slow_p99_us,slow_max_us,healthy_send_p99_us\n";
+	}
+	report << chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count() << ","
+		   << config.numClients << "," << slowCount << "," << modeName << "," << config.trickleMs << ","
+		   << config.totalMessages << "," << elapsedSeconds << ","
+		   << g_simResults.healthyDeliveryUs.getCount() << "," << g_simResults.healthyDeliveryUs.percentile(0.50) << ","
+		   << g_simResults.healthyDeliveryUs.percentile(0.99) << "," << g_simResults.healthyDeliveryUs.getMax() << ","
+		   << g_simResults.slowDeliveryUs.getCount() << "," << g_simResults.slowDeliveryUs.percentile(0.50) << ","
+		   << g_simResults.slowDeliveryUs.percentile(0.99) << "," << g_simResults.slowDeliveryUs.getMax() << ","
+		   << g_simResults.healthySendUs.percentile(0.99) << "\n";
+}
 
-	int numHandles = atoi(token);
-	LOG_DEBUG("handleMessageCommand: numHandles=" << numHandles);
+// ---------------------------------------------------------------------------
+// Batch mode: strict %M/%B/%L/%E lines from a file (or stdin for "-") are read
+// in large chunks, parsed in place and queued back to back, with no prompt,
+// NLP translation or per-line debug output. The queue is written as the
+// socket accepts it while replies are drained and counted. At end of input an
+// exit is queued; the server acknowledges it only after every command before
+// it, so the throughput report covers the whole run.
+// ---------------------------------------------------------------------------
 
-	if (numHandles < 1 || numHandles > 9)
+// Input is read this many bytes at a time; a longer line is rejected.
+#define BATCH_READ_CHUNK (64 * 1024)
+
+// Input is not read while this much output waits for the socket.
+#define BATCH_MAX_QUEUED (1024 * 1024)
+
+struct BatchStats
+{
+	uint64_t lines = 0;				  // Input lines, including blank and comment lines.
+	uint64_t commands = 0;			  // %M, %B and %L lines queued.
+	uint64_t rejected = 0;			  // Lines that are not a valid strict command.
+	uint64_t bytesSent = 0;			  // Bytes written to the socket.
+	uint64_t messagesReceived = 0;	  // %M and %B packets from other clients.
+	uint64_t listsReceived = 0;		  // Complete %L replies.
+	uint64_t unknownDestinations = 0; // ERROR_INVALID_DESTINATION replies.
+};
+
+enum BatchLineResult
+{
+	BATCH_SKIPPED,	// Blank or '#' comment line.
+	BATCH_QUEUED,
+	BATCH_REJECTED,
+	BATCH_EXIT		// %E: ends the input.
+};
+
+// Returns the length of the next space-separated token in [position, end)
+// and moves position just past it; 0 at the end of the line.
+static size_t nextBatchToken(const char *&position, const char *end, const char **token)
+{
+	while (position < end && *position == ' ')
+		position++;
+	*token = position;
+	while (position < end && *position != ' ')
+		position++;
+	return position - *token;
+}
+
+// Parses one NUL-terminated line of [line, end) and queues its packets on out.
+// Destination handles are used where they lie in the line, and the text goes
+// from one space after the last token to the end of the line, as in the
+// interactive commands.
+static BatchLineResult queueBatchLine(PDU_Stream &out, const string &handle, const char *line, const char *end)
+{
+	const char *position = line;
+	const char *command;
+	size_t commandLength = nextBatchToken(position, end, &command);
+	if (commandLength == 0 || command[0] == '#')
+		return BATCH_SKIPPED;
+	if (commandLength != 2 || command[0] != '%')
+		return BATCH_REJECTED;
+
+	char type = toupper(static_cast<unsigned char>(command[1]));
+	if (type == 'L')
 	{
-		cout << "Invalid number of destination handles" << endl;
-		return;
+		out.queue(CLIENT_TO_SERVER_LIST_OF_HANDLES, nullptr, 0);
+		return BATCH_QUEUED;
 	}
+	if (type == 'E')
+		return BATCH_EXIT;
 
-	// Collect destination handles.
-	char desHandles[10][MAX_NAME_LEN];
-	for (int i = 0; i < numHandles; i++)
+	uint8_t routingHeader[MAXBUF - MAX_TEXT_PER_PACKET];
+	size_t headerSize = 0;
+	int flag;
+	if (type == 'M')
 	{
-		token = strtok(nullptr, " ");
-		if (token == nullptr)
+		const char *token;
+		if (nextBatchToken(position, end, &token) == 0)
+			return BATCH_REJECTED;
+		int numHandles = atoi(token);
+		if (numHandles < 1 || numHandles > 9)
+			return BATCH_REJECTED;
+
+		PDU_Handle destinations[9];
+		for (int i = 0; i < numHandles; i++)
 		{
-			cout << "Insufficient destination handles" << endl;
-			return;
+			size_t tokenLength = nextBatchToken(position, end, &token);
+			if (tokenLength == 0 || tokenLength >= MAX_NAME_LEN)
+				return BATCH_REJECTED;
+			destinations[i] = PDU_Handle(token, static_cast<uint8_t>(tokenLength));
 		}
-		strncpy(desHandles[i], token, MAX_NAME_LEN);
-		desHandles[i][MAX_NAME_LEN - 1] = '\0';
+		headerSize = MessagePDU::buildHeader(routingHeader, sizeof(routingHeader), handle, destinations, destinations + numHandles);
+		flag = MESSAGE_PACKET;
 	}
+	else if (type == 'B')
+	{
+		headerSize = BroadcastPDU::buildHeader(routingHeader, sizeof(routingHeader), handle);
+		flag = BROADCAST_PACKET;
+	}
+	else
+	{
+		return BATCH_REJECTED;
+	}
+	if (headerSize == 0)
+		return BATCH_REJECTED;
 
-	// The rest of the input is the message text.
-	token = strtok(nullptr, "\n");
-	const char *message = (token != nullptr) ? token : "";
-
-	// Build the header portion of the payload.
-	// Format: [1 byte sender handle length][sender handle][1 byte num destinations]
-	// For each destination: [1 byte dest handle length][dest handle]
-	uint8_t headerPayload[MAXBUF];
-	int headerOffset = 0;
+	if (position < end)
+		position++; // The single space before the text.
+	out.queueSegments(flag, routingHeader, headerSize, position, end - position, MAX_TEXT_PER_PACKET - 1);
+	return BATCH_QUEUED;
+}
 
-	uint8_t senderLen = (uint8_t)g_clientHandle.length();
-	headerPayload[headerOffset++] = senderLen;
-	memcpy(headerPayload + headerOffset, g_clientHandle.c_str(), senderLen);
-	headerOffset += senderLen;
-	headerPayload[headerOffset++] = (uint8_t)numHandles;
+// Queues every complete line in data[0, length) and returns the bytes used;
+// with final set, a last line without '\n' counts too. Stops after %E.
+static size_t queueBatchLines(PDU_Stream &out, const string &handle, char *data, size_t length, bool final,
+							  BatchStats &stats, bool &exitRequested)
+{
+	size_t used = 0;
+	while (used < length && !exitRequested)
+	{
+		char *line = data + used;
+		char *newline = static_cast<char *>(memchr(line, '\n', length - used));
+		if (newline == nullptr && !final)
+			break;
+		char *end = (newline != nullptr) ? newline : data + length;
+		used = (newline != nullptr) ? end - data + 1 : length;
+		if (end > line && end[-1] == '\r')
+			end--;
+		*end = '\0'; // atoi() needs the line terminated.
+
+		stats.lines++;
+		switch (queueBatchLine(out, handle, line, end))
+		{
+		case BATCH_QUEUED:
+			stats.commands++;
+			break;
+		case BATCH_REJECTED:
+			stats.rejected++;
+			LOG_ERROR("Batch line " << stats.lines << ": not a valid %M, %B, %L or %E command.");
+			break;
+		case BATCH_EXIT:
+			exitRequested = true;
+			break;
+		case BATCH_SKIPPED:
+			break;
+		}
+	}
+	return used;
+}
 
-	for (int i = 0; i < numHandles; i++)
+// Runs batch mode; returns the process exit status.
+int runBatch(const string &server, int port, const string &handle, const char *inputPath)
+{
+	int inputFd = STDIN_FILENO;
+	if (strcmp(inputPath, "-") != 0)
 	{
-		uint8_t dLen = (uint8_t)strlen(desHandles[i]);
-		headerPayload[headerOffset++] = dLen;
-		memcpy(headerPayload + headerOffset, desHandles[i], dLen);
-		headerOffset += dLen;
+		inputFd = open(inputPath, O_RDONLY);
+		if (inputFd < 0)
+		{
+			perror(inputPath);
+			return 1;
+		}
 	}
 
-	int headerSize = headerOffset;
-	int messageLen = strlen(message);
-	int pos = 0;
-	const int MAX_SEGMENT = MAX_TEXT_PER_PACKET - 1;
+	int sock = connectToServer(server, port, handle);
+	PDU_Stream stream;
+	if (sock < 0 || !stream.attach(sock))
+		return 1;
+
+	uint8_t registration[1 + UINT8_MAX];
+	stream.queue(CLIENT_INIT_PACKET_TO_SERVER, registration, RegistrationPDU::build(registration, sizeof(registration), handle));
+
+	BatchStats stats;
+	// One byte more than a chunk so the last line can always be terminated.
+	vector<char> input(BATCH_READ_CHUNK + 1);
+	size_t inputUsed = 0;
+	bool inputOpen = true;
+	bool skippingLongLine = false;
+	bool exitQueued = false;
+	bool exitAcknowledged = false;
+	bool failed = false;
+	auto start = chrono::steady_clock::now();
+
+	while (!exitAcknowledged && !failed)
+	{
+		// Reading stops while the server is behind, so memory stays bounded.
+		bool readInput = inputOpen && stream.pendingOutputBytes() < BATCH_MAX_QUEUED;
+
+		pollfd fds[2];
+		fds[0].fd = sock;
+		fds[0].events = POLLIN | (stream.hasPendingOutput() ? POLLOUT : 0);
+		fds[0].revents = 0;
+		fds[1].fd = inputFd;
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+
+		if (poll(fds, readInput ? 2 : 1, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
 
-	PDU_Send_And_Recv pdu;
+		if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+		{
+			bool open = stream.fill();
+			int flag;
+			const uint8_t *payload;
+			uint16_t length;
+			while (stream.nextPDU(&flag, &payload, &length))
+			{
+				if (flag == MESSAGE_PACKET || flag == BROADCAST_PACKET)
+					stats.messagesReceived++;
+				else if (flag == LIST_RESPONSE_END)
+					stats.listsReceived++;
+				else if (flag == ERROR_INVALID_DESTINATION)
+					stats.unknownDestinations++;
+				else if (flag == EXIT_ACK)
+					exitAcknowledged = true;
+				else if (flag == ERROR_ON_INIT_PACKET)
+				{
+					LOG_ERROR("Handle " << handle << " is already in use.");
+					failed = true;
+				}
+			}
+			if (stream.isCorrupt() || (!open && !exitAcknowledged))
+			{
+				cout << "Server terminated connection." << endl;
+				failed = true;
+			}
+		}
 
-	// If no message, send a packet with just the header plus a '\0'.
-	if (messageLen == 0)
-	{
-		uint8_t packetPayload[MAXBUF];
-		memcpy(packetPayload, headerPayload, headerSize);
-		packetPayload[headerSize] = '\0';
+		if (readInput && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+		{
+			ssize_t bytes = read(inputFd, input.data() + inputUsed, BATCH_READ_CHUNK - inputUsed);
+			if (bytes < 0 && errno == EINTR)
+				continue;
+			if (bytes < 0)
+				perror("read batch input");
+			if (bytes <= 0)
+				inputOpen = false;
+			else
+				inputUsed += bytes;
+
+			bool exitRequested = false;
+			size_t used = 0;
+			if (skippingLongLine)
+			{
+				// Drop the rest of an overlong line up to its newline.
+				char *newline = static_cast<char *>(memchr(input.data(), '\n', inputUsed));
+				used = (newline != nullptr) ? newline - input.data() + 1 : inputUsed;
+				skippingLongLine = (newline == nullptr);
+			}
+			used += queueBatchLines(stream, handle, input.data() + used, inputUsed - used, !inputOpen, stats, exitRequested);
+			if (used == 0 && inputUsed == BATCH_READ_CHUNK)
+			{
+				stats.lines++;
+				stats.rejected++;
+				LOG_ERROR("Batch line " << stats.lines << ": longer than " << BATCH_READ_CHUNK << " bytes.");
+				used = inputUsed;
+				skippingLongLine = true;
+			}
+			memmove(input.data(), input.data() + used, inputUsed - used);
+			inputUsed -= used;
 
-		LOG_DEBUG("Sending empty message packet: flag=" << MESSAGE_PACKET
-														<< ", totalLen=" << (headerSize + 1));
-		LOG_DEBUG("Payload hex: " << hexDump(packetPayload, headerSize + 1));
+			if (exitRequested)
+				inputOpen = false;
+		}
 
-		pdu.sendBuf(socketNum, packetPayload, headerSize + 1, MESSAGE_PACKET);
-		return;
+		if (!inputOpen && !exitQueued)
+		{
+			stream.queue(CLIENT_TO_SERVER_EXIT, nullptr, 0);
+			exitQueued = true;
+		}
+
+		size_t pendingBefore = stream.pendingOutputBytes();
+		if (pendingBefore > 0 && !stream.flush())
+			failed = true;
+		stats.bytesSent += pendingBefore - stream.pendingOutputBytes();
 	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-	// Otherwise, segment the message if necessary.
-	while (pos < messageLen)
-	{
-		int segmentLength = (messageLen - pos > MAX_SEGMENT) ? MAX_SEGMENT : (messageLen - pos);
-		uint8_t packetPayload[MAXBUF];
+	if (inputFd != STDIN_FILENO)
+		close(inputFd);
+	close(sock);
 
-		memcpy(packetPayload, headerPayload, headerSize);
-		memcpy(packetPayload + headerSize, message + pos, segmentLength);
-		packetPayload[headerSize + segmentLength] = '\0';
+	cout << "===========================================================" << endl;
+	cout << dec << "Batch report: " << stats.commands << " commands from " << stats.lines << " lines ("
+		 << stats.rejected << " rejected), " << elapsed << " s" << (exitAcknowledged ? "" : ", incomplete") << endl;
+	cout << "Sent: " << stream.getQueuedPDUs() << " PDUs, " << stats.bytesSent << " bytes in "
+		 << stream.getSendCalls() << " send calls" << endl;
+	if (elapsed > 0)
+		cout << "Throughput: " << stats.commands / elapsed << " commands/s, " << stream.getQueuedPDUs() / elapsed
+			 << " PDUs/s, " << stats.bytesSent / elapsed / 1e6 << " MB/s" << endl;
+	cout << "Received: " << stats.messagesReceived << " messages, " << stats.listsReceived << " lists, "
+		 << stats.unknownDestinations << " unknown destinations" << endl;
+	cout << "===========================================================" << endl;
+	return exitAcknowledged ? 0 : 1;
+}
 
-		int totalPacketLength = headerSize + segmentLength + 1;
-		LOG_DEBUG("Sending message packet: flag=" << MESSAGE_PACKET
-												  << ", segmentLength=" << segmentLength
-												  << ", totalLen=" << totalPacketLength);
-		LOG_DEBUG("Payload hex: " << hexDump(packetPayload, totalPacketLength));
+// ---------------------------------------------------------------------------
+// Checks that the handle starts with a letter and fits in MAX_NAME_LEN.
+// ---------------------------------------------------------------------------
+static bool validHandle(const char *handle)
+{
+	if (!isalpha(handle[0]))
+	{
+		LOG_ERROR("Handle must start with a letter.");
+		return false;
+	}
+	if (strlen(handle) > MAX_NAME_LEN)
+	{
+		LOG_ERROR("Handle exceeds maximum allowed length of " << MAX_NAME_LEN);
+		return false;
+	}
+	return true;
+}
 
-		int bytesSent = pdu.sendBuf(socketNum, packetPayload, totalPacketLength, MESSAGE_PACKET);
-		connStats.recordSent(bytesSent);
-		connStats.recordMessageSent();
-		pos += segmentLength;
+// ---------------------------------------------------------------------------
+// Reads a line from STDIN into buffer. Returns the length (excluding newline).
+// ---------------------------------------------------------------------------
+int readFromStdin(char *buffer)
+{
+	if (fgets(buffer, MAXBUF, stdin) == nullptr)
+		return 0;
+
+	size_t len = strlen(buffer);
+	if (len > 0 && buffer[len - 1] == '\n')
+	{
+		buffer[len - 1] = '\0';
+		len--;
 	}
+	return static_cast<int>(len);
 }
 
 // ---------------------------------------------------------------------------
-// Handles the %B command (broadcast message).
-// Expected format: %B <message>
+// Checks command-line arguments.
 // ---------------------------------------------------------------------------
-void handleBroadcastCommand(int socketNum, const char *input)
+void checkArgs(int argc, char *argv[], string &dictionaryPath, string &intentModelPath, int &redrawMs, int &maxFrameMessages)
 {
-	LOG_DEBUG("handleBroadcastCommand called");
-	char temp[MAXBUF];
-	strncpy(temp, input, MAXBUF);
-	temp[MAXBUF - 1] = '\0';
+	bool valid = (argc >= 4 && argc % 2 == 0);
+	for (int i = 4; valid && i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--dictionary") == 0)
+			dictionaryPath = argv[i + 1];
+		else if (strcmp(argv[i], "--intent-model") == 0)
+			intentModelPath = argv[i + 1];
+		else if (strcmp(argv[i], "--redraw-ms") == 0)
+			valid = (redrawMs = atoi(argv[i + 1])) >= 0;
+		else if (strcmp(argv[i], "--max-frame-messages") == 0)
+			valid = (maxFrameMessages = atoi(argv[i + 1])) >= 0;
+		else
+			valid = false;
+	}
+	if (!valid)
+	{
+		LOG_ERROR("Usage: cclient [handle] [server-name] [server-port] [--dictionary word-list] [--intent-model model-file]"
+				  << " [--redraw-ms ms] [--max-frame-messages n]");
+		LOG_ERROR("       cclient [handle] [server-name] [server-port] --batch [command-file|-]");
+		exit(1);
+	}
+}
 
-	char *token = strtok(temp, " "); // Skip command token
-	token = strtok(nullptr, "\n");	 // The rest is the message
-	const char *message = (token != nullptr) ? token : "";
+// ---------------------------------------------------------------------------
+// Sends the initial connection (registration) packet with the client handle.
+// ---------------------------------------------------------------------------
+void connection_setup(int socketNum, const char *handle)
+{
+	LOG_DEBUG("connection_setup: Using socket " << socketNum << " to send registration packet.");
 
-	int messageLen = strlen(message);
-	int pos = 0;
-	const int MAX_SEGMENT = MAX_TEXT_PER_PACKET - 1;
+	uint8_t buffer[MAXBUF];
+	uint16_t payload_len = RegistrationPDU::build(buffer, sizeof(buffer), handle);
 
-	PDU_Send_And_Recv pdu;
+	LOG_DEBUG("Sending registration packet: flag=" << CLIENT_INIT_PACKET_TO_SERVER
+												   << ", payload_len=" << payload_len
+												   << ", handle=" << handle);
 
-	// Build the broadcast header: [1 byte sender handle length][sender handle]
-	uint8_t headerPayload[MAXBUF];
-	int headerOffset = 0;
+	// Optional hex dump for debugging:
+	LOG_DEBUG("Registration packet payload hex dump: "
+			  << hexDump(buffer, payload_len));
 
-	uint8_t senderLen = (uint8_t)g_clientHandle.length();
-	headerPayload[headerOffset++] = senderLen;
-	memcpy(headerPayload + headerOffset, g_clientHandle.c_str(), senderLen);
-	headerOffset += senderLen;
+	// Queue the registration packet; flushOutbound() sends it.
+	g_server.queue(CLIENT_INIT_PACKET_TO_SERVER, buffer, payload_len);
+	connStats.recordMessageSent();
+}
 
-	if (messageLen == 0)
-	{
-		// Send just the header plus '\0'.
-		uint8_t packetPayload[MAXBUF];
-		memcpy(packetPayload, headerPayload, headerOffset);
-		packetPayload[headerOffset] = '\0';
+// ---------------------------------------------------------------------------
+// Handlers for packets from the server. processIncomingPacket() has already
+// checked each flag's direction and minimum length against chatFlags.h.
+// ---------------------------------------------------------------------------
+static void showRegistrationConfirmed(const uint8_t *, int)
+{
+	g_frame.addLine("Registration confirmed by server.");
+}
 
-		int totalLen = headerOffset + 1;
-		LOG_DEBUG("Sending empty broadcast packet: flag=" << BROADCAST_PACKET
-														  << ", totalLen=" << totalLen);
-		LOG_DEBUG("Payload hex: " << hexDump(packetPayload, totalLen));
+static void showChatText(const PDU_Handle &sender, const PDU_Text &text)
+{
+	g_directory.markOnline(sender.str());
+	g_frame.addMessage(sender.data, sender.length, text.data, text.length);
+}
 
-		pdu.sendBuf(socketNum, packetPayload, totalLen, BROADCAST_PACKET);
+static void showBroadcast(const uint8_t *dataBuffer, int len)
+{
+	BroadcastPDU broadcast;
+	if (!broadcast.parse(dataBuffer, len))
+	{
+		LOG_ERROR("Sender length exceeds packet length");
 		return;
 	}
+	showChatText(broadcast.sender, broadcast.text);
+}
 
-	// Otherwise, segment the message if needed.
-	while (pos < messageLen)
+static void showDirectMessage(const uint8_t *dataBuffer, int len)
+{
+	MessagePDU message;
+	if (!message.parse(dataBuffer, len))
 	{
-		int segmentLength = (messageLen - pos > MAX_SEGMENT) ? MAX_SEGMENT : (messageLen - pos);
-		uint8_t packetPayload[MAXBUF];
-
-		memcpy(packetPayload, headerPayload, headerOffset);
-		memcpy(packetPayload + headerOffset, message + pos, segmentLength);
-		packetPayload[headerOffset + segmentLength] = '\0';
-
-		int totalLen = headerOffset + segmentLength + 1;
-		LOG_DEBUG("Sending broadcast packet: flag=" << BROADCAST_PACKET
-													<< ", segmentLength=" << segmentLength
-													<< ", totalLen=" << totalLen);
-		LOG_DEBUG("Payload hex: " << hexDump(packetPayload, totalLen));
+		LOG_ERROR("Handle lengths exceed packet length");
+		return;
+	}
+	showChatText(message.sender, message.text);
+}
 
-		int bytesSent = pdu.sendBuf(socketNum, packetPayload, totalLen, BROADCAST_PACKET);
-		connStats.recordSent(bytesSent);
-		connStats.recordMessageSent();
-		pos += segmentLength;
+// %L responses: count, then one packet per handle, then the end marker.
+// Each handle is shown as soon as it arrives. Packets that do not fit the
+// current state (e.g. no request outstanding) are logged and dropped.
+static void receiveListCount(const uint8_t *dataBuffer, int len)
+{
+	ListCountPDU count;
+	if (g_list.state != LIST_AWAIT_COUNT || !count.parse(dataBuffer, len))
+	{
+		LOG_ERROR("Unexpected list count packet (len=" << len << ").");
+		return;
 	}
+	g_list.expected = count.count;
+	g_list.handles.clear();
+	g_list.state = LIST_AWAIT_HANDLES;
+	g_frame.addLine("Number of clients: " + to_string(count.count));
 }
 
-// ---------------------------------------------------------------------------
-// Handles the %L command (list request).
-// ---------------------------------------------------------------------------
-// Reads exactly 'n' bytes from the socket using MSG_WAITALL.
-// Returns 'n' on success or -1 if the connection is closed or an error occurs.
-int readNBytes(int socketNum, uint8_t *buffer, int n)
+static void receiveListHandle(const uint8_t *dataBuffer, int len)
 {
-	int totalRead = 0;
-	while (totalRead < n)
+	ListHandlePDU entry;
+	if (g_list.state != LIST_AWAIT_HANDLES || !entry.parse(dataBuffer, len))
 	{
-		int bytesRead = recv(socketNum, buffer + totalRead, n - totalRead, MSG_WAITALL);
-		if (bytesRead <= 0)
-		{
-			return -1; // Connection closed or error
-		}
-		totalRead += bytesRead;
+		LOG_ERROR("Unexpected list handle packet (len=" << len << ").");
+		return;
 	}
-	return totalRead;
+	g_list.handles.push_back(entry.handle.str());
+	g_frame.addLine(g_list.handles.back());
 }
 
-void handleListCommand(int socketNum)
+static void receiveListEnd(const uint8_t *, int)
 {
-	LOG_DEBUG("handleListCommand: Using socket " << socketNum << " to send list request (flag 0x0A).");
-	PDU_Send_And_Recv pdu;
-	// Send the list request (header-only PDU).
-	if (pdu.sendBuf(socketNum, nullptr, 0, LIST_REQUEST_PACKET) != 3)
+	if (g_list.state != LIST_AWAIT_HANDLES)
 	{
-		LOG_ERROR("handleListCommand: Failed to send list request.");
+		LOG_ERROR("Unexpected end-of-list packet.");
 		return;
 	}
+	if (g_list.handles.size() != g_list.expected)
+		LOG_ERROR("List ended after " << g_list.handles.size() << " of " << g_list.expected << " handles.");
+	else
+		LOG_DEBUG("End-of-list marker received successfully.");
+
+	g_list.finishedHandles.swap(g_list.handles);
+	g_list.handles.clear();
+	g_directory.replaceOnline(g_list.finishedHandles);
+	g_list.finished = true;
+	g_list.outstanding--;
+	g_list.state = g_list.outstanding > 0 ? LIST_AWAIT_COUNT : LIST_IDLE;
+}
+
+// Hands over the most recently completed %L list, once.
+bool takeFinishedList(vector<string> &handles)
+{
+	if (!g_list.finished)
+		return false;
+	handles.swap(g_list.finishedHandles);
+	g_list.finishedHandles.clear();
+	g_list.finished = false;
+	return true;
+}
 
-	// Read the 3-byte header for the list count PDU.
-	uint8_t header[3] = {0};
-	if (readNBytes(socketNum, header, 3) != 3)
+// Error packet for non-existent destination.
+static void showInvalidDestination(const uint8_t *dataBuffer, int len)
+{
+	InvalidDestinationPDU error;
+	if (!error.parse(dataBuffer, len))
 	{
-		LOG_ERROR("handleListCommand: Failed to read list count header.");
+		LOG_ERROR("Destination handle length exceeds packet length");
 		return;
 	}
-	uint16_t pduLen = ntohs(*(uint16_t *)header);
-	int receivedFlag = header[2];
-	int payloadLen = pduLen - 3;
-	LOG_DEBUG("handleListCommand: List count header received: PDU length = "
-			  << pduLen << ", flag = 0x" << std::hex << receivedFlag
-			  << ", payload length = " << payloadLen);
-	if (receivedFlag != LIST_RESPONSE_NUM || payloadLen != 4)
+
+	g_directory.markUnknown(error.handle.str());
+	g_frame.addLine("Error: Client with handle " + error.handle.str() + " does not exist.");
+}
+
+static void showExitAck(const uint8_t *, int)
+{
+	g_frame.addLine("Exit ACK received. Closing connection.");
+	g_exitAcknowledged = true;
+}
+
+typedef void (*ClientPacketHandler)(const uint8_t *payload, int len);
+
+static constexpr ChatFlagHandler<ClientPacketHandler> clientHandlerList[] = {
+	{CONFIRM_GOOD_HANDLE, showRegistrationConfirmed},
+	{BROADCAST_PACKET, showBroadcast},
+	{MESSAGE_PACKET, showDirectMessage},
+	{ERROR_INVALID_DESTINATION, showInvalidDestination},
+	{EXIT_ACK, showExitAck},
+	{LIST_RESPONSE_NUM, receiveListCount},
+	{LIST_RESPONSE_HANDLE, receiveListHandle},
+	{LIST_RESPONSE_END, receiveListEnd}};
+
+// One slot per flag value, generated at compile time; nullptr means unhandled.
+#define CLIENT_HANDLER_ROW(value) chatFlagHandlerFor(clientHandlerList, value)
+static constexpr ClientPacketHandler clientHandlers[256] = {CHAT_FLAG_ROWS256(CLIENT_HANDLER_ROW)};
+#undef CLIENT_HANDLER_ROW
+
+// ---------------------------------------------------------------------------
+// Hands one packet from the server to its handler; the handlers add what
+// they display to g_frame.
+// ---------------------------------------------------------------------------
+static void dispatchServerPacket(int flag, const uint8_t *payload, int len)
+{
+	connStats.recordReceived(len + SIZE_CHAT_HEADER);
+	if (flag == MESSAGE_PACKET || flag == BROADCAST_PACKET)
+		connStats.recordMessageReceived();
+
+	// The flag table validates direction and minimum length before dispatch.
+	ChatFlagCheck check = checkChatFlag(flag, CHAT_DIR_TO_CLIENT, len);
+	if (check == CHAT_FLAG_TOO_SHORT || check == CHAT_FLAG_WRONG_DIRECTION)
 	{
-		LOG_ERROR("handleListCommand: Expected flag 0x0B with 4 payload bytes, but got flag 0x"
-				  << std::hex << receivedFlag << " and payload length " << payloadLen);
+		LOG_ERROR("Invalid " << chatFlagToString(flag) << " packet: " << chatFlagCheckString(check));
 		return;
 	}
 
-	uint8_t countBuffer[4] = {0};
-	if (readNBytes(socketNum, countBuffer, 4) != 4)
+	ClientPacketHandler handler = clientHandlers[flag & 0xFF];
+	if (check != CHAT_FLAG_OK || handler == nullptr)
 	{
-		LOG_ERROR("handleListCommand: Failed to read list count payload.");
+		g_frame.addLine("Received packet with flag " + to_string(flag));
 		return;
 	}
-	uint32_t numHandles;
-	memcpy(&numHandles, countBuffer, sizeof(uint32_t));
-	numHandles = ntohl(numHandles);
-	cout << "Number of clients: " << numHandles << endl;
+	handler(payload, len);
+}
 
-	// Receive each handle PDU.
-	for (uint32_t i = 0; i < numHandles; i++)
+// ---------------------------------------------------------------------------
+// Reads everything the server has sent and handles every complete packet.
+// ---------------------------------------------------------------------------
+void processIncomingPackets()
+{
+	bool open = g_server.fill();
+
+	int flag;
+	const uint8_t *payload;
+	uint16_t length;
+	int packets = 0;
+	while (g_server.nextPDU(&flag, &payload, &length))
 	{
-		if (readNBytes(socketNum, header, 3) != 3)
-		{
-			LOG_ERROR("handleListCommand: Failed to read handle header.");
-			return;
-		}
-		pduLen = ntohs(*(uint16_t *)header);
-		receivedFlag = header[2];
-		payloadLen = pduLen - 3;
-		LOG_DEBUG("handleListCommand: Handle header received: PDU length = "
-				  << pduLen << ", flag = 0x" << std::hex << receivedFlag
-				  << ", payload length = " << payloadLen);
-		if (receivedFlag != LIST_RESPONSE_HANDLE || payloadLen < 1)
-		{
-			LOG_ERROR("handleListCommand: Expected flag 0x0C with at least 1 payload byte, but got flag 0x"
-					  << std::hex << receivedFlag << " and payload length " << payloadLen);
-			continue;
-		}
-		uint8_t handleBuffer[MAX_NAME_LEN + 1] = {0};
-		if (readNBytes(socketNum, handleBuffer, payloadLen) != payloadLen)
-		{
-			LOG_ERROR("handleListCommand: Failed to read handle payload.");
-			return;
-		}
-		uint8_t handleLen = handleBuffer[0];
-		if (payloadLen < (1 + handleLen))
-		{
-			LOG_ERROR("handleListCommand: Incomplete handle payload received.");
-			continue;
-		}
-		char handle[MAX_NAME_LEN + 1] = {0};
-		memcpy(handle, handleBuffer + 1, handleLen);
-		handle[handleLen] = '\0';
-		cout << handle << endl;
+		dispatchServerPacket(flag, payload, length);
+		packets++;
 	}
+	LOG_DEBUG("processIncomingPackets: handled " << packets << " packet(s).");
 
-	// Receive the end-of-list marker.
-	if (readNBytes(socketNum, header, 3) != 3)
+	if (g_server.isCorrupt())
 	{
-		LOG_ERROR("handleListCommand: Failed to read end-of-list header.");
-		return;
+		g_frame.render(true);
+		LOG_ERROR("Malformed packet from server.");
+		exit(1);
 	}
-	pduLen = ntohs(*(uint16_t *)header);
-	receivedFlag = header[2];
-	payloadLen = pduLen - 3;
-	LOG_DEBUG("handleListCommand: End-of-list header received: PDU length = "
-			  << pduLen << ", flag = 0x" << std::hex << receivedFlag
-			  << ", payload length = " << payloadLen);
-	if (receivedFlag != LIST_RESPONSE_END || payloadLen != 0)
+	if (!open && !g_exitAcknowledged)
 	{
-		LOG_ERROR("handleListCommand: Expected end marker flag 0x0D with no payload, but got flag 0x"
-				  << std::hex << receivedFlag << " and payload length " << payloadLen);
+		g_frame.addLine("Server terminated connection.");
+		g_frame.render(true);
+		exit(1);
 	}
-	else
+}
+
+// ---------------------------------------------------------------------------
+// Writes as much queued output as the socket accepts without blocking, and
+// asks pollCall() for POLLOUT only while some is left.
+// ---------------------------------------------------------------------------
+static void flushOutbound()
+{
+	size_t pendingBefore = g_server.pendingOutputBytes();
+	uint64_t callsBefore = g_server.getSendCalls();
+	if (pendingBefore > 0 && !g_server.flush())
 	{
-		LOG_DEBUG("handleListCommand: End-of-list marker received successfully.");
+		g_frame.addLine("Server terminated connection.");
+		g_frame.render(true);
+		exit(1);
 	}
+	connStats.recordSent(pendingBefore - g_server.pendingOutputBytes());
+	connStats.recordSendCalls(g_server.getSendCalls() - callsBefore);
+	setPollOut(g_socketNum, g_server.hasPendingOutput());
 }
 
 // ---------------------------------------------------------------------------
-// Handles the %E command (exit).
+// Queues message on the interactive client's outbound stream; the next
+// flushOutbound() writes it.
 // ---------------------------------------------------------------------------
-void handleExitCommand(int socketNum)
+static void sendTextSegments(int socketNum, int flag, const uint8_t *routingHeader, int headerSize, const char *message)
 {
-	LOG_DEBUG("Sending exit command packet: flag=" << EXIT_PACKET);
-	PDU_Send_And_Recv pdu;
-	pdu.sendBuf(socketNum, nullptr, 0, EXIT_PACKET);
+	size_t messageLen = strlen(message);
 
-	int flag;
-	uint8_t dataBuffer[MAXBUF] = {0};
-	int len = pdu.recvBuf(socketNum, dataBuffer, &flag);
-	LOG_DEBUG("Received response to exit, flag=" << flag << ", len=" << len);
+	LOG_DEBUG("Queueing packet(s) for socket " << socketNum << ": flag=" << flag
+											   << ", headerSize=" << headerSize << ", messageLen=" << messageLen);
 
-	if (flag == 9)
+	size_t segments = g_server.queueSegments(flag, routingHeader, headerSize, message, messageLen, MAX_TEXT_PER_PACKET - 1);
+	for (size_t i = 0; i < segments; i++)
+		connStats.recordMessageSent();
+}
+
+// ---------------------------------------------------------------------------
+// Splits a %M command, in place, into its destination handles and the text
+// after them. Expected format:
+// %M <num-handles> <destHandle1> [destHandle2 ...] <message>
+// ---------------------------------------------------------------------------
+static bool parseMessageCommand(char *text, vector<string> &destinations, const char **message)
+{
+	char *token = strtok(text, " "); // Should be "%M"
+	token = strtok(nullptr, " ");	 // Number of destination handles.
+
+	if (token == nullptr)
 	{
-		cout << "Exit ACK received. Closing connection." << endl;
+		cout << "Invalid %M command format" << endl;
+		return false;
 	}
-	else
+
+	int numHandles = atoi(token);
+	LOG_DEBUG("parseMessageCommand: numHandles=" << numHandles);
+
+	if (numHandles < 1 || numHandles > 9)
 	{
-		cout << "Expected exit ACK (flag 9), but received flag " << flag << endl;
+		cout << "Invalid number of destination handles" << endl;
+		return false;
 	}
+
+	// Collect destination handles.
+	for (int i = 0; i < numHandles; i++)
+	{
+		token = strtok(nullptr, " ");
+		if (token == nullptr)
+		{
+			cout << "Insufficient destination handles" << endl;
+			return false;
+		}
+		destinations.push_back(string(token, strnlen(token, MAX_NAME_LEN - 1)));
+	}
+
+	// The rest of the input is the message text.
+	token = strtok(nullptr, "\n");
+	*message = (token != nullptr) ? token : "";
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Handles the %M command (send message to specific clients).
+// ---------------------------------------------------------------------------
+void handleMessageCommand(int socketNum, const char *input)
+{
+	char temp[MAXBUF];
+	strncpy(temp, input, MAXBUF);
+	temp[MAXBUF - 1] = '\0';
+
+	vector<string> typed;
+	const char *message;
+	if (!parseMessageCommand(temp, typed, &message))
+		return;
+
+	// Destinations known not to exist are dropped here rather than by the
+	// server; a unique prefix of an online handle is completed.
+	vector<string> destinations;
+	for (const string &desHandle : typed)
+	{
+		string handle = desHandle;
+		switch (g_directory.resolve(handle))
+		{
+		case HandleDirectory::HANDLE_SEND:
+			destinations.push_back(handle);
+			break;
+		case HandleDirectory::HANDLE_COMPLETED:
+			cout << "Completed " << desHandle << " to " << handle << "." << endl;
+			destinations.push_back(handle);
+			break;
+		case HandleDirectory::HANDLE_AMBIGUOUS:
+			cout << "Error: Handle " << desHandle << " matches more than one client; not sent." << endl;
+			break;
+		case HandleDirectory::HANDLE_SUPPRESS:
+			cout << "Error: Client with handle " << desHandle << " does not exist (not sent; %L refreshes the list)." << endl;
+			break;
+		}
+	}
+	if (destinations.empty())
+		return;
+
+	// The routing header is built once and shared by every segment.
+	uint8_t headerPayload[MAXBUF - MAX_TEXT_PER_PACKET];
+	int headerSize = MessagePDU::buildHeader(headerPayload, sizeof(headerPayload), g_clientHandle,
+											 destinations.begin(), destinations.end());
+	if (headerSize == 0)
+	{
+		cout << "Message header too long" << endl;
+		return;
+	}
+	LOG_DEBUG("Message header hex: " << hexDump(headerPayload, headerSize));
+
+	sendTextSegments(socketNum, MESSAGE_PACKET, headerPayload, headerSize, message);
+}
+
+// ---------------------------------------------------------------------------
+// Handles the %B command (broadcast message).
+// Expected format: %B <message>
+// ---------------------------------------------------------------------------
+void handleBroadcastCommand(int socketNum, const char *input)
+{
+	LOG_DEBUG("handleBroadcastCommand called");
+	char temp[MAXBUF];
+	strncpy(temp, input, MAXBUF);
+	temp[MAXBUF - 1] = '\0';
+
+	char *token = strtok(temp, " "); // Skip command token
+	token = strtok(nullptr, "\n");	 // The rest is the message
+	const char *message = (token != nullptr) ? token : "";
+
+	// The sender header is built once and shared by every segment.
+	uint8_t headerPayload[1 + UINT8_MAX];
+	int headerSize = BroadcastPDU::buildHeader(headerPayload, sizeof(headerPayload), g_clientHandle);
+
+	sendTextSegments(socketNum, BROADCAST_PACKET, headerPayload, headerSize, message);
+}
+
+// ---------------------------------------------------------------------------
+// Handles the %L command (list request). Only sends the request; the replies
+// are handled by receiveListCount/Handle/End as they arrive.
+// ---------------------------------------------------------------------------
+void handleListCommand(int socketNum)
+{
+	LOG_DEBUG("handleListCommand: Using socket " << socketNum << " to send list request (flag 0x0A).");
+	g_server.queue(CLIENT_TO_SERVER_LIST_OF_HANDLES, nullptr, 0);
+
+	g_list.outstanding++;
+	if (g_list.state == LIST_IDLE)
+		g_list.state = LIST_AWAIT_COUNT;
+}
+
+// ---------------------------------------------------------------------------
+// Handles the %E command (exit). Queues the exit packet behind anything
+// still unsent; the main loop keeps reading the socket until showExitAck().
+// ---------------------------------------------------------------------------
+void handleExitCommand(int socketNum)
+{
+	LOG_DEBUG("Queueing exit command packet for socket " << socketNum << ": flag=" << CLIENT_TO_SERVER_EXIT);
+	g_server.queue(CLIENT_TO_SERVER_EXIT, nullptr, 0);
 }
@@ -1,39 +1,61 @@
 #ifndef CHAT_FLAGS_H
 #define CHAT_FLAGS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 
+// -----------------------------------------------------------------------------
+// Who may send a flag (bit mask, so a flag can travel both ways).
+enum ChatFlagDirection {
+    CHAT_DIR_NONE = 0,      // Not a defined flag.
+    CHAT_DIR_TO_SERVER = 1, // Sent by clients, handled by the server.
+    CHAT_DIR_TO_CLIENT = 2, // Sent by the server, handled by clients.
+    CHAT_DIR_BOTH = CHAT_DIR_TO_SERVER | CHAT_DIR_TO_CLIENT
+};
+
+// How urgently a queued packet of this flag should go out (lower first).
+enum ChatFlagPriority {
+    CHAT_PRIORITY_CONTROL = 0,     // Registration, exit and their replies.
+    CHAT_PRIORITY_INTERACTIVE = 1, // Messages and per-message errors.
+    CHAT_PRIORITY_BULK = 2         // Handle lists.
+};
+
 // -----------------------------------------------------------------------------
 // X-macro table for chat packet flags.
-// Each entry defines a flag name, its value, and a description of what it represents.
+// Each entry defines a flag name, its value, the direction it travels, its
+// send priority, the minimum payload length (bytes after the 3-byte header)
+// a well-formed packet has, and a description of what it represents.
 #define CHAT_FLAGS \
-    /* Registration packet from client to server. */ \
-    X(CLIENT_INIT_PACKET_TO_SERVER, 1, "Registration packet from client to server") \
+    /* Registration packet from client to server: [1 byte length][handle]. */ \
+    X(CLIENT_INIT_PACKET_TO_SERVER, 1, CHAT_DIR_TO_SERVER, CHAT_PRIORITY_CONTROL, 1, "Registration packet from client to server") \
     /* Confirmation packet sent from server to client indicating a successful registration. */ \
-    X(CONFIRM_GOOD_HANDLE, 2, "Confirmation of good handle") \
+    X(CONFIRM_GOOD_HANDLE, 2, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_CONTROL, 0, "Confirmation of good handle") \
     /* Error packet sent from server if registration fails (e.g., duplicate handle). */ \
-    X(ERROR_ON_INIT_PACKET, 3, "Error on registration (e.g., duplicate handle)") \
-    /* Packet sent from client to server to broadcast a message to all clients. */ \
-    X(BROADCAST_PACKET, 4, "Broadcast message") \
-    /* Direct message packet sent from client to server for forwarding to one or more clients. */ \
-    X(MESSAGE_PACKET, 5, "Direct message") \
+    X(ERROR_ON_INIT_PACKET, 3, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_CONTROL, 0, "Error on registration (e.g., duplicate handle)") \
+    /* Broadcast to all clients: [1 byte sender length][sender][text\0], forwarded unchanged. */ \
+    X(BROADCAST_PACKET, 4, CHAT_DIR_BOTH, CHAT_PRIORITY_INTERACTIVE, 2, "Broadcast message") \
+    /* Direct message: [sender][1 byte count]{[1 byte length][destination]}[text\0], forwarded unchanged. */ \
+    X(MESSAGE_PACKET, 5, CHAT_DIR_BOTH, CHAT_PRIORITY_INTERACTIVE, 3, "Direct message") \
+    /* Error sent from server when a message names a handle that is not connected: [1 byte length][handle]. */ \
+    X(ERROR_INVALID_DESTINATION, 7, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_INTERACTIVE, 1, "Error: destination handle does not exist") \
     /* Exit notification sent from client to server when the client is exiting. */ \
-    X(CLIENT_TO_SERVER_EXIT, 8, "Exit notification") \
+    X(CLIENT_TO_SERVER_EXIT, 8, CHAT_DIR_TO_SERVER, CHAT_PRIORITY_CONTROL, 0, "Exit notification") \
     /* List request packet sent from client to server to request the list of connected handles. */ \
-    X(CLIENT_TO_SERVER_LIST_OF_HANDLES, 10, "List request") \
+    X(CLIENT_TO_SERVER_LIST_OF_HANDLES, 10, CHAT_DIR_TO_SERVER, CHAT_PRIORITY_BULK, 0, "List request") \
     /* Packet sent from server containing a 4-byte number indicating the count of connected handles. */ \
-    X(LIST_RESPONSE_NUM, 0x0B, "List response: handle count") \
+    X(LIST_RESPONSE_NUM, 0x0B, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_BULK, 4, "List response: handle count") \
     /* Packet sent from server with one handle (1-byte length followed by the handle name). */ \
-    X(LIST_RESPONSE_HANDLE, 0x0C, "List response: a single handle") \
+    X(LIST_RESPONSE_HANDLE, 0x0C, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_BULK, 1, "List response: a single handle") \
     /* Packet sent from server signaling the end of the list response. */ \
-    X(LIST_RESPONSE_END, 0x0D, "List response: end marker") \
+    X(LIST_RESPONSE_END, 0x0D, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_BULK, 0, "List response: end marker") \
     /* Exit acknowledgement sent from server to client confirming exit. */ \
-    X(EXIT_ACK, 9, "Exit acknowledgement")
+    X(EXIT_ACK, 9, CHAT_DIR_TO_CLIENT, CHAT_PRIORITY_CONTROL, 0, "Exit acknowledgement")
 
 // -----------------------------------------------------------------------------
 // Generate an enum for the chat flags using the X-macro.
 enum ChatPacketFlag {
-#define X(flag, value, desc) flag = value,
+#define X(flag, value, direction, priority, minLength, desc) flag = value,
     CHAT_FLAGS
 #undef X
 };
@@ -41,14 +63,17 @@ enum ChatPacketFlag {
 // -----------------------------------------------------------------------------
 // Structure to hold detailed information about each chat flag.
 struct ChatFlagInfo {
-    ChatPacketFlag flag;
+    int flag;
     const char* name;         // Name of the flag, e.g. "MESSAGE_PACKET"
     const char* description;  // Description of what the flag represents.
+    int direction;            // ChatFlagDirection mask; CHAT_DIR_NONE for undefined values.
+    int priority;             // ChatFlagPriority.
+    int minLength;            // Minimum payload length in bytes.
 };
 
 // Create a constant array containing all chat flag information.
-static const ChatFlagInfo chatFlagInfos[] = {
-#define X(flag, value, desc) { flag, #flag, desc },
+static constexpr ChatFlagInfo chatFlagInfos[] = {
+#define X(flag, value, direction, priority, minLength, desc) { flag, #flag, desc, direction, priority, minLength },
     CHAT_FLAGS
 #undef X
 };
@@ -56,39 +81,63 @@ static const ChatFlagInfo chatFlagInfos[] = {
 // Calculate the number of chat flags.
 static const int numChatFlags = sizeof(chatFlagInfos) / sizeof(ChatFlagInfo);
 
+// -----------------------------------------------------------------------------
+// Compile-time 256-entry table indexed by the flag byte.
+//
+// CHAT_FLAG_ROWS256(ROW) expands to ROW(0), ROW(1), ..., ROW(255), so an
+// initializer built from it has one element per possible flag value; each
+// ROW is a constexpr lookup into a list generated from CHAT_FLAGS. Every
+// run-time query below is then a single array index.
+#define CHAT_FLAG_ROWS16(ROW, base) \
+    ROW(base + 0), ROW(base + 1), ROW(base + 2), ROW(base + 3), \
+    ROW(base + 4), ROW(base + 5), ROW(base + 6), ROW(base + 7), \
+    ROW(base + 8), ROW(base + 9), ROW(base + 10), ROW(base + 11), \
+    ROW(base + 12), ROW(base + 13), ROW(base + 14), ROW(base + 15)
+#define CHAT_FLAG_ROWS256(ROW) \
+    CHAT_FLAG_ROWS16(ROW, 0), CHAT_FLAG_ROWS16(ROW, 16), CHAT_FLAG_ROWS16(ROW, 32), CHAT_FLAG_ROWS16(ROW, 48), \
+    CHAT_FLAG_ROWS16(ROW, 64), CHAT_FLAG_ROWS16(ROW, 80), CHAT_FLAG_ROWS16(ROW, 96), CHAT_FLAG_ROWS16(ROW, 112), \
+    CHAT_FLAG_ROWS16(ROW, 128), CHAT_FLAG_ROWS16(ROW, 144), CHAT_FLAG_ROWS16(ROW, 160), CHAT_FLAG_ROWS16(ROW, 176), \
+    CHAT_FLAG_ROWS16(ROW, 192), CHAT_FLAG_ROWS16(ROW, 208), CHAT_FLAG_ROWS16(ROW, 224), CHAT_FLAG_ROWS16(ROW, 240)
+
+// The info for value, or an "UNKNOWN" row with no direction.
+constexpr ChatFlagInfo chatFlagInfoFor(int value, int i = 0) {
+    return i == numChatFlags
+               ? ChatFlagInfo{ value, "UNKNOWN", "No description available", CHAT_DIR_NONE, CHAT_PRIORITY_BULK, 0 }
+               : chatFlagInfos[i].flag == value ? chatFlagInfos[i] : chatFlagInfoFor(value, i + 1);
+}
+
+#define CHAT_FLAG_INFO_ROW(value) chatFlagInfoFor(value)
+static constexpr ChatFlagInfo chatFlagTable[256] = { CHAT_FLAG_ROWS256(CHAT_FLAG_INFO_ROW) };
+#undef CHAT_FLAG_INFO_ROW
+
+// Out-of-range values are looked up as 0, which must stay undefined.
+static_assert(chatFlagTable[0].direction == CHAT_DIR_NONE, "flag value 0 is reserved for unknown flags");
+static_assert(chatFlagTable[MESSAGE_PACKET].minLength == 3, "chatFlagTable is indexed by flag value");
+
+// -----------------------------------------------------------------------------
+// Inline function: The table row of a flag value (the "UNKNOWN" row if it is not defined).
+inline const ChatFlagInfo& chatFlagInfo(int flag) {
+    return chatFlagTable[(flag & ~0xFF) == 0 ? flag : 0];
+}
+
 // -----------------------------------------------------------------------------
 // Inline function: Check if a given flag value is one of the defined chat flags.
 inline bool isValidChatFlag(int flag) {
-    for (int i = 0; i < numChatFlags; ++i) {
-        if (chatFlagInfos[i].flag == flag) {
-            return true;
-        }
-    }
-    return false;
+    return chatFlagInfo(flag).direction != CHAT_DIR_NONE;
 }
 
 // -----------------------------------------------------------------------------
 // Inline function: Convert a chat flag value to its string representation.
 // Returns the flag name if found, or "UNKNOWN" if not recognized.
 inline const char* chatFlagToString(int flag) {
-    for (int i = 0; i < numChatFlags; ++i) {
-        if (chatFlagInfos[i].flag == flag) {
-            return chatFlagInfos[i].name;
-        }
-    }
-    return "UNKNOWN";
+    return chatFlagInfo(flag).name;
 }
 
 // -----------------------------------------------------------------------------
 // Inline function: Get the description of a given chat flag.
 // Returns a human-readable description or a default message if not recognized.
 inline const char* chatFlagDescription(int flag) {
-    for (int i = 0; i < numChatFlags; ++i) {
-        if (chatFlagInfos[i].flag == flag) {
-            return chatFlagInfos[i].description;
-        }
-    }
-    return "No description available";
+    return chatFlagInfo(flag).description;
 }
 
 // -----------------------------------------------------------------------------
@@ -103,4 +152,59 @@ inline int chatFlagFromString(const char* flagStr) {
     return -1; // Flag not found.
 }
 
+// -----------------------------------------------------------------------------
+// Validation done before a packet reaches its handler.
+enum ChatFlagCheck {
+    CHAT_FLAG_OK,
+    CHAT_FLAG_UNKNOWN,         // Not a defined flag.
+    CHAT_FLAG_WRONG_DIRECTION, // Defined, but not sent towards this side.
+    CHAT_FLAG_TOO_SHORT        // Payload shorter than the flag's minimum length.
+};
+
+// Inline function: Checks a received packet for the side that receives it
+// (CHAT_DIR_TO_SERVER on the server, CHAT_DIR_TO_CLIENT on clients).
+inline ChatFlagCheck checkChatFlag(int flag, int receivingSide, int payloadLength) {
+    const ChatFlagInfo& info = chatFlagInfo(flag);
+    if (info.direction == CHAT_DIR_NONE)
+        return CHAT_FLAG_UNKNOWN;
+    if ((info.direction & receivingSide) == 0)
+        return CHAT_FLAG_WRONG_DIRECTION;
+    if (payloadLength < info.minLength)
+        return CHAT_FLAG_TOO_SHORT;
+    return CHAT_FLAG_OK;
+}
+
+inline const char* chatFlagCheckString(ChatFlagCheck check) {
+    switch (check) {
+    case CHAT_FLAG_OK: return "ok";
+    case CHAT_FLAG_UNKNOWN: return "unknown flag";
+    case CHAT_FLAG_WRONG_DIRECTION: return "flag not expected in this direction";
+    case CHAT_FLAG_TOO_SHORT: return "payload too short";
+    }
+    return "invalid";
+}
+
+// -----------------------------------------------------------------------------
+// Per-side dispatch tables.
+//
+// A program lists the flags it handles as ChatFlagHandler<Handler> entries
+// and turns the list into a 256-entry table (nullptr where it has no
+// handler) at compile time:
+//
+//     static constexpr ChatFlagHandler<Fn> handlerList[] = { { MESSAGE_PACKET, onMessage }, ... };
+//     #define ROW(value) chatFlagHandlerFor(handlerList, value)
+//     static constexpr Fn handlers[256] = { CHAT_FLAG_ROWS256(ROW) };
+//
+// Handler may be a function or member function pointer.
+template <typename Handler>
+struct ChatFlagHandler {
+    int flag;
+    Handler handler;
+};
+
+template <typename Handler, size_t N>
+constexpr Handler chatFlagHandlerFor(const ChatFlagHandler<Handler> (&list)[N], int value, size_t i = 0) {
+    return i == N ? Handler(nullptr) : list[i].flag == value ? list[i].handler : chatFlagHandlerFor(list, value, i + 1);
+}
+
 #endif // CHAT_FLAGS_H
@@ -0,0 +1,839 @@
+/******************************************************************************
+ * Name: Derek J. Russell
+ *
+ * Microbenchmarks for the individual chat components:
+ *   - PDU_Send_And_Recv encode/decode over a socketpair, contiguous and
+ *     gathered from three iovecs.
+ *   - Dynamic_Array add / lookup / remove at several table sizes.
+ *   - BinarySearchHelper search, insertion index and compare.
+ *   - NLPProcessor::processMessage on typical phrasings (string and
+ *     caller-buffer APIs), with heap allocations per message, and 100k
+ *     dialogue sessions sharing one NLPModel; with and without the
+ *     response cache.
+ *   - IntentModel::classify throughput in messages/sec.
+ *   - KeywordAutomaton scan cost with 19 versus 5000 keywords.
+ *   - IntentClassifier mmap load and naive-Bayes scoring.
+ *   - NLPModel::processBatch throughput from 1 to N worker threads.
+ *   - SpellDictionary build and fuzzy lookup on a 100k-word dictionary.
+ *   - chatFlagToString and checkChatFlag over every defined flag.
+ *   - PDU_Schema build and parse of a three-destination %M payload.
+ *
+ * Usage: microbench [--warmup N] [--reps N] [--filter substring]
+ *
+ * Each benchmark runs N warmup repetitions and N measured repetitions and
+ * reports min/median/mean/p95/stddev nanoseconds and CPU cycles per operation.
+ *****************************************************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <random>
+#include <thread>
+#include <fstream>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "BenchHarness.h"
+#include "PDU_Send_And_Recv.h"
+#include "PDU_Stream.h"
+#include "Dynamic_Array.h"
+#include "BinarySearchHelper.h"
+#include "NLPProcessor.h"
+#include "IntentModel.h"
+#include "KeywordAutomaton.h"
+#include "IntentClassifier.h"
+#include "WorkerPool.h"
+#include "SpellDictionary.h"
+#include "TerminalFrame.h"
+#include "chatFlags.h"
+#include "PDU_Schema.h"
+
+using namespace std;
+
+#define MAXBUF 1024
+#define MAX_TEXT_PER_PACKET 200 // As in cclient: text bytes per %M/%B packet, including the '\0'.
+
+// Every heap allocation in the process, so benchmarks can report allocations/op.
+static atomic<uint64_t> allocationCount(0);
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// Runs body once (untimed) and prints the heap allocations per operation.
+template <typename Body>
+static void reportAllocations(BenchHarness &harness, const string &name, long ops, Body body)
+{
+    if (!harness.enabled(name))
+        return;
+    uint64_t before = allocationCount.load();
+    {
+        StreamSilencer silence;
+        body();
+    }
+    uint64_t allocations = allocationCount.load() - before;
+    printf("%-44s %.2f allocations/op\n", ("  -> " + name).c_str(), static_cast<double>(allocations) / ops);
+}
+
+// Builds a Handling structure from a C string.
+static Handling makeHandle(const string &name)
+{
+    Handling h;
+    memset(&h, 0, sizeof(h));
+    h.handleLength = static_cast<char>(name.size());
+    memcpy(h.handle, name.c_str(), name.size());
+    return h;
+}
+
+// Produces count distinct handle names ("user000000", "user000001", ...).
+static vector<string> makeHandleNames(int count)
+{
+    vector<string> names;
+    names.reserve(count);
+    char name[32];
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "user%06d", i);
+        names.push_back(name);
+    }
+    return names;
+}
+
+// -----------------------------------------------------------------------------
+// PDU encode/decode round trip over a connected socketpair.
+static void benchPDU(BenchHarness &harness)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        perror("socketpair");
+        return;
+    }
+
+    const int payloadSizes[] = {0, 16, 200, 1000};
+    const long ops = 200;
+    PDU_Send_And_Recv pdu;
+    uint8_t sendBuffer[MAXBUF];
+    uint8_t recvBuffer[MAXBUF];
+    memset(sendBuffer, 'x', sizeof(sendBuffer));
+
+    for (int size : payloadSizes)
+    {
+        harness.run("pdu/sendBuf+recvBuf/" + to_string(size) + "B", ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                int flag = 0;
+                pdu.sendBuf(sv[0], sendBuffer, static_cast<uint16_t>(size), MESSAGE_PACKET);
+                int len = pdu.recvBuf(sv[1], recvBuffer, &flag);
+                doNotOptimize(len);
+            }
+        });
+    }
+
+    // A %M segment as cclient sends it: routing header, text and terminator
+    // gathered by one sendmsg().
+    struct iovec parts[] = {{sendBuffer, 20}, {sendBuffer + 20, 199}, {const_cast<char *>(""), 1}};
+    harness.run("pdu/sendv+recvBuf/3-parts-220B", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            int flag = 0;
+            pdu.sendv(sv[0], MESSAGE_PACKET, parts, 3);
+            int len = pdu.recvBuf(sv[1], recvBuffer, &flag);
+            doNotOptimize(len);
+        }
+    });
+
+    // Pasted text sent the way cclient's %M used to (one sendv per 199-byte
+    // segment) and the way it does now (queued on a PDU_Stream and written by one flush).
+    // Operations are KB of text, so ns/op is CPU per KB.
+    const size_t pasteBytes = 8 * 1024;
+    const size_t maxSegment = MAX_TEXT_PER_PACKET - 1;
+    string paste(pasteBytes, 'p');
+    uint8_t routingHeader[20];
+    memset(routingHeader, 'h', sizeof(routingHeader));
+    const long kilobytes = pasteBytes / 1024;
+    size_t segments = (pasteBytes + maxSegment - 1) / maxSegment;
+
+    auto drain = [&]() {
+        for (size_t i = 0; i < segments; i++)
+        {
+            int flag = 0;
+            doNotOptimize(pdu.recvBuf(sv[1], recvBuffer, &flag));
+        }
+    };
+
+    PDU_Send_And_Recv perSegment;
+    long perSegmentPastes = 0;
+    harness.run("pdu/paste-8KB/sendv-per-segment", kilobytes, [&]() {
+        perSegmentPastes++;
+        for (size_t position = 0; position < pasteBytes; position += maxSegment)
+        {
+            struct iovec parts[] = {{routingHeader, sizeof(routingHeader)},
+                                    {&paste[position], min(maxSegment, pasteBytes - position)},
+                                    {const_cast<char *>(""), 1}};
+            perSegment.sendv(sv[0], MESSAGE_PACKET, parts, 3);
+        }
+        drain();
+    });
+
+    // The drain reads sv[1] with blocking calls, so sv[0] stays blocking.
+    PDU_Stream queued;
+    queued.attach(sv[0], false);
+    long queuedPastes = 0;
+    harness.run("pdu/paste-8KB/queueSegments+flush", kilobytes, [&]() {
+        queuedPastes++;
+        queued.queueSegments(MESSAGE_PACKET, routingHeader, sizeof(routingHeader), paste.data(), pasteBytes,
+                             maxSegment);
+        while (queued.hasPendingOutput() && queued.flush())
+        {
+        }
+        drain();
+    });
+
+    if (perSegmentPastes > 0 && queuedPastes > 0)
+        printf("%-44s %.2f send calls/KB (sendv-per-segment), %.2f (queueSegments+flush)\n", "  -> pdu/paste-8KB",
+               static_cast<double>(perSegment.getSendCalls()) / perSegmentPastes / kilobytes,
+               static_cast<double>(queued.getSendCalls()) / queuedPastes / kilobytes);
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+// -----------------------------------------------------------------------------
+// Handle table operations at increasing table sizes.
+static void benchDynamicArray(BenchHarness &harness)
+{
+    const int sizes[] = {10, 100, 1000, 10000};
+
+    for (int size : sizes)
+    {
+        vector<string> names = makeHandleNames(size);
+        vector<Handling> handles;
+        for (const string &n : names)
+            handles.push_back(makeHandle(n));
+
+        // Rebuilds the table with all 'size' handles.
+        Dynamic_Array *table = nullptr;
+        auto fillTable = [&]() {
+            delete table;
+            table = new Dynamic_Array();
+            for (int i = 0; i < size; i++)
+                table->addElement(handles[i], i + 3);
+        };
+
+        // Insert 'size' handles into a fresh table (reverse order forces shifting).
+        harness.run("dynarray/addElement/n=" + to_string(size), size,
+                    [&]() { delete table; table = new Dynamic_Array(); },
+                    [&]() {
+                        for (int i = size - 1; i >= 0; i--)
+                            table->addElement(handles[i], i + 3);
+                    });
+
+        // Look up a fixed number of handles spread through the table.
+        const long lookups = 200;
+        harness.run("dynarray/getSocketForHandle/n=" + to_string(size), lookups,
+                    [&]() { if (table == nullptr || table->getCount() != size) fillTable(); },
+                    [&]() {
+                        for (long i = 0; i < lookups; i++)
+                        {
+                            int sock = table->getSocketForHandle(names[(i * 7919) % size].c_str());
+                            doNotOptimize(sock);
+                        }
+                    });
+
+        // Remove every handle from a full table.
+        harness.run("dynarray/removeElement/n=" + to_string(size), size,
+                    fillTable,
+                    [&]() {
+                        for (int i = 0; i < size; i++)
+                            table->removeElement(names[i].c_str());
+                    });
+
+        // Remove every entry by socket number from a full table.
+        harness.run("dynarray/removeElementBySocket/n=" + to_string(size), size,
+                    fillTable,
+                    [&]() {
+                        for (int i = 0; i < size; i++)
+                            table->removeElementBySocket(i + 3);
+                    });
+
+        delete table;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// BinarySearchHelper on a sorted handle table.
+static void benchBinarySearch(BenchHarness &harness)
+{
+    const int sizes[] = {16, 1024, 65536};
+    const long ops = 10000;
+
+    for (int size : sizes)
+    {
+        vector<string> names = makeHandleNames(size);
+        vector<Entry_Handle_Table> entries(size);
+        for (int i = 0; i < size; i++)
+        {
+            entries[i].socketNumber = i;
+            entries[i].handle = makeHandle(names[i]);
+        }
+        Handling missing = makeHandle("zzz-not-present");
+
+        harness.run("bsearch/binarySearch/n=" + to_string(size), ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                int idx = BinarySearchHelper::binarySearch(entries.data(), size,
+                                                           entries[(i * 7919) % size].handle);
+                doNotOptimize(idx);
+            }
+        });
+
+        harness.run("bsearch/binarySearch-miss/n=" + to_string(size), ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                int idx = BinarySearchHelper::binarySearch(entries.data(), size, missing);
+                doNotOptimize(idx);
+            }
+        });
+
+        harness.run("bsearch/findInsertionIndex/n=" + to_string(size), ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                int idx = BinarySearchHelper::findInsertionIndex(entries.data(), size,
+                                                                 entries[(i * 7919) % size].handle);
+                doNotOptimize(idx);
+            }
+        });
+    }
+
+    Handling a = makeHandle("simclient_1024");
+    Handling b = makeHandle("SimClient_1025");
+    harness.run("bsearch/comparesHandles", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            int cmp = BinarySearchHelper::comparesHandles(a, b);
+            doNotOptimize(cmp);
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------
+// NLPProcessor end-to-end conversion of typical simulator phrasings.
+static void benchNLP(BenchHarness &harness)
+{
+    struct Phrase
+    {
+        const char *label;
+        const char *text;
+    };
+    const Phrase phrases[] = {
+        {"send_message", "send a message to simclient_3 hello from simclient_1"},
+        {"broadcast", "broadcast good morning from simclient_1"},
+        {"list", "show me the list of clients"},
+        {"unknown", "what is the weather like today"},
+    };
+    const long ops = 1000;
+
+    for (const Phrase &p : phrases)
+    {
+        NLPProcessor nlp;
+        string input(p.text);
+        string name = string("nlp/processMessage/") + p.label;
+        auto body = [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                string out = nlp.processMessage(input);
+                doNotOptimize(out.size());
+            }
+        };
+        harness.run(name, ops, body);
+        reportAllocations(harness, name, ops, body);
+    }
+
+    // Caller-provided output buffer: no per-message allocation once warmed up.
+    for (const Phrase &p : phrases)
+    {
+        NLPProcessor nlp;
+        size_t length = strlen(p.text);
+        char out[MAXBUF];
+        string name = string("nlp/processMessageInto/") + p.label;
+        auto body = [&]() {
+            for (long i = 0; i < ops; i++)
+                doNotOptimize(nlp.processMessage(p.text, length, out, sizeof(out)));
+        };
+        harness.run(name, ops, body);
+        reportAllocations(harness, name, ops, body);
+    }
+
+    // The same with the response cache off: the full pipeline on every call.
+    NLPModel::setThreadCacheCapacity(0);
+    for (const Phrase &p : phrases)
+    {
+        NLPProcessor nlp;
+        size_t length = strlen(p.text);
+        char out[MAXBUF];
+        harness.run(string("nlp/processMessageInto/uncached/") + p.label, ops, [&]() {
+            for (long i = 0; i < ops; i++)
+                doNotOptimize(nlp.processMessage(p.text, length, out, sizeof(out)));
+        });
+    }
+    NLPModel::setThreadCacheCapacity(ResponseCache::DEFAULT_CAPACITY);
+
+    // 100k concurrent dialogues on one shared model, each two turns deep
+    // ("send a message" then the destination), so every session holds state.
+    const size_t sessionCount = 100000;
+    shared_ptr<const NLPModel> model = NLPModel::shared();
+    vector<DialogueSession> sessions(sessionCount);
+    const char *first = "send a message";
+    const char *second = "simclient_3";
+    char out[MAXBUF];
+    harness.run("nlp/sharedModel/100k-sessions", sessionCount * 2, [&]() {
+        for (DialogueSession &session : sessions)
+            session.reset();
+    }, [&]() {
+        for (DialogueSession &session : sessions)
+            doNotOptimize(model->processMessage(session, first, strlen(first), out, sizeof(out)));
+        for (DialogueSession &session : sessions)
+            doNotOptimize(model->processMessage(session, second, strlen(second), out, sizeof(out)));
+    });
+    if (harness.enabled("nlp/sharedModel/100k-sessions"))
+        printf("%-44s %zu bytes/session, %zu KiB for %zu sessions\n", "  -> nlp/sharedModel/100k-sessions",
+               sizeof(DialogueSession), sessionCount * sizeof(DialogueSession) / 1024, sessionCount);
+}
+
+// -----------------------------------------------------------------------------
+// Intent classification alone over a mixed corpus; reported as messages/sec.
+static void benchIntentModel(BenchHarness &harness)
+{
+    const vector<string> corpus = {
+        "send a message to simclient_3 hello from simclient_1",
+        "broadcast good morning from simclient_1",
+        "show me the list of clients",
+        "what is the weather like today",
+        "please deliver this message to bob",
+        "check connection status",
+        "bye everyone",
+        "quit"};
+    const IntentModel &model = IntentModel::instance();
+    const long ops = 100000;
+    const string name = "nlp/intentModel/classify";
+
+    harness.run(name, ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            const string &text = corpus[i % corpus.size()];
+            doNotOptimize(model.classify(text.data(), text.size()));
+        }
+    });
+
+    if (harness.enabled(name) && !harness.getResults().empty() && harness.getResults().back().medianNs > 0)
+        printf("%-44s %.0f messages/sec\n", "  -> classify throughput", 1e9 / harness.getResults().back().medianNs);
+}
+
+// -----------------------------------------------------------------------------
+// One Aho–Corasick pass per message: the intent keywords versus a keyword set
+// 250 times larger. The time per message should stay about the same.
+static void benchKeywordAutomaton(BenchHarness &harness)
+{
+    const vector<string> corpus = {
+        "send a message to simclient_3 hello from simclient_1",
+        "broadcast good morning from simclient_1",
+        "show me the list of clients",
+        "what is the weather like today",
+        "please deliver this message to bob",
+        "check connection status"};
+    const char *const keywords[] = {"list", "client", "clients", "show", "display", "broadcast", "all",
+                                    "everyone", "send", "message", "to", "deliver", "status", "connection",
+                                    "info", "exit", "quit", "close", "bye"};
+    const size_t keywordCount = sizeof(keywords) / sizeof(keywords[0]);
+    const size_t largeCount = 5000;
+    const long ops = 100000;
+
+    mt19937 rng(463);
+    uniform_int_distribution<int> letter('a', 'z');
+    uniform_int_distribution<int> wordLength(3, 9);
+
+    KeywordAutomaton small;
+    KeywordAutomaton large;
+    for (size_t k = 0; k < keywordCount; k++)
+    {
+        small.addPattern(keywords[k], strlen(keywords[k]), KeywordAutomaton::MATCH_WHOLE_TOKEN);
+        large.addPattern(keywords[k], strlen(keywords[k]), KeywordAutomaton::MATCH_WHOLE_TOKEN);
+    }
+    while (large.getPatternCount() < largeCount)
+    {
+        string word(wordLength(rng), 'a');
+        for (char &c : word)
+            c = static_cast<char>(letter(rng));
+        large.addPattern(word.data(), word.size(), KeywordAutomaton::MATCH_WHOLE_TOKEN);
+    }
+    small.compile();
+    large.compile();
+
+    const KeywordAutomaton *automata[] = {&small, &large};
+    for (const KeywordAutomaton *automaton : automata)
+    {
+        const string name = "nlp/keywordAutomaton/scan/" + to_string(automaton->getPatternCount());
+        harness.run(name, ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                const string &text = corpus[i % corpus.size()];
+                size_t matches = 0;
+                automaton->scan(text.data(), text.size(), [&](const KeywordAutomaton::Match &) { matches++; });
+                doNotOptimize(matches);
+            }
+        });
+        if (harness.enabled(name))
+            printf("%-44s %zu states\n", ("  -> " + name).c_str(), automaton->getStateCount());
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Naive-Bayes scoring over a 2^16-bucket model with random weights, written to
+// a temporary file so load() is the same mmap the clients do.
+static void benchIntentClassifier(BenchHarness &harness)
+{
+    const string loadName = "nlp/intentClassifier/load";
+    const string classifyName = "nlp/intentClassifier/classify";
+    if (!harness.enabled(loadName) && !harness.enabled(classifyName))
+        return;
+
+    const uint32_t bucketBits = 16;
+    mt19937 rng(464);
+    uniform_real_distribution<float> logProbability(-12.0f, -2.0f);
+    vector<float> priors(INTENT_CLASS_STRIDE);
+    vector<float> weights((static_cast<size_t>(1) << bucketBits) * INTENT_CLASS_STRIDE);
+    for (float &p : priors)
+        p = logProbability(rng);
+    for (float &w : weights)
+        w = logProbability(rng);
+
+    char path[] = "/tmp/microbench_intent_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return;
+    }
+    close(fd);
+    if (!IntentClassifier::save(path, bucketBits, 0, priors, weights))
+    {
+        unlink(path);
+        return;
+    }
+
+    const long loads = 100;
+    harness.run(loadName, loads, [&]() {
+        for (long i = 0; i < loads; i++)
+        {
+            IntentClassifier classifier;
+            doNotOptimize(classifier.load(path));
+        }
+    });
+
+    // Pre-tokenized like NLPModel hands them over.
+    const vector<string> corpus = {
+        "send a message to simclient_3 hello from simclient_1",
+        "broadcast good morning from simclient_1",
+        "show me the list of clients",
+        "what is the weather like today"};
+    vector<vector<TokenSpan>> tokens(corpus.size());
+    for (size_t m = 0; m < corpus.size(); m++)
+    {
+        const string &text = corpus[m];
+        for (size_t i = 0; i < text.size();)
+        {
+            size_t end = text.find(' ', i);
+            if (end == string::npos)
+                end = text.size();
+            TokenSpan span = {static_cast<uint32_t>(i), static_cast<uint32_t>(end - i)};
+            tokens[m].push_back(span);
+            i = end + 1;
+        }
+    }
+
+    IntentClassifier classifier;
+    if (classifier.load(path))
+    {
+        const long ops = 100000;
+        harness.run(classifyName, ops, [&]() {
+            for (long i = 0; i < ops; i++)
+            {
+                size_t m = i % corpus.size();
+                doNotOptimize(classifier.classify(corpus[m].data(), tokens[m].data(), tokens[m].size()));
+            }
+        });
+    }
+    unlink(path);
+}
+
+// -----------------------------------------------------------------------------
+// A burst of distinct messages (one session each) through processBatch with
+// 1, 2, 4, ... up to one thread per core; reported as messages/sec and as
+// speedup over one thread. The messages are numbered so they mostly miss the
+// response cache, and avoid send_message, which logs to stdout.
+static void benchProcessBatch(BenchHarness &harness)
+{
+    const size_t batchSize = 4096;
+    const char *const phrasings[] = {"broadcast good morning from client ", "show me the list of clients ",
+                                     "what is the weather like on day ", "check connection status "};
+    vector<string> messages;
+    for (size_t i = 0; i < batchSize; i++)
+        messages.push_back(phrasings[i % 4] + to_string(i));
+
+    const NLPModel &model = *NLPModel::shared();
+    vector<DialogueSession> sessions(batchSize);
+    vector<NLPBatchItem> items(batchSize);
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        items[i].session = &sessions[i];
+        items[i].message = messages[i].data();
+        items[i].length = messages[i].size();
+    }
+
+    size_t cores = thread::hardware_concurrency();
+    if (cores == 0)
+        cores = 1;
+    vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < cores; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(cores);
+
+    double singleThreadNs = 0;
+    for (size_t threads : threadCounts)
+    {
+        const string name = "nlp/processBatch/threads=" + to_string(threads);
+        if (!harness.enabled(name))
+            continue;
+
+        WorkerPool pool(threads);
+        harness.run(name, static_cast<long>(batchSize), [&]() {
+            model.processBatch(items.data(), items.size(), pool);
+            doNotOptimize(items.back().response.size());
+        });
+
+        double medianNs = harness.getResults().back().medianNs;
+        if (threads == 1)
+            singleThreadNs = medianNs;
+        if (medianNs > 0)
+            printf("%-44s %.0f messages/sec, %.2fx\n", ("  -> " + name).c_str(), 1e9 / medianNs,
+                   singleThreadNs > 0 ? singleThreadNs / medianNs : 0.0);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// SymSpell dictionary: index build and lookups of exact and one-edit tokens.
+static void benchSpellDictionary(BenchHarness &harness)
+{
+    const int wordCount = 100000;
+    const int queryCount = 1000;
+    mt19937 rng(464);
+    uniform_int_distribution<int> letter('a', 'z');
+    uniform_int_distribution<int> wordLength(4, 10);
+
+    vector<string> words;
+    words.reserve(wordCount);
+    for (int i = 0; i < wordCount; i++)
+    {
+        string word(wordLength(rng), 'a');
+        for (char &c : word)
+            c = static_cast<char>(letter(rng));
+        words.push_back(word);
+    }
+
+    // One random substitution, insertion, deletion or transposition per query.
+    vector<string> typos;
+    for (int i = 0; i < queryCount; i++)
+    {
+        string word = words[rng() % words.size()];
+        size_t pos = rng() % (word.size() - 1);
+        switch (rng() % 4)
+        {
+        case 0: word[pos] = static_cast<char>(letter(rng)); break;
+        case 1: word.insert(word.begin() + pos, static_cast<char>(letter(rng))); break;
+        case 2: word.erase(word.begin() + pos); break;
+        default: swap(word[pos], word[pos + 1]); break;
+        }
+        typos.push_back(word);
+    }
+
+    SpellDictionary dictionary;
+    harness.run("spell/build/100k", 1, [&]() { dictionary.clear(); }, [&]() {
+        dictionary.addWords(words);
+    });
+    if (dictionary.empty())
+        dictionary.addWords(words);
+
+    harness.run("spell/lookup-exact/100k", queryCount, [&]() {
+        for (int i = 0; i < queryCount; i++)
+        {
+            const string &word = words[i * 97 % words.size()];
+            doNotOptimize(dictionary.lookup(word.data(), word.size()));
+        }
+    });
+    harness.run("spell/lookup-typo/100k", queryCount, [&]() {
+        for (const string &typo : typos)
+            doNotOptimize(dictionary.lookup(typo.data(), typo.size()));
+    });
+
+    SpellDictionary distanceTwo(2);
+    if (harness.enabled("spell/lookup-typo-d2/100k"))
+        distanceTwo.addWords(words);
+    harness.run("spell/lookup-typo-d2/100k", queryCount, [&]() {
+        for (const string &typo : typos)
+            doNotOptimize(distanceTwo.lookup(typo.data(), typo.size()));
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Flag-to-name lookup and PDU validation over all defined flags plus an unknown value.
+static void benchChatFlags(BenchHarness &harness)
+{
+    vector<int> flags;
+    for (int i = 0; i < numChatFlags; i++)
+        flags.push_back(chatFlagInfos[i].flag);
+    flags.push_back(0xFF);
+
+    const long ops = 100000;
+    harness.run("chatflags/chatFlagToString", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            const char *name = chatFlagToString(flags[i % flags.size()]);
+            doNotOptimize(name);
+        }
+    });
+    harness.run("chatflags/checkChatFlag", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            ChatFlagCheck check = checkChatFlag(flags[i % flags.size()], CHAT_DIR_TO_CLIENT, 2);
+            doNotOptimize(check);
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Schema codec on a %M payload with three destinations: build in place, then
+// parse and walk the destination list.
+static void benchPDUSchema(BenchHarness &harness)
+{
+    const string sender = "alice";
+    const char *destinations[] = {"bob", "carol", "dave"};
+    const string text = "hello there, this is a typical chat message";
+    uint8_t payload[MAXBUF];
+
+    const long ops = 100000;
+    size_t length = 0;
+    harness.run("pdu/MessagePDU/build", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            length = MessagePDU::build(payload, sizeof(payload), sender, destinations, destinations + 3,
+                                       text.data(), text.size());
+            doNotOptimize(length);
+        }
+    });
+    harness.run("pdu/MessagePDU/parse", ops, [&]() {
+        for (long i = 0; i < ops; i++)
+        {
+            MessagePDU message;
+            bool ok = message.parse(payload, length);
+            size_t handleBytes = 0;
+            for (PDU_Handle destination : message.destinations)
+                handleBytes += destination.length;
+            doNotOptimize(ok);
+            doNotOptimize(handleBytes);
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Showing a burst of 1000 incoming chat lines on an unbuffered terminal-like
+// stream (/dev/null): one flushed line per message, as the client used to,
+// against one TerminalFrame render.
+static void benchTerminalFrame(BenchHarness &harness)
+{
+    ofstream sink("/dev/null");
+    if (!sink)
+        return;
+    const string sender = "alice";
+    const string text = "hello there, this is a typical chat message";
+    const long messages = 1000;
+
+    harness.run("frame/1000-messages/endl-per-line", messages, [&]() {
+        for (long i = 0; i < messages; i++)
+        {
+            sink.write(sender.data(), sender.size());
+            sink << ": ";
+            sink.write(text.data(), text.size());
+            sink << endl;
+        }
+    });
+
+    TerminalFrame frame(sink);
+    harness.run("frame/1000-messages/TerminalFrame", messages, [&]() {
+        for (long i = 0; i < messages; i++)
+            frame.addMessage(sender.data(), sender.size(), text.data(), text.size());
+        frame.render(true);
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    int warmup = 3;
+    int reps = 20;
+    string filter;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg == "--warmup" && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (arg == "--reps" && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--warmup N] [--reps N] [--filter substring]" << endl;
+            return 1;
+        }
+    }
+    if (warmup < 0 || reps < 1)
+    {
+        cerr << "Error: --warmup must be >= 0 and --reps must be >= 1." << endl;
+        return 1;
+    }
+
+    BenchHarness harness(warmup, reps, filter);
+    BenchHarness::printHeader();
+
+    benchPDU(harness);
+    benchDynamicArray(harness);
+    benchBinarySearch(harness);
+    benchNLP(harness);
+    benchIntentModel(harness);
+    benchKeywordAutomaton(harness);
+    benchIntentClassifier(harness);
+    benchProcessBatch(harness);
+    benchSpellDictionary(harness);
+    benchChatFlags(harness);
+    benchPDUSchema(harness);
+    benchTerminalFrame(harness);
+
+    return 0;
+}
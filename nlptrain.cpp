@@ -0,0 +1,173 @@
+/******************************************************************************
+ * Name: Derek J. Russell
+ *
+ * Trains the naive-Bayes intent model used by "cclient --intent-model" and
+ * "chatbot --intent-model" from labeled utterances.
+ *
+ * Usage: nlptrain <labeled.tsv> <model file> [--bits N] [--alpha A]
+ *
+ * Every non-blank line of the input is "<intent>\t<utterance>", where intent
+ * is one of broadcast, exit, list, send_message, status or unknown; lines
+ * starting with '#' are comments. Utterances are normalized exactly like
+ * chat input (NLPModel::tokenize), hashed into 2^N unigram/bigram feature
+ * buckets (default 16) and counted per intent. The model file stores
+ * Laplace-smoothed (alpha, default 1) log likelihoods; see IntentClassifier.h
+ * for its layout. The written model is loaded back and its accuracy on the
+ * training set is printed.
+ *****************************************************************************/
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "IntentClassifier.h"
+#include "IntentModel.h"
+#include "NLPModel.h"
+
+using namespace std;
+
+#define DEFAULT_BUCKET_BITS 16
+#define DEFAULT_ALPHA 1.0
+
+// Prior of the padding classes; far below any real score.
+#define PADDING_PRIOR -1e30f
+
+struct Example
+{
+    Intent intent;
+    string text;
+};
+
+// Reads "<intent>\t<utterance>" lines. Returns false on an unreadable file or bad label.
+static bool readExamples(const char *path, vector<Example> &examples)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cerr << "[ERROR] Unable to open training file " << path << endl;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line))
+    {
+        lineNumber++;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        size_t tab = line.find('\t');
+        Example example;
+        if (tab == string::npos || !IntentModel::intentFromName(line.substr(0, tab).c_str(), &example.intent))
+        {
+            cerr << "[ERROR] " << path << ":" << lineNumber << ": expected \"<intent>\\t<utterance>\"" << endl;
+            return false;
+        }
+        example.text = line.substr(tab + 1);
+        examples.push_back(example);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t bucketBits = DEFAULT_BUCKET_BITS;
+    double alpha = DEFAULT_ALPHA;
+
+    bool validArgs = (argc >= 3);
+    for (int i = 3; validArgs && i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bits") == 0 && i + 1 < argc)
+            bucketBits = static_cast<uint32_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc)
+            alpha = atof(argv[++i]);
+        else
+            validArgs = false;
+    }
+    if (!validArgs)
+    {
+        cerr << "Usage: " << argv[0] << " <labeled.tsv> <model file> [--bits N] [--alpha A]" << endl;
+        return 1;
+    }
+    if (bucketBits < INTENT_MIN_BUCKET_BITS || bucketBits > INTENT_MAX_BUCKET_BITS || !(alpha > 0))
+    {
+        cerr << "Error: --bits must be " << INTENT_MIN_BUCKET_BITS << " to " << INTENT_MAX_BUCKET_BITS
+             << " and --alpha must be > 0." << endl;
+        return 1;
+    }
+
+    vector<Example> examples;
+    if (!readExamples(argv[1], examples))
+        return 1;
+    if (examples.empty())
+    {
+        cerr << "Error: " << argv[1] << " has no training examples." << endl;
+        return 1;
+    }
+
+    // Count features per class over the normalized tokens.
+    const size_t buckets = static_cast<size_t>(1) << bucketBits;
+    vector<double> counts(buckets * INTENT_CLASS_STRIDE, 0.0);
+    double featureTotals[INTENT_CLASS_STRIDE] = {0};
+    uint32_t classExamples[INTENT_CLASS_STRIDE] = {0};
+
+    const NLPModel &nlp = *NLPModel::shared();
+    string normalized;
+    vector<TokenSpan> tokens;
+    for (const Example &example : examples)
+    {
+        nlp.tokenize(example.text.data(), example.text.size(), normalized, tokens);
+        classExamples[example.intent]++;
+        IntentClassifier::forEachFeature(normalized.data(), tokens.data(), tokens.size(), bucketBits,
+                                         [&](uint32_t bucket) {
+                                             counts[bucket * INTENT_CLASS_STRIDE + example.intent] += 1.0;
+                                             featureTotals[example.intent] += 1.0;
+                                         });
+    }
+
+    // Laplace-smoothed log probabilities; padding classes never win.
+    vector<float> priors(INTENT_CLASS_STRIDE, PADDING_PRIOR);
+    vector<float> weights(buckets * INTENT_CLASS_STRIDE, 0.0f);
+    for (int c = 0; c < INTENT_CLASS_COUNT; c++)
+    {
+        priors[c] = static_cast<float>(log((classExamples[c] + 1.0) / (examples.size() + INTENT_CLASS_COUNT)));
+        double denominator = featureTotals[c] + alpha * buckets;
+        for (size_t b = 0; b < buckets; b++)
+            weights[b * INTENT_CLASS_STRIDE + c] =
+                static_cast<float>(log((counts[b * INTENT_CLASS_STRIDE + c] + alpha) / denominator));
+    }
+
+    if (!IntentClassifier::save(argv[2], bucketBits, static_cast<uint32_t>(examples.size()), priors, weights))
+        return 1;
+
+    // Load the file back through the same path the clients use.
+    IntentClassifier classifier;
+    if (!classifier.load(argv[2]))
+        return 1;
+
+    uint32_t correct[INTENT_CLASS_STRIDE] = {0};
+    for (const Example &example : examples)
+    {
+        nlp.tokenize(example.text.data(), example.text.size(), normalized, tokens);
+        if (classifier.classify(normalized.data(), tokens.data(), tokens.size()) == example.intent)
+            correct[example.intent]++;
+    }
+
+    uint32_t totalCorrect = 0;
+    printf("%-14s %10s %10s\n", "intent", "examples", "accuracy");
+    for (int c = 0; c < INTENT_CLASS_COUNT; c++)
+    {
+        totalCorrect += correct[c];
+        printf("%-14s %10u %9.1f%%\n", IntentModel::intentName(static_cast<Intent>(c)), classExamples[c],
+               classExamples[c] ? 100.0 * correct[c] / classExamples[c] : 0.0);
+    }
+    printf("Wrote %s: %zu buckets (%zu KiB), training accuracy %.1f%% over %zu examples\n", argv[2], buckets,
+           (sizeof(IntentModelFileHeader) + (buckets + 1) * INTENT_CLASS_STRIDE * sizeof(float)) / 1024,
+           100.0 * totalCorrect / examples.size(), examples.size());
+    return 0;
+}
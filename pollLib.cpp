@@ -16,6 +16,7 @@
 static struct pollfd * pollFileDescriptors;
 static int maxFileDescriptor = 0;
 static int currentPollSetSize = 0;
+static int nextPollIndex = 0; // where pollCall() starts looking, so no fd starves the rest
 
 static void growPollSet(int newSetSize);
 
@@ -24,6 +25,12 @@ void setupPollSet()
 {
 	currentPollSetSize = POLL_SET_SIZE;
 	pollFileDescriptors = (struct pollfd *) sCalloc(POLL_SET_SIZE, sizeof(struct pollfd));
+
+	// unused slots must not alias fd 0
+	for (int i = 0; i < POLL_SET_SIZE; i++)
+	{
+		pollFileDescriptors[i].fd = -1;
+	}
 }
 
 
@@ -49,10 +56,43 @@ void addToPollSet(int socketNumber)
 
 void removeFromPollSet(int socketNumber)
 {
-	pollFileDescriptors[socketNumber].fd = 0;
+	// sockets that were rejected before being added may lie past the end of the set
+	if (socketNumber < 0 || socketNumber >= currentPollSetSize)
+	{
+		return;
+	}
+	
+	// poll() skips negative fds; fd 0 with no events would still report POLLHUP
+	pollFileDescriptors[socketNumber].fd = -1;
 	pollFileDescriptors[socketNumber].events = 0;
 }
 
+void setPollOut(int socketNumber, int enabled)
+{
+	if (socketNumber < 0 || socketNumber >= currentPollSetSize)
+	{
+		return;
+	}
+
+	if (enabled)
+	{
+		pollFileDescriptors[socketNumber].events |= POLLOUT;
+	}
+	else
+	{
+		pollFileDescriptors[socketNumber].events &= ~POLLOUT;
+	}
+}
+
+int getPollEvents(int socketNumber)
+{
+	if (socketNumber < 0 || socketNumber >= maxFileDescriptor)
+	{
+		return 0;
+	}
+	return pollFileDescriptors[socketNumber].revents;
+}
+
 int pollCall(int timeInMilliSeconds)
 {
     int i = 0;
@@ -71,13 +111,17 @@ int pollCall(int timeInMilliSeconds)
     
     if (pollValue > 0)
     {
-        // Check which file descriptor(s) are ready.
-        for (i = 0; i < maxFileDescriptor; i++)
+        // Check which file descriptor(s) are ready, starting after the one
+        // returned last time so a busy fd (e.g. a stdin burst) cannot starve
+        // the others.
+        for (int checked = 0; checked < maxFileDescriptor; checked++)
         {
+            i = (nextPollIndex + checked) % maxFileDescriptor;
             if (pollFileDescriptors[i].revents > 0)
             {
                 printf("[DEBUG] pollCall: FD %d has revents: 0x%x\n", i, pollFileDescriptors[i].revents);
                 returnValue = i;
+                nextPollIndex = i + 1;
                 break;
             }
         }
@@ -108,7 +152,7 @@ static void growPollSet(int newSetSize)
 	// zero out the new poll set elements
 	for (i = currentPollSetSize; i < newSetSize; i++)
 	{
-		pollFileDescriptors[i].fd = 0;
+		pollFileDescriptors[i].fd = -1;
 		pollFileDescriptors[i].events = 0;
 	}
 	
@@ -18,4 +18,11 @@ void addToPollSet(int socketNumber);
 void removeFromPollSet(int socketNumber);
 int pollCall(int timeInMilliSeconds);
 
+// Also wake pollCall() when socketNumber can be written (POLLOUT); enable it
+// only while there is output waiting, or poll() returns immediately.
+void setPollOut(int socketNumber, int enabled);
+
+// The revents poll() reported for socketNumber in the last pollCall().
+int getPollEvents(int socketNumber);
+
 #endif
\ No newline at end of file
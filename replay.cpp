@@ -0,0 +1,261 @@
+/******************************************************************************
+ * Name: Derek J. Russell
+ *
+ * Replays a traffic capture (written by "server --capture <file>") against a
+ * running server. Every captured connection is re-opened and its inbound PDUs
+ * are re-sent in the original order, either at the original pace (optionally
+ * scaled with --speed) or as fast as possible with --fast.
+ *
+ * Usage: replay <capture file> <server> <port> [--fast] [--speed <factor>]
+ *
+ * Responses from the server are drained and discarded so the server never
+ * blocks on a full socket buffer. A throughput summary is printed at the end.
+ *****************************************************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "networks.h"
+#include "PDU_Send_And_Recv.h"
+#include "TrafficCapture.h"
+
+using namespace std;
+
+#define MAXBUF 1024
+
+// In --fast mode, drain server responses after this many records.
+#define FAST_DRAIN_INTERVAL 64
+
+// How long to keep draining responses after the last record.
+#define FINAL_DRAIN_MS 200
+
+struct ReplayStats
+{
+    uint64_t connections = 0;
+    uint64_t pdusSent = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t disconnects = 0;
+};
+
+// Sends one captured PDU (header + payload) on socketNum. Returns false on error.
+static bool sendCapturedPDU(int socketNum, const CaptureRecord &record, ReplayStats &stats)
+{
+    uint8_t packet[SIZE_CHAT_HEADER + 65535];
+    PDU_Header header;
+    uint16_t totalLength = static_cast<uint16_t>(SIZE_CHAT_HEADER + record.payloadLength);
+    header.PDU_Length = htons(totalLength);
+    header.flag = record.flag;
+
+    memcpy(packet, &header, SIZE_CHAT_HEADER);
+    if (record.payloadLength > 0)
+        memcpy(packet + SIZE_CHAT_HEADER, record.payload, record.payloadLength);
+
+    int totalSent = 0;
+    while (totalSent < totalLength)
+    {
+        int bytesSent = send(socketNum, packet + totalSent, totalLength - totalSent, 0);
+        if (bytesSent <= 0)
+        {
+            perror("replay send");
+            return false;
+        }
+        totalSent += bytesSent;
+    }
+
+    stats.pdusSent++;
+    stats.bytesSent += totalSent;
+    return true;
+}
+
+// Reads and discards whatever the server has sent on the open connections.
+// Waits up to timeoutMs for the first readable socket.
+static void drainResponses(map<uint32_t, int> &connections, int timeoutMs, ReplayStats &stats)
+{
+    if (connections.empty())
+    {
+        if (timeoutMs > 0)
+            this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+        return;
+    }
+
+    vector<struct pollfd> fds;
+    fds.reserve(connections.size());
+    for (map<uint32_t, int>::const_iterator it = connections.begin(); it != connections.end(); ++it)
+    {
+        struct pollfd p;
+        p.fd = it->second;
+        p.events = POLLIN;
+        p.revents = 0;
+        fds.push_back(p);
+    }
+
+    if (poll(fds.data(), fds.size(), timeoutMs) <= 0)
+        return;
+
+    uint8_t buffer[MAXBUF * 8];
+    for (size_t i = 0; i < fds.size(); i++)
+    {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        int n;
+        while ((n = recv(fds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            stats.bytesReceived += n;
+    }
+}
+
+static void usage(const char *program)
+{
+    cerr << "Usage: " << program << " <capture file> <server> <port> [--fast] [--speed <factor>]" << endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+        usage(argv[0]);
+
+    // Ignore SIGPIPE so a server-side close is reported instead of killing us.
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *capturePath = argv[1];
+    char *serverName = argv[2];
+    char *serverPort = argv[3];
+    bool fast = false;
+    double speed = 1.0;
+
+    for (int i = 4; i < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg == "--fast")
+            fast = true;
+        else if (arg == "--speed" && i + 1 < argc)
+            speed = atof(argv[++i]);
+        else
+            usage(argv[0]);
+    }
+    if (speed <= 0.0)
+    {
+        cerr << "Error: --speed must be greater than zero." << endl;
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(capturePath))
+        return 1;
+
+    const CaptureFileHeader *fileHeader = reader.getHeader();
+    cout << "Capture " << capturePath << ": " << fileHeader->liveRecords << " live records, "
+         << fileHeader->totalRecords << " written, " << fileHeader->evictedRecords << " evicted by wrap." << endl;
+    if (fileHeader->evictedRecords > 0)
+        cout << "Warning: the ring wrapped; connections whose CONNECT record was evicted are skipped." << endl;
+
+    map<uint32_t, int> connections;
+    ReplayStats stats;
+    uint64_t records = 0;
+    uint64_t skipped = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    bool haveFirst = false;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CaptureRecord record;
+
+    while (reader.next(record))
+    {
+        records++;
+        if (!haveFirst)
+        {
+            firstTimestamp = record.timestampNs;
+            haveFirst = true;
+        }
+        lastTimestamp = record.timestampNs;
+
+        if (fast)
+        {
+            if (records % FAST_DRAIN_INTERVAL == 0)
+                drainResponses(connections, 0, stats);
+        }
+        else
+        {
+            // Keep draining responses until this record is due.
+            chrono::nanoseconds offset(static_cast<int64_t>((record.timestampNs - firstTimestamp) / speed));
+            chrono::steady_clock::time_point due = start + offset;
+            while (true)
+            {
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                if (now >= due)
+                    break;
+                int waitMs = static_cast<int>(chrono::duration_cast<chrono::milliseconds>(due - now).count());
+                drainResponses(connections, waitMs > 0 ? waitMs : 0, stats);
+                if (waitMs <= 0)
+                    break;
+            }
+        }
+
+        map<uint32_t, int>::iterator it = connections.find(record.connectionId);
+
+        if (record.kind == CAPTURE_RECORD_CONNECT)
+        {
+            if (it != connections.end())
+                close(it->second);
+            int sock = tcpClientSetup(serverName, serverPort, 0);
+            connections[record.connectionId] = sock;
+            stats.connections++;
+        }
+        else if (record.kind == CAPTURE_RECORD_PDU)
+        {
+            if (it == connections.end())
+            {
+                skipped++;
+                continue;
+            }
+            if (!sendCapturedPDU(it->second, record, stats))
+            {
+                close(it->second);
+                connections.erase(it);
+            }
+        }
+        else if (record.kind == CAPTURE_RECORD_DISCONNECT)
+        {
+            if (it == connections.end())
+                continue;
+            drainResponses(connections, 0, stats);
+            close(it->second);
+            connections.erase(it);
+            stats.disconnects++;
+        }
+    }
+
+    drainResponses(connections, FINAL_DRAIN_MS, stats);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (map<uint32_t, int>::iterator it = connections.begin(); it != connections.end(); ++it)
+        close(it->second);
+
+    double originalSeconds = haveFirst ? (lastTimestamp - firstTimestamp) / 1e9 : 0.0;
+
+    cout << "---------------------------" << endl;
+    cout << "Replay Summary (" << (fast ? "fast" : "paced") << "):" << endl;
+    cout << "Records replayed: " << records << " (" << skipped << " skipped)" << endl;
+    cout << "Connections opened: " << stats.connections << ", closed: " << stats.disconnects << endl;
+    cout << "PDUs sent: " << stats.pdusSent << " (" << stats.bytesSent << " bytes)" << endl;
+    cout << "Bytes received: " << stats.bytesReceived << endl;
+    cout << "Original duration: " << originalSeconds << " s, replay duration: " << elapsed << " s" << endl;
+    if (elapsed > 0)
+        cout << "Throughput: " << (stats.pdusSent / elapsed) << " PDUs/s" << endl;
+    cout << "---------------------------" << endl;
+    return 0;
+}
@@ -18,6 +18,10 @@
  *   - Flag 0x0D: End-of-list marker.
  *
  * It uses poll (via pollLib) to monitor sockets.
+ *
+ * Usage: server [port] [--capture <file>] [--capture-size <MB>]
+ *   --capture writes every inbound PDU (with a timestamp and connection ID)
+ *   into a preallocated mmap'd ring file that the replay tool can re-drive.
  *****************************************************************************/
 
 #include <iostream>
@@ -27,6 +31,7 @@
 #include <cstdio>
 #include <sstream> // For hex dump logging
 #include <locale>
+#include <algorithm>
 
 #include <unistd.h>
 #include <sys/socket.h>
@@ -38,8 +43,10 @@
 #include "networks.h"
 #include "PDU_Send_And_Recv.h"
 #include "Dynamic_Array.h" // Your dynamic handle table API
+#include "TrafficCapture.h"
 
 #include "chatFlags.h"
+#include "PDU_Schema.h"
 
 // Define a namespace for chat constants.
 namespace ChatConstants
@@ -60,26 +67,18 @@ namespace ChatConstants
 #define LOG_INFO(msg) std::cout << "[INFO] " << msg << std::endl
 #define LOG_ERROR(msg) std::cerr << "[ERROR] " << msg << std::endl
 
-// Flag definitions.
-#define CLIENT_INIT_PACKET_TO_SERVER 1		// Registration packet from client
-#define CONFIRM_GOOD_HANDLE 2				// Confirmation sent to client
-#define ERROR_ON_INIT_PACKET 3				// Error on registration
-#define BROADCAST_PACKET 4					// Broadcast message
-#define MESSAGE_PACKET 5					// Direct message packet
-#define CLIENT_TO_SERVER_EXIT 8				// Exit notification from client
-#define CLIENT_TO_SERVER_LIST_OF_HANDLES 10 // List request from client
-
-// List response flags.
-#define LIST_RESPONSE_NUM 0x0B	  // Server sends: 4-byte number of handles
-#define LIST_RESPONSE_HANDLE 0x0C // Server sends: one handle (1 byte length + handle)
-#define LIST_RESPONSE_END 0x0D	  // Server sends: end-of-list marker
-#define EXIT_ACK 9				  // Exit ACK from server
+// Flag values, directions and minimum lengths come from the CHAT_FLAGS table in chatFlags.h.
 
 using namespace std;
 
 // Global dynamic array for client handle management.
 Dynamic_Array clientTable;
 
+// Optional capture of every inbound PDU (enabled with --capture <file>).
+TrafficCapture trafficCapture;
+static const char *captureFilePath = nullptr;
+static size_t captureFileSizeMB = CAPTURE_DEFAULT_SIZE_MB;
+
 // Helper function: Produce a hex dump string from a buffer.
 std::string hexDump(uint8_t *buffer, int length)
 {
@@ -102,8 +101,6 @@ static void dispatchPacket(int clientSocket, int flag, uint8_t *buffer, int len)
 void processClientPacket(int clientSocket);
 void processListRequest(int clientSocket);
 void forwardBroadcast(int senderSocket, uint8_t *payload, int payloadLen);
-static bool parseSenderAndDestinations(uint8_t *payload, int payloadLen, int &offset, char *sender, int maxSenderSize, int &numDest);
-static bool getNextDestinationHandle(uint8_t *payload, int payloadLen, int &offset, char *dest, int maxDestSize);
 void forwardDirectMessage(int senderSocket, uint8_t *payload, int payloadLen);
 void processClientExit(int clientSocket);
 void sendErrorForInvalidHandle(int senderSocket, const char *destHandle);
@@ -116,6 +113,7 @@ bool sendEndOfListMarker(int clientSocket);
 // Cleanup a client connection gracefully.
 void cleanupClient(int clientSocket)
 {
+	trafficCapture.recordDisconnect(clientSocket);
 	removeClientBySocket(clientSocket);
 	removeFromPollSet(clientSocket);
 	close(clientSocket);
@@ -129,6 +127,16 @@ int main(int argc, char *argv[])
 	setupPollSet();
 	addToPollSet(serverSocket);
 
+	if (captureFilePath != nullptr)
+	{
+		if (!trafficCapture.open(captureFilePath, captureFileSizeMB * 1024 * 1024))
+		{
+			LOG_ERROR("Unable to open capture file " << captureFilePath);
+			exit(-1);
+		}
+		LOG_INFO("Capturing inbound traffic to " << captureFilePath << " (" << captureFileSizeMB << " MB ring)");
+	}
+
 	LOG_INFO("Server is using port " << portNumber);
 	talk_to_clients(serverSocket);
 	close(serverSocket);
@@ -136,27 +144,46 @@ int main(int argc, char *argv[])
 }
 
 // Checks command-line arguments and returns port number.
+// Also picks up the optional --capture <file> and --capture-size <MB> options.
 int checkArgs(int argc, char *argv[])
 {
 	try
 	{
-		// If more than one optional parameter is provided, it's an error.
-		if (argc > 2)
-		{
-			throw std::invalid_argument("Usage: <program> [optional port number]");
-		}
-
 		int portNumber = 0;
-		if (argc == 2)
+		bool havePort = false;
+
+		for (int i = 1; i < argc; i++)
 		{
-			// Use std::string and std::stoi for robust conversion.
-			std::string arg(argv[1]);
-			portNumber = std::stoi(arg);
+			std::string arg(argv[i]);
 
-			// Optionally, verify that the port number is within a valid range.
-			if (portNumber < 1 || portNumber > 65535)
+			if (arg == "--capture" && i + 1 < argc)
+			{
+				captureFilePath = argv[++i];
+			}
+			else if (arg == "--capture-size" && i + 1 < argc)
+			{
+				int sizeMB = std::stoi(std::string(argv[++i]));
+				if (sizeMB < 1)
+				{
+					throw std::out_of_range("Capture size must be at least 1 MB.");
+				}
+				captureFileSizeMB = static_cast<size_t>(sizeMB);
+			}
+			else if (!havePort && !arg.empty() && arg[0] != '-')
 			{
-				throw std::out_of_range("Port number must be between 1 and 65535.");
+				// Use std::string and std::stoi for robust conversion.
+				portNumber = std::stoi(arg);
+				havePort = true;
+
+				// Optionally, verify that the port number is within a valid range.
+				if (portNumber < 1 || portNumber > 65535)
+				{
+					throw std::out_of_range("Port number must be between 1 and 65535.");
+				}
+			}
+			else
+			{
+				throw std::invalid_argument("Usage: <program> [optional port number] [--capture <file>] [--capture-size <MB>]");
 			}
 		}
 		return portNumber;
@@ -197,19 +224,20 @@ void talk_to_clients(int serverSocket)
 // Returns true if the extraction is successful; false otherwise.
 static bool extractHandleFromRegistration(uint8_t *buffer, int len, char *handle, int maxNameLen, uint8_t &handleLen)
 {
-	if (len < 1)
+	RegistrationPDU registration;
+	if (!registration.parse(buffer, len))
 	{
 		LOG_ERROR("Registration payload is too short.");
 		return false;
 	}
-	handleLen = buffer[0];
-	if (handleLen == 0 || handleLen > maxNameLen || len < (1 + handleLen))
+	handleLen = registration.handle.length;
+	if (handleLen == 0 || handleLen > maxNameLen)
 	{
 		LOG_ERROR("Invalid handle length in registration packet: " << (int)handleLen
 																   << ". Expected between 1 and " << maxNameLen << " bytes.");
 		return false;
 	}
-	memcpy(handle, buffer + 1, handleLen);
+	memcpy(handle, registration.handle.data, handleLen);
 	handle[handleLen] = '\0';
 	return true;
 }
@@ -219,11 +247,15 @@ static bool extractHandleFromRegistration(uint8_t *buffer, int len, char *handle
 void processNewClient(int serverSocket)
 {
 	int clientSocket = tcpAccept(serverSocket, DEBUG_FLAG);
+	trafficCapture.recordConnect(clientSocket);
 	PDU_Send_And_Recv pdu;
 	uint8_t buffer[MAXBUF] = {0};
 	int flag;
 	int len = pdu.recvBuf(clientSocket, buffer, &flag);
 
+	if (len >= 0 || len == VALID_ZERO_PAYLOAD)
+		trafficCapture.recordPDU(clientSocket, flag, buffer, len);
+
 	LOG_DEBUG("Received registration packet on socket " << clientSocket
 														<< " with flag " << flag << " and length " << len
 														<< ". Data: " << hexDump(buffer, len));
@@ -307,32 +339,46 @@ void processNewClient(int serverSocket)
 }
 
 // Helper function: Dispatch the packet based on its flag.
+// Dispatch wrappers for the handlers that do not look at the payload.
+static void dispatchExit(int clientSocket, uint8_t *, int)
+{
+	LOG_DEBUG("Dispatch: Processing exit packet from socket " << clientSocket);
+	processClientExit(clientSocket);
+}
+
+static void dispatchListRequest(int clientSocket, uint8_t *, int)
+{
+	LOG_DEBUG("Dispatch: Processing list request from socket" << clientSocket);
+	processListRequest(clientSocket);
+}
+
+// Packets a registered client may send, by flag. Registration itself is
+// handled in processNewClient().
+typedef void (*ServerPacketHandler)(int clientSocket, uint8_t *payload, int len);
+static constexpr ChatFlagHandler<ServerPacketHandler> serverHandlerList[] = {
+	{BROADCAST_PACKET, forwardBroadcast},
+	{MESSAGE_PACKET, forwardDirectMessage},
+	{CLIENT_TO_SERVER_EXIT, dispatchExit},
+	{CLIENT_TO_SERVER_LIST_OF_HANDLES, dispatchListRequest}};
+
+#define SERVER_HANDLER_ROW(value) chatFlagHandlerFor(serverHandlerList, value)
+static constexpr ServerPacketHandler serverHandlers[256] = {CHAT_FLAG_ROWS256(SERVER_HANDLER_ROW)};
+#undef SERVER_HANDLER_ROW
+
+// Validates the flag against chatFlags.h (defined, sent to the server, long
+// enough) and calls its handler with one table lookup.
 static void dispatchPacket(int clientSocket, int flag, uint8_t *buffer, int len)
 {
-	switch (flag)
+	ChatFlagCheck check = checkChatFlag(flag, CHAT_DIR_TO_SERVER, len);
+	ServerPacketHandler handler = check == CHAT_FLAG_OK ? serverHandlers[flag] : nullptr;
+	if (handler == nullptr)
 	{
-	case BROADCAST_PACKET:
-		forwardBroadcast(clientSocket, buffer, len);
-		break;
-
-	case MESSAGE_PACKET:
-		forwardDirectMessage(clientSocket, buffer, len);
-		break;
-
-	case CLIENT_TO_SERVER_EXIT:
-		LOG_DEBUG("Dispatch: Processing exit packet from socket " << clientSocket);
-		processClientExit(clientSocket);
-		break;
-
-	case CLIENT_TO_SERVER_LIST_OF_HANDLES: // flag 10 (0x0A)
-		LOG_DEBUG("Dispatch: Processing list request from socket" << clientSocket);
-		processListRequest(clientSocket);
-		break;
-
-	default:
-		LOG_ERROR("Dispatch: Unknown flag " << flag << " received from socket " << clientSocket << ". Data: " << hexDump(buffer, len));
-		break;
+		LOG_ERROR("Dispatch: Rejected flag " << flag << " (" << chatFlagToString(flag) << ": "
+											 << (check == CHAT_FLAG_OK ? "not accepted after registration" : chatFlagCheckString(check))
+											 << ") from socket " << clientSocket << ". Data: " << hexDump(buffer, len));
+		return;
 	}
+	handler(clientSocket, buffer, len);
 }
 
 // Processes a packet from an already connected client.
@@ -344,6 +390,9 @@ void processClientPacket(int clientSocket)
 	int flag;
 	int len = pdu.recvBuf(clientSocket, buffer, &flag);
 
+	if (len >= 0 || len == VALID_ZERO_PAYLOAD)
+		trafficCapture.recordPDU(clientSocket, flag, buffer, len);
+
 	LOG_DEBUG("Received packet on socket " << clientSocket
 										   << " with flag " << flag << " and length " << len
 										   << ". Data: " << hexDump(buffer, (len < 16 ? len : 16)) << "...");
@@ -370,20 +419,12 @@ void processClientPacket(int clientSocket)
 // For broadcast messages, forward the packet to all clients except the sender.
 void forwardBroadcast(int senderSocket, uint8_t *payload, int payloadLen)
 {
-	if (payloadLen < 1)
-	{
-		LOG_ERROR("Broadcast packet is too short.");
-		return;
-	}
-	uint8_t senderLen = payload[0];
-	if (payloadLen < (1 + senderLen))
+	BroadcastPDU broadcast;
+	if (!broadcast.parse(payload, payloadLen))
 	{
 		LOG_ERROR("Broadcast packet length inconsistent with sender handle length.");
 		return;
 	}
-	char sender[ChatConstants::MaxNameLen + 1] = {0};
-	memcpy(sender, payload + 1, senderLen);
-	sender[senderLen] = '\0';
 
 	int cap = clientTable.getCapacity();
 	Entry_Handle_Table *arr = clientTable.getArray();
@@ -395,83 +436,7 @@ void forwardBroadcast(int senderSocket, uint8_t *payload, int payloadLen)
 				LOG_ERROR("Failed to forward broadcast to socket " << arr[i].socketNumber);
 		}
 	}
-	LOG_INFO("Broadcast message from " << sender << " forwarded.");
-}
-
-// Helper function: Parses sender handle and destination count from the payload.
-// Parameters:
-// - payload: the received direct message payload.
-// - payloadLen: total length of the payload.
-// - offset: reference to the current offset (starting at 0) in the payload; it will be updated.
-// - sender: buffer to store the parsed sender handle (should have size at least maxSenderSize).
-// - maxSenderSize: maximum allowed size for sender.
-// - numDest: reference to an int to store the number of destination handles.
-// Returns true if successful; false otherwise.
-static bool parseSenderAndDestinations(uint8_t *payload, int payloadLen, int &offset, char *sender, int maxSenderSize, int &numDest)
-{
-	if (payloadLen < 1)
-	{
-		LOG_ERROR("Payload length insufficient for sender length.");
-		return false;
-	}
-
-	uint8_t senderLen = payload[offset++];
-
-	if (payloadLen < (1 + senderLen + 1))
-	{
-		LOG_ERROR("Payload too short for sender and destination count.");
-		return false;
-	}
-
-	if (senderLen >= maxSenderSize)
-	{
-		LOG_ERROR("Sender length exceeds maximum allowed (" << maxSenderSize << ").");
-		return false;
-	}
-
-	memcpy(sender, payload + offset, senderLen);
-	sender[senderLen] = '\0';
-	offset += senderLen;
-	numDest = payload[offset++];
-
-	return true;
-}
-
-// Helper function: Parses the next destination handle from the payload.
-// Parameters:
-// - payload: the received direct message payload.
-// - payloadLen: total length of the payload.
-// - offset: reference to the current offset in the payload; it will be updated.
-// - dest: buffer to store the parsed destination handle (should have size at least maxDestSize).
-// - maxDestSize: maximum allowed size for destination handle.
-// Returns true if successful; false otherwise.
-static bool getNextDestinationHandle(uint8_t *payload, int payloadLen, int &offset, char *dest, int maxDestSize)
-{
-	if (offset >= payloadLen)
-	{
-		LOG_ERROR("Direct message packet truncated while reading destination handle length.");
-		return false;
-	}
-
-	uint8_t destLen = payload[offset++];
-
-	if (offset + destLen > payloadLen)
-	{
-		LOG_ERROR("Direct meesage packet length inconsistent with destination handle length.");
-		return false;
-	}
-
-	if (destLen >= maxDestSize)
-	{
-		LOG_ERROR("Destination handle length exceeds maximum allowed (" << maxDestSize << ").");
-		return false;
-	}
-
-	memcpy(dest, payload + offset, destLen);
-	dest[destLen] = '\0';
-	offset += destLen;
-
-	return true;
+	LOG_INFO("Broadcast message from " << broadcast.sender.str() << " forwarded.");
 }
 
 // trim from start (in place)
@@ -522,36 +487,22 @@ static std::string toLower(const std::string &s)
 	return result;
 }
 
-// Revised forwardDirectMessage() using helper functions and ChatConstants::MaxNameLen.
+// Forwards a direct message, unchanged, to every destination named in it.
 void forwardDirectMessage(int senderSocket, uint8_t *payload, int payloadLen)
 {
-	int offset = 0;
-	char sender[ChatConstants::MaxNameLen + 1] = {0};
-	int numDest = 0;
-
-	if (!parseSenderAndDestinations(payload, payloadLen, offset, sender, ChatConstants::MaxNameLen + 1, numDest))
+	MessagePDU message;
+	if (!message.parse(payload, payloadLen))
 	{
-		LOG_ERROR("Failed to parse sender and destination count.");
+		LOG_ERROR("Direct message packet length inconsistent with its handle lengths.");
 		return;
 	}
 
-	LOG_INFO("Direct message from " << sender << " to " << numDest << " destination(s).");
+	LOG_INFO("Direct message from " << message.sender.str() << " to " << message.destinations.size() << " destination(s).");
 
-	for (int i = 0; i < numDest; i++)
+	for (PDU_Handle destination : message.destinations)
 	{
-		char destRaw[ChatConstants::MaxNameLen + 1] = {0};
-
-		if (!getNextDestinationHandle(payload, payloadLen, offset, destRaw, ChatConstants::MaxNameLen + 1))
-		{
-			LOG_ERROR("Failed to parse destination handle for destination " << i + 1);
-			return;
-		}
-
-		// Convert the extracted destination handle to a std::string,
-		// trim whitespace, and convert to lowercase.
-		std::string destStr(destRaw);
-		destStr = trimString(destStr);
-		destStr = toLower(destStr);
+		// Trim whitespace and convert to lowercase, as registration does.
+		std::string destStr = toLower(trimString(destination.str()));
 
 		LOG_DEBUG("Extracted destination handle after processing: '" << destStr
 																	 << "' with length: " << destStr.size());
@@ -574,6 +525,7 @@ void forwardDirectMessage(int senderSocket, uint8_t *payload, int payloadLen)
 void processClientExit(int clientSocket)
 {
 	safeSend(clientSocket, nullptr, 0, EXIT_ACK);
+	trafficCapture.recordDisconnect(clientSocket);
 	removeClientBySocket(clientSocket);
 	removeFromPollSet(clientSocket);
 	close(clientSocket);
@@ -583,11 +535,14 @@ void processClientExit(int clientSocket)
 // Sends an error packet (flag 7) to the sender for an invalid destination handle.
 void sendErrorForInvalidHandle(int senderSocket, const char *destHandle)
 {
-	uint8_t payload[MAXBUF] = {0};
-	uint8_t hLen = strlen(destHandle);
-	payload[0] = hLen;
-	memcpy(payload + 1, destHandle, hLen);
-	safeSend(senderSocket, payload, 1 + hLen, 7);
+	uint8_t payload[1 + UINT8_MAX];
+	size_t payloadLen = InvalidDestinationPDU::build(payload, sizeof(payload), destHandle);
+	if (payloadLen == 0)
+	{
+		LOG_ERROR("Invalid destination handle is too long to report.");
+		return;
+	}
+	safeSend(senderSocket, payload, payloadLen, ERROR_INVALID_DESTINATION);
 	LOG_INFO("Sent error for invalid handle: " << destHandle << " to socket " << senderSocket);
 }
 
@@ -632,11 +587,12 @@ bool safeSend(int socketNum, uint8_t *payload, int payloadLen, int flag)
 // Helper function: Sends the list count PDU.
 bool sendListCount(int clientSocket, uint32_t numHandles)
 {
-	uint32_t netCount = htonl(numHandles);
+	uint8_t payload[4];
+	ListCountPDU::build(payload, sizeof(payload), numHandles);
 
 	LOG_DEBUG("sendListCount: Sending handle count (" << numHandles << ") with expected PDU size = " << (SIZE_CHAT_HEADER + 4) << " bytes and flag 0x0B.");
 
-	if (!safeSend(clientSocket, reinterpret_cast<uint8_t *>(&netCount), 4, LIST_RESPONSE_NUM))
+	if (!safeSend(clientSocket, payload, sizeof(payload), LIST_RESPONSE_NUM))
 	{
 		LOG_ERROR("sendListCount: Failed to send handle count PDU.");
 		return false;
@@ -649,16 +605,15 @@ bool sendListCount(int clientSocket, uint32_t numHandles)
 // Helper function: Sends a handle entry PDU.
 bool sendHandleEntry(int clientSocket, const char *handle, uint8_t handleLen)
 {
-	uint8_t payload[1 + MAXIMUM_CHARACTERS] = {0};
-	payload[0] = handleLen;
-	memcpy(payload + 1, handle, handleLen);
+	uint8_t payload[1 + MAXIMUM_CHARACTERS];
+	size_t payloadLen = ListHandlePDU::build(payload, sizeof(payload), PDU_Handle(handle, handleLen));
 
 	LOG_DEBUG("sendHandleEntry: Sending handle '" << handle
-												  << "' with payload size " << (1 + handleLen)
+												  << "' with payload size " << payloadLen
 												  << " (expected PDU size = " << (SIZE_CHAT_HEADER + 1 + handleLen)
 												  << " bytes, flag 0x0C).");
 
-	if (!safeSend(clientSocket, payload, 1 + handleLen, LIST_RESPONSE_HANDLE))
+	if (payloadLen == 0 || !safeSend(clientSocket, payload, payloadLen, LIST_RESPONSE_HANDLE))
 	{
 		LOG_ERROR("sendHandleEntry: Failed to send handle PDU for '" << handle << "'.");
 		return false;
@@ -1,37 +1,74 @@
+/******************************************************************************
+ * Name: Derek J. Russell
+ *
+ * Registration test and connection-storm benchmark for the chat server.
+ *
+ * Single registration (original behaviour):
+ *   test_register <server_ip> <port> <handle>
+ *
+ * Registration benchmark:
+ *   test_register <server_ip> <port> --bench <connections>
+ *                 [--concurrency 1,10,100,1000] [--duplicates <percent>]
+ *
+ * For every concurrency level the benchmark opens <connections> non-blocking
+ * connections, keeping at most <concurrency> registrations in flight. Each
+ * connection registers a unique handle, except for the requested percentage
+ * which reuse a handle that the server has already confirmed. It reports
+ * registrations/sec, connect-to-confirm latency percentiles and whether the
+ * server accepted every unique handle (flag 2) and rejected every duplicate
+ * (flag 3).
+ *****************************************************************************/
+
 #include <iostream>
+#include <iomanip>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 
-// Use the same definitions as in your assignment.
-#pragma pack(push, 1)
-struct PDU_Header
-{
-    uint16_t PDU_Length; // in network byte order
-    uint8_t flag;
-};
-#pragma pack(pop)
+#include "PDU_Send_And_Recv.h"
+#include "chatFlags.h"
 
-#define CLIENT_INIT_PACKET_TO_SERVER 1
 #define MAXIMUM_CHARACTERS 100
 
+// Give up on a level if no connection makes progress for this long. SYN-ACK
+// retransmits after a full listen queue back off to several seconds.
+#define BENCH_STALL_TIMEOUT_MS 30000
+
 using namespace std;
 
-int main(int argc, char *argv[])
+// Builds a registration PDU for handle into packet; returns the PDU length.
+static int buildRegistrationPacket(const char *handle, uint8_t *packet)
 {
-    if (argc != 4)
-    {
-        cerr << "Usage: " << argv[0] << " <server_ip> <port> <handle>" << endl;
-        exit(1);
-    }
+    uint8_t handleLen = static_cast<uint8_t>(strlen(handle));
+    uint16_t totalLength = sizeof(PDU_Header) + 1 + handleLen;
 
-    const char *server_ip = argv[1];
-    int port = atoi(argv[2]);
-    const char *handle = argv[3];
+    PDU_Header header;
+    header.PDU_Length = htons(totalLength);
+    header.flag = CLIENT_INIT_PACKET_TO_SERVER;
 
+    memcpy(packet, &header, sizeof(header));
+    packet[sizeof(header)] = handleLen;
+    memcpy(packet + sizeof(header) + 1, handle, handleLen);
+    return totalLength;
+}
+
+// Original single-connection registration test.
+static int registerOnce(const char *server_ip, int port, const char *handle)
+{
     // Create a TCP socket.
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0)
@@ -59,28 +96,15 @@ int main(int argc, char *argv[])
     }
     cout << "Connected to " << server_ip << " on port " << port << endl;
 
-    // Build the registration payload.
-    uint8_t handleLen = strlen(handle);
-    if (handleLen > MAXIMUM_CHARACTERS)
+    // Build the registration packet.
+    if (strlen(handle) > MAXIMUM_CHARACTERS)
     {
         cerr << "Handle exceeds maximum allowed length." << endl;
         exit(1);
     }
 
-    uint8_t payload[256];
-    payload[0] = handleLen;
-    memcpy(payload + 1, handle, handleLen);
-
-    // Total PDU length = header (3 bytes) + payload (1 + handleLen).
-    uint16_t totalLength = sizeof(PDU_Header) + 1 + handleLen;
-    PDU_Header header;
-    header.PDU_Length = htons(totalLength);
-    header.flag = CLIENT_INIT_PACKET_TO_SERVER;
-
-    // Build full packet.
     uint8_t packet[512];
-    memcpy(packet, &header, sizeof(header));
-    memcpy(packet + sizeof(header), payload, 1 + handleLen);
+    int totalLength = buildRegistrationPacket(handle, packet);
 
     // Send registration packet.
     if (send(sock, packet, totalLength, 0) < 0)
@@ -101,10 +125,379 @@ int main(int argc, char *argv[])
     }
 
     PDU_Header *respHeader = reinterpret_cast<PDU_Header *>(respHeaderBuffer);
-    uint16_t respPDU_Length = ntohs(respHeader->PDU_Length);
     uint8_t respFlag = respHeader->flag;
     cout << "Response received. Flag: " << (int)respFlag << endl;
 
     close(sock);
     return 0;
 }
+
+// -----------------------------------------------------------------------------
+// Registration benchmark
+// -----------------------------------------------------------------------------
+
+enum BenchConnState
+{
+    BENCH_CONNECTING,
+    BENCH_AWAITING_RESPONSE,
+    BENCH_DONE
+};
+
+struct BenchConnection
+{
+    int sock;
+    BenchConnState state;
+    bool duplicate;             // True if this connection reuses a confirmed handle.
+    string handle;
+    uint8_t response[sizeof(PDU_Header)];
+    int responseBytes;
+    chrono::steady_clock::time_point connectStart;
+    chrono::steady_clock::time_point registrationSent;
+};
+
+struct BenchLevelResult
+{
+    int concurrency;
+    int attempted;
+    double elapsedSeconds;
+    vector<double> connectToConfirmUs;  // Connect start to server response.
+    vector<double> registerToConfirmUs; // Registration sent to server response.
+    int uniqueAccepted;
+    int uniqueRejected;
+    int duplicatesRejected;
+    int duplicatesAccepted;
+    int failures; // Connect errors, resets or unexpected flags.
+};
+
+// Raises the open file limit to the hard maximum so thousands of sockets fit.
+static void raiseFileLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static double percentile(vector<double> &samples, double p)
+{
+    if (samples.empty())
+        return 0.0;
+    sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+    return samples[idx];
+}
+
+// Starts a non-blocking connect for conn. Returns false on immediate failure.
+static bool startConnect(BenchConnection &conn, const struct sockaddr_in &serverAddr)
+{
+    conn.sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn.sock < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    fcntl(conn.sock, F_SETFL, fcntl(conn.sock, F_GETFL, 0) | O_NONBLOCK);
+
+    conn.connectStart = chrono::steady_clock::now();
+    conn.state = BENCH_CONNECTING;
+    conn.responseBytes = 0;
+
+    if (connect(conn.sock, (const struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0 && errno != EINPROGRESS)
+    {
+        perror("connect");
+        close(conn.sock);
+        conn.sock = -1;
+        return false;
+    }
+    return true;
+}
+
+// Sends the registration PDU once the connect has completed.
+static bool sendRegistration(BenchConnection &conn)
+{
+    int soError = 0;
+    socklen_t soLen = sizeof(soError);
+    if (getsockopt(conn.sock, SOL_SOCKET, SO_ERROR, &soError, &soLen) < 0 || soError != 0)
+        return false;
+
+    uint8_t packet[512];
+    int totalLength = buildRegistrationPacket(conn.handle.c_str(), packet);
+    conn.registrationSent = chrono::steady_clock::now();
+
+    // A registration PDU is tiny; a fresh socket always has room for it.
+    return send(conn.sock, packet, totalLength, 0) == totalLength;
+}
+
+// Runs one concurrency level and returns its statistics.
+static BenchLevelResult runLevel(const struct sockaddr_in &serverAddr, int connections, int concurrency,
+                                 int duplicatePercent, int levelIndex, default_random_engine &eng)
+{
+    BenchLevelResult result;
+    result.elapsedSeconds = 0.0;
+    result.concurrency = concurrency;
+    result.attempted = connections;
+    result.uniqueAccepted = result.uniqueRejected = 0;
+    result.duplicatesRejected = result.duplicatesAccepted = 0;
+    result.failures = 0;
+
+    uniform_int_distribution<int> percentDist(0, 99);
+    vector<BenchConnection> conns(connections);
+    vector<string> confirmedHandles;
+    vector<int> openSockets; // Kept open (registered) until the level finishes.
+    vector<int> inFlight;    // Indices into conns.
+    int nextToStart = 0;
+
+    chrono::steady_clock::time_point levelStart = chrono::steady_clock::now();
+
+    while (nextToStart < connections || !inFlight.empty())
+    {
+        // Top up the in-flight window.
+        while (nextToStart < connections && static_cast<int>(inFlight.size()) < concurrency)
+        {
+            BenchConnection &conn = conns[nextToStart];
+            conn.duplicate = !confirmedHandles.empty() && percentDist(eng) < duplicatePercent;
+            if (conn.duplicate)
+            {
+                uniform_int_distribution<size_t> pick(0, confirmedHandles.size() - 1);
+                conn.handle = confirmedHandles[pick(eng)];
+            }
+            else
+            {
+                conn.handle = "bench" + to_string(levelIndex) + "_" + to_string(nextToStart);
+            }
+
+            if (startConnect(conn, serverAddr))
+                inFlight.push_back(nextToStart);
+            else
+                result.failures++;
+            nextToStart++;
+        }
+
+        vector<struct pollfd> fds(inFlight.size());
+        for (size_t i = 0; i < inFlight.size(); i++)
+        {
+            BenchConnection &conn = conns[inFlight[i]];
+            fds[i].fd = conn.sock;
+            fds[i].events = (conn.state == BENCH_CONNECTING) ? POLLOUT : POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds.data(), fds.size(), BENCH_STALL_TIMEOUT_MS) <= 0)
+        {
+            cerr << "Timed out waiting for the server; abandoning " << inFlight.size() << " connections." << endl;
+            for (size_t i = 0; i < inFlight.size(); i++)
+                close(conns[inFlight[i]].sock);
+            result.failures += inFlight.size();
+            inFlight.clear();
+            break;
+        }
+
+        vector<int> stillInFlight;
+        for (size_t i = 0; i < inFlight.size(); i++)
+        {
+            BenchConnection &conn = conns[inFlight[i]];
+            if (fds[i].revents == 0)
+            {
+                stillInFlight.push_back(inFlight[i]);
+                continue;
+            }
+
+            if (conn.state == BENCH_CONNECTING)
+            {
+                if (sendRegistration(conn))
+                {
+                    conn.state = BENCH_AWAITING_RESPONSE;
+                    stillInFlight.push_back(inFlight[i]);
+                }
+                else
+                {
+                    result.failures++;
+                    close(conn.sock);
+                }
+                continue;
+            }
+
+            int n = recv(conn.sock, conn.response + conn.responseBytes,
+                         sizeof(conn.response) - conn.responseBytes, 0);
+            if (n <= 0)
+            {
+                // The server closes duplicates right after the error PDU; a
+                // reset before we read it counts as a failure.
+                result.failures++;
+                close(conn.sock);
+                continue;
+            }
+            conn.responseBytes += n;
+            if (conn.responseBytes < static_cast<int>(sizeof(conn.response)))
+            {
+                stillInFlight.push_back(inFlight[i]);
+                continue;
+            }
+
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            result.connectToConfirmUs.push_back(chrono::duration<double, micro>(now - conn.connectStart).count());
+            result.registerToConfirmUs.push_back(chrono::duration<double, micro>(now - conn.registrationSent).count());
+            conn.state = BENCH_DONE;
+
+            int flag = reinterpret_cast<PDU_Header *>(conn.response)->flag;
+            if (flag == CONFIRM_GOOD_HANDLE)
+            {
+                if (conn.duplicate)
+                    result.duplicatesAccepted++;
+                else
+                    result.uniqueAccepted++;
+                confirmedHandles.push_back(conn.handle);
+                openSockets.push_back(conn.sock);
+            }
+            else if (flag == ERROR_ON_INIT_PACKET)
+            {
+                if (conn.duplicate)
+                    result.duplicatesRejected++;
+                else
+                    result.uniqueRejected++;
+                close(conn.sock);
+            }
+            else
+            {
+                result.failures++;
+                close(conn.sock);
+            }
+        }
+        inFlight.swap(stillInFlight);
+    }
+
+    result.elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - levelStart).count();
+
+    // Disconnect everything so the next level starts with an empty handle table.
+    for (size_t i = 0; i < openSockets.size(); i++)
+        close(openSockets[i]);
+
+    return result;
+}
+
+static void printLevelResult(BenchLevelResult &r)
+{
+    int completed = static_cast<int>(r.connectToConfirmUs.size());
+    double rate = r.elapsedSeconds > 0 ? completed / r.elapsedSeconds : 0.0;
+    bool correct = (r.uniqueRejected == 0 && r.duplicatesAccepted == 0);
+
+    cout << setw(11) << r.concurrency
+         << setw(8) << r.attempted
+         << setw(10) << fixed << setprecision(3) << r.elapsedSeconds
+         << setw(11) << setprecision(0) << rate
+         << setw(10) << setprecision(0) << percentile(r.connectToConfirmUs, 0.50)
+         << setw(10) << percentile(r.connectToConfirmUs, 0.99)
+         << setw(11) << percentile(r.connectToConfirmUs, 1.0)
+         << setw(10) << percentile(r.registerToConfirmUs, 0.50)
+         << setw(10) << percentile(r.registerToConfirmUs, 0.99)
+         << setw(9) << r.uniqueAccepted << "/" << left << setw(4) << r.uniqueRejected << right
+         << setw(7) << r.duplicatesRejected << "/" << left << setw(4) << r.duplicatesAccepted << right
+         << setw(6) << r.failures
+         << "  " << (correct ? "OK" : "WRONG") << endl;
+}
+
+// Runs the benchmark for every requested concurrency level.
+static int runBenchmark(const char *server_ip, int port, int connections,
+                        const vector<int> &levels, int duplicatePercent)
+{
+    raiseFileLimit();
+
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &serverAddr.sin_addr) <= 0)
+    {
+        perror("inet_pton");
+        return 1;
+    }
+
+    cout << "Registration benchmark: " << connections << " connections per level, "
+         << duplicatePercent << "% duplicate handles" << endl;
+    cout << "Latencies in microseconds. unique = accepted/wrongly rejected, dup = rejected/wrongly accepted." << endl;
+    cout << setw(11) << "concurrency" << setw(8) << "conns" << setw(10) << "secs" << setw(11) << "regs/s"
+         << setw(10) << "c2c p50" << setw(10) << "c2c p99" << setw(11) << "c2c max"
+         << setw(10) << "r2c p50" << setw(10) << "r2c p99"
+         << setw(14) << "unique" << setw(12) << "dup" << setw(6) << "fail" << endl;
+
+    default_random_engine eng(12345);
+    bool allCorrect = true;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        BenchLevelResult r = runLevel(serverAddr, connections, levels[i], duplicatePercent, static_cast<int>(i), eng);
+        printLevelResult(r);
+        allCorrect = allCorrect && r.uniqueRejected == 0 && r.duplicatesAccepted == 0;
+
+        // Give the server a moment to process the disconnects.
+        usleep(200 * 1000);
+    }
+    return allCorrect ? 0 : 2;
+}
+
+// Parses a comma separated list of positive integers.
+static vector<int> parseLevels(const string &text)
+{
+    vector<int> levels;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t comma = text.find(',', start);
+        string part = text.substr(start, comma == string::npos ? string::npos : comma - start);
+        int value = atoi(part.c_str());
+        if (value > 0)
+            levels.push_back(value);
+        if (comma == string::npos)
+            break;
+        start = comma + 1;
+    }
+    return levels;
+}
+
+static void usage(const char *program)
+{
+    cerr << "Usage: " << program << " <server_ip> <port> <handle>" << endl;
+    cerr << "       " << program << " <server_ip> <port> --bench <connections>"
+         << " [--concurrency 1,10,100,1000] [--duplicates <percent>]" << endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+        usage(argv[0]);
+
+    const char *server_ip = argv[1];
+    int port = atoi(argv[2]);
+
+    if (string(argv[3]) != "--bench")
+    {
+        if (argc != 4)
+            usage(argv[0]);
+        return registerOnce(server_ip, port, argv[3]);
+    }
+
+    if (argc < 5)
+        usage(argv[0]);
+
+    int connections = atoi(argv[4]);
+    vector<int> levels = parseLevels("1,10,100,1000");
+    int duplicatePercent = 10;
+
+    for (int i = 5; i < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg == "--concurrency" && i + 1 < argc)
+            levels = parseLevels(argv[++i]);
+        else if (arg == "--duplicates" && i + 1 < argc)
+            duplicatePercent = atoi(argv[++i]);
+        else
+            usage(argv[0]);
+    }
+
+    if (connections < 1 || levels.empty() || duplicatePercent < 0 || duplicatePercent > 100)
+        usage(argv[0]);
+
+    return runBenchmark(server_ip, port, connections, levels, duplicatePercent);
+}